@@ -24,6 +24,16 @@ CONF_DISPLAY_ENABLE_PIN = "display_enable_pin"  # New testing-only configuration
 CONF_MESSAGE_QUEUE_SIZE_SENSOR = "message_queue_size_sensor"
 CONF_LAST_MESSAGE_SENSOR = "last_message_sensor"
 CONF_PURGE_INTERVAL_HOURS = "purge_interval_hours"  # New configuration for database maintenance
+CONF_CONTENT_PACK_PARTITION = "content_pack_partition"  # Flash partition with prebuilt, memory-mapped messages
+CONF_LOG_RING_SIZE = "log_ring_size"  # RAM for deferred-format hot-path logs (0 = log directly)
+CONF_FAULT_INJECTION = "fault_injection"  # Compile in the fault-injection hooks (testing only)
+CONF_JOB_BUDGET_US = "job_budget_us"  # Time per loop() for background storage jobs
+CONF_DISPLAY_COUNT_FLUSH_INTERVAL = "display_count_flush_interval"  # Seconds between display count writes
+CONF_TRANSITION_MIN_DURATION = "transition_min_duration"  # Bounds for cycle 6 following the wire time
+CONF_TRANSITION_MAX_DURATION = "transition_max_duration"
+CONF_SHADOW_POLICIES = "shadow_policies"  # Scheduling policies evaluated next to the live one, never displayed
+
+SCHEDULING_POLICIES = ["round_robin", "oldest_first", "strict_priority", "lottery"]
 
 # Configuration schema with all required parameters
 CONFIG_SCHEMA = cv.Schema({
@@ -31,6 +41,8 @@ CONFIG_SCHEMA = cv.Schema({
     cv.Required(CONF_UART_ID): cv.use_id(uart.UARTComponent),
     cv.Required(CONF_DATABASE_PATH): cv.string,
     cv.Optional(CONF_TRANSITION_DURATION, default=4): cv.positive_int,
+    cv.Inclusive(CONF_TRANSITION_MIN_DURATION, "transition_bounds"): cv.positive_time_period_milliseconds,
+    cv.Inclusive(CONF_TRANSITION_MAX_DURATION, "transition_bounds"): cv.positive_time_period_milliseconds,
     cv.Optional(CONF_TIME_SYNC_INTERVAL, default=60): cv.positive_int,
     cv.Optional(CONF_EMERGENCY_PRIORITY_THRESHOLD, default=95): cv.int_range(min=0, max=100),
     cv.Optional(CONF_RUN_TESTS_ON_STARTUP, default=False): cv.boolean,
@@ -40,8 +52,26 @@ CONFIG_SCHEMA = cv.Schema({
     cv.Optional(CONF_MESSAGE_QUEUE_SIZE_SENSOR): cv.use_id(Sensor),
     cv.Optional(CONF_LAST_MESSAGE_SENSOR): cv.use_id(TextSensor),
     cv.Optional(CONF_PURGE_INTERVAL_HOURS, default=24): cv.positive_int,  # Default to 24 hours
+    cv.Optional(CONF_CONTENT_PACK_PARTITION): cv.All(cv.string, cv.Length(min=1, max=16)),
+    cv.Optional(CONF_LOG_RING_SIZE, default=8192): cv.int_range(min=0, max=65536),
+    cv.Optional(CONF_FAULT_INJECTION, default=False): cv.boolean,
+    cv.Optional(CONF_JOB_BUDGET_US, default=4000): cv.int_range(min=500, max=100000),
+    cv.Optional(CONF_DISPLAY_COUNT_FLUSH_INTERVAL, default=300): cv.int_range(min=10, max=86400),
+    cv.Optional(CONF_SHADOW_POLICIES, default=[]): cv.All(
+        cv.ensure_list(cv.one_of(*SCHEDULING_POLICIES, lower=True)), cv.Length(max=len(SCHEDULING_POLICIES))
+    ),
 }).extend(cv.COMPONENT_SCHEMA)
 
+
+def validate_transition_bounds(config):
+    if CONF_TRANSITION_MIN_DURATION in config:
+        if config[CONF_TRANSITION_MIN_DURATION] > config[CONF_TRANSITION_MAX_DURATION]:
+            raise cv.Invalid(f"{CONF_TRANSITION_MIN_DURATION} must not exceed {CONF_TRANSITION_MAX_DURATION}")
+    return config
+
+
+CONFIG_SCHEMA = cv.All(CONFIG_SCHEMA, validate_transition_bounds)
+
 async def to_code(config):
     # This function generates C++ code for the component
     var = cg.new_Pvariable(config[CONF_ID])
@@ -54,6 +84,9 @@ async def to_code(config):
     # Set configuration values
     cg.add(var.set_database_path(config[CONF_DATABASE_PATH]))
     cg.add(var.set_transition_duration(config[CONF_TRANSITION_DURATION]))
+    if CONF_TRANSITION_MIN_DURATION in config:
+        cg.add(var.set_transition_bounds(config[CONF_TRANSITION_MIN_DURATION].total_milliseconds,
+                                         config[CONF_TRANSITION_MAX_DURATION].total_milliseconds))
     cg.add(var.set_time_sync_interval(config[CONF_TIME_SYNC_INTERVAL]))
     cg.add(var.set_emergency_priority_threshold(config[CONF_EMERGENCY_PRIORITY_THRESHOLD]))
     cg.add(var.set_run_tests_on_startup(config[CONF_RUN_TESTS_ON_STARTUP]))
@@ -65,6 +98,28 @@ async def to_code(config):
     
     # Set database maintenance configuration
     cg.add(var.set_purge_interval_hours(config[CONF_PURGE_INTERVAL_HOURS]))
+
+    # Content pack partition (optional)
+    if CONF_CONTENT_PACK_PARTITION in config:
+        cg.add(var.set_content_pack_partition(config[CONF_CONTENT_PACK_PARTITION]))
+
+    # Hot-path log ring
+    cg.add(var.set_log_ring_size(config[CONF_LOG_RING_SIZE]))
+
+    # Background job budget
+    cg.add(var.set_job_budget_us(config[CONF_JOB_BUDGET_US]))
+
+    # Batched writes of display counts (count-limited messages)
+    cg.add(var.set_display_count_flush_interval(config[CONF_DISPLAY_COUNT_FLUSH_INTERVAL]))
+
+    # Shadow scheduling policies (compared via report_scheduling)
+    for policy in config[CONF_SHADOW_POLICIES]:
+        cg.add(var.add_shadow_policy(policy))
+
+    # Fault-injection hooks (testing only). A build flag rather than a define, so every translation unit sees
+    # it: the hooks sit in inline functions and class layouts that must agree across files.
+    if config[CONF_FAULT_INJECTION]:
+        cg.add_build_flag("-DB48_FAULT_INJECTION")
         
     # Connect sensors if specified
     if CONF_MESSAGE_QUEUE_SIZE_SENSOR in config:
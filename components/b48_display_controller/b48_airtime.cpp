@@ -0,0 +1,195 @@
+#include "b48_airtime.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace b48_display_controller {
+
+static const char *const TAG = "b48c.airtime";
+
+void B48AirtimeLedger::enter(AirtimeState state, uint32_t now_ms) {
+  if (!this->started_) {
+    this->started_ = true;
+  } else if (state == this->current_) {
+    return;  // Called every loop; only a change closes the span
+  } else {
+    this->totals_ms_[this->current_] += now_ms - this->since_ms_;
+  }
+  this->current_ = state;
+  this->since_ms_ = now_ms;
+  this->entries_[state]++;
+}
+
+uint64_t B48AirtimeLedger::total_ms(AirtimeState state, uint32_t now_ms) const {
+  uint64_t total = this->totals_ms_[state];
+  if (this->started_ && state == this->current_) {
+    total += now_ms - this->since_ms_;
+  }
+  return total;
+}
+
+uint64_t B48AirtimeLedger::tracked_ms(uint32_t now_ms) const {
+  uint64_t total = 0;
+  for (int state = 0; state < AIRTIME_STATE_COUNT; state++) {
+    total += this->total_ms(static_cast<AirtimeState>(state), now_ms);
+  }
+  return total;
+}
+
+float B48AirtimeLedger::content_ratio(uint32_t now_ms) const {
+  uint64_t transition_ms = this->total_ms(AIRTIME_TRANSITION, now_ms);
+  if (transition_ms == 0) {
+    return 0.0f;
+  }
+  return static_cast<float>(this->total_ms(AIRTIME_CONTENT, now_ms)) / transition_ms;
+}
+
+void B48AirtimeLedger::reset(uint32_t now_ms) {
+  for (int state = 0; state < AIRTIME_STATE_COUNT; state++) {
+    this->totals_ms_[state] = 0;
+    this->entries_[state] = 0;
+  }
+  this->since_ms_ = now_ms;
+}
+
+void B48AirtimeLedger::log_report(uint32_t now_ms) const {
+  uint64_t tracked = this->tracked_ms(now_ms);
+  ESP_LOGI(TAG, "Airtime: %u s tracked, now %s", (unsigned) (tracked / 1000), state_name(this->current_));
+  for (int state = 0; state < AIRTIME_STATE_COUNT; state++) {
+    uint64_t total = this->total_ms(static_cast<AirtimeState>(state), now_ms);
+    ESP_LOGI(TAG, "  %-10s %8u s %5.1f%% in %u spans", state_name(static_cast<AirtimeState>(state)),
+             (unsigned) (total / 1000), tracked ? 100.0f * total / tracked : 0.0f, (unsigned) this->entries_[state]);
+  }
+}
+
+const char *B48AirtimeLedger::state_name(AirtimeState state) {
+  switch (state) {
+    case AIRTIME_TRANSITION:
+      return "transition";
+    case AIRTIME_CONTENT:
+      return "content";
+    case AIRTIME_FALLBACK:
+      return "fallback";
+    case AIRTIME_PAUSED:
+      return "paused";
+    case AIRTIME_TEST:
+      return "test";
+    default:
+      return "?";
+  }
+}
+
+void B48TransitionTuner::set_fixed_duration(uint32_t duration_ms) {
+  this->fixed_ms_ = duration_ms;
+  this->planned_ms_ = duration_ms;
+  if (this->adaptive()) {
+    this->set_bounds(this->min_ms_, this->max_ms_);
+  }
+}
+
+void B48TransitionTuner::set_bounds(uint32_t min_ms, uint32_t max_ms) {
+  this->min_ms_ = min_ms;
+  this->max_ms_ = max_ms;
+  // The fixed duration is the starting point
+  if (this->planned_ms_ < min_ms) {
+    this->planned_ms_ = min_ms;
+  } else if (this->planned_ms_ > max_ms) {
+    this->planned_ms_ = max_ms;
+  }
+}
+
+bool B48TransitionTuner::may_end(uint32_t elapsed_ms, uint32_t drained_ms) const {
+  if (elapsed_ms < this->planned_ms_) {
+    return false;
+  }
+  if (!this->adaptive()) {
+    return true;
+  }
+  return elapsed_ms >= drained_ms + SETTLE_MS || elapsed_ms >= this->max_ms_;
+}
+
+void B48TransitionTuner::record(uint32_t elapsed_ms, uint32_t drained_ms, uint32_t wire_bytes) {
+  uint32_t needed_ms = drained_ms + SETTLE_MS;
+  bool late = needed_ms > this->planned_ms_;
+  this->transitions_++;
+  this->drain_ms_total_ += drained_ms;
+  this->wire_bytes_total_ += wire_bytes;
+  if (drained_ms > this->longest_drain_ms_) {
+    this->longest_drain_ms_ = drained_ms;
+  }
+  if (late) {
+    this->late_++;
+  }
+  if (!this->adaptive()) {
+    return;
+  }
+
+  // The hold already kept this transition until its frames were out, so one long message only moves the plan
+  // halfway up; shorten more slowly than that
+  uint32_t planned = this->planned_ms_;
+  if (late) {
+    planned += (needed_ms - planned) / LENGTHEN_DIVISOR;
+  } else {
+    planned -= (planned - needed_ms) / DECAY_DIVISOR;
+  }
+  if (planned < this->min_ms_) {
+    planned = this->min_ms_;
+  } else if (planned > this->max_ms_) {
+    planned = this->max_ms_;
+  }
+  if (planned != this->planned_ms_) {
+    ESP_LOGV(TAG, "Cycle 6 %u -> %u ms (lasted %u ms, frames out after %u ms)", (unsigned) this->planned_ms_,
+             (unsigned) planned, (unsigned) elapsed_ms, (unsigned) drained_ms);
+    this->planned_ms_ = planned;
+  }
+}
+
+uint32_t B48TransitionTuner::average_drain_ms() const {
+  return this->transitions_ ? static_cast<uint32_t>(this->drain_ms_total_ / this->transitions_) : 0;
+}
+
+uint32_t B48TransitionTuner::average_wire_bytes() const {
+  return this->transitions_ ? static_cast<uint32_t>(this->wire_bytes_total_ / this->transitions_) : 0;
+}
+
+void B48TransitionTuner::reset_statistics() {
+  this->transitions_ = 0;
+  this->late_ = 0;
+  this->drain_ms_total_ = 0;
+  this->longest_drain_ms_ = 0;
+  this->wire_bytes_total_ = 0;
+}
+
+void B48TransitionTuner::log_report() const {
+  if (this->adaptive()) {
+    ESP_LOGI(TAG, "Cycle 6: %u ms planned (bounds %u-%u ms, fixed %u ms)", (unsigned) this->planned_ms_,
+             (unsigned) this->min_ms_, (unsigned) this->max_ms_, (unsigned) this->fixed_ms_);
+  } else {
+    ESP_LOGI(TAG, "Cycle 6: fixed %u ms (no bounds configured)", (unsigned) this->fixed_ms_);
+  }
+  ESP_LOGI(TAG, "  %u transitions, %u B on the wire on average, frames out after %u ms on average (longest %u ms), "
+           "%u late", (unsigned) this->transitions_, (unsigned) this->average_wire_bytes(),
+           (unsigned) this->average_drain_ms(), (unsigned) this->longest_drain_ms_, (unsigned) this->late_);
+}
+
+AirtimeSummary summarize_airtime(const B48AirtimeLedger &ledger, const B48TransitionTuner &tuner, uint32_t now_ms) {
+  AirtimeSummary summary{};
+  uint64_t tracked = ledger.tracked_ms(now_ms);
+  for (int state = 0; state < AIRTIME_STATE_COUNT; state++) {
+    uint64_t total = ledger.total_ms(static_cast<AirtimeState>(state), now_ms);
+    summary.share[state] = tracked ? static_cast<float>(total) / tracked : 0.0f;
+  }
+  summary.content_ratio = ledger.content_ratio(now_ms);
+  uint64_t fixed_transition_ms = static_cast<uint64_t>(tuner.transitions()) * tuner.fixed_ms();
+  if (fixed_transition_ms > 0) {
+    summary.fixed_ratio = static_cast<float>(ledger.total_ms(AIRTIME_CONTENT, now_ms)) / fixed_transition_ms;
+  }
+  summary.tracked_s = static_cast<uint32_t>(tracked / 1000);
+  summary.transitions = tuner.transitions();
+  summary.late = tuner.late();
+  summary.planned_ms = tuner.planned_ms();
+  summary.average_drain_ms = tuner.average_drain_ms();
+  return summary;
+}
+
+}  // namespace b48_display_controller
+}  // namespace esphome
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace esphome {
+namespace b48_display_controller {
+
+// What the display spends its time on. Transitions are cycle 6 (frames for the next message going out), content
+// is cycle 0 with a cached message, fallback is cycle 0 with the fallback message.
+enum AirtimeState : uint8_t {
+  AIRTIME_TRANSITION,
+  AIRTIME_CONTENT,
+  AIRTIME_FALLBACK,
+  AIRTIME_PAUSED,  // State machine paused from HA
+  AIRTIME_TEST,    // Time test and character test modes
+  AIRTIME_STATE_COUNT
+};
+
+/**
+ * @brief Wall time per display state, charged by the state machine as it moves between states.
+ *
+ * Times come from the caller (millis() on the device, a virtual clock in tests); spans are computed with
+ * unsigned subtraction, so a millis() wrap in between is harmless. Not thread-safe: loop task only.
+ */
+class B48AirtimeLedger {
+ public:
+  // Charge the time since the last call to the state it was in, then continue in `state`
+  void enter(AirtimeState state, uint32_t now_ms);
+  AirtimeState current() const { return this->current_; }
+
+  uint64_t total_ms(AirtimeState state, uint32_t now_ms) const;  // Includes the open span of the current state
+  uint32_t entries(AirtimeState state) const { return this->entries_[state]; }
+  uint64_t tracked_ms(uint32_t now_ms) const;  // All states together
+
+  // Content time per transition time; 0 without any transition time
+  float content_ratio(uint32_t now_ms) const;
+
+  void reset(uint32_t now_ms);
+  void log_report(uint32_t now_ms) const;
+
+  static const char *state_name(AirtimeState state);
+
+ protected:
+  uint64_t totals_ms_[AIRTIME_STATE_COUNT]{};
+  uint32_t entries_[AIRTIME_STATE_COUNT]{};
+  AirtimeState current_{AIRTIME_TRANSITION};
+  uint32_t since_ms_{0};
+  bool started_{false};
+};
+
+/**
+ * @brief Closed-loop length of cycle 6, from when the transition's frames actually leave the UART.
+ *
+ * A transition may end once its planned duration has passed and its frames (plus SETTLE_MS for the display to
+ * take them over) are out; while they are not, it is held up to the upper bound. After each transition the
+ * planned duration moves towards the drain time: by half the shortfall when frames were still going out at the
+ * planned end, by a quarter of the slack when they were out early. Without bounds the duration stays fixed and
+ * only the statistics are kept.
+ */
+class B48TransitionTuner {
+ public:
+  void set_fixed_duration(uint32_t duration_ms);
+  void set_bounds(uint32_t min_ms, uint32_t max_ms);
+  bool adaptive() const { return this->max_ms_ > 0; }
+  uint32_t min_ms() const { return this->min_ms_; }
+  uint32_t max_ms() const { return this->max_ms_; }
+
+  uint32_t planned_ms() const { return this->planned_ms_; }  // Cycle 6 time for the next transition
+
+  /**
+   * @brief Whether a transition may switch to cycle 0
+   * @param elapsed_ms Time since the transition started
+   * @param drained_ms When its frames leave the UART, counted from the transition start
+   */
+  bool may_end(uint32_t elapsed_ms, uint32_t drained_ms) const;
+
+  /**
+   * @brief Account a finished transition and adjust the planned duration
+   * @param elapsed_ms How long the transition lasted
+   * @param drained_ms When its frames left the UART, counted from the transition start
+   * @param wire_bytes Bytes sent for it
+   */
+  void record(uint32_t elapsed_ms, uint32_t drained_ms, uint32_t wire_bytes);
+
+  uint32_t transitions() const { return this->transitions_; }
+  uint32_t late() const { return this->late_; }  // Frames still going out at the planned end (held if adaptive)
+  uint32_t average_drain_ms() const;
+  uint32_t longest_drain_ms() const { return this->longest_drain_ms_; }
+  uint32_t average_wire_bytes() const;
+  uint32_t fixed_ms() const { return this->fixed_ms_; }
+
+  void reset_statistics();
+  void log_report() const;
+
+  static constexpr uint32_t SETTLE_MS = 300;  // Display takes over received frames before the cycle switch
+  static constexpr uint32_t LENGTHEN_DIVISOR = 2;  // Share of a shortfall added to the plan
+  static constexpr uint32_t DECAY_DIVISOR = 4;     // Share of the slack taken off the plan
+
+ protected:
+  uint32_t fixed_ms_{4000};
+  uint32_t planned_ms_{4000};
+  uint32_t min_ms_{0};
+  uint32_t max_ms_{0};  // 0 = fixed duration
+  uint32_t transitions_{0};
+  uint32_t late_{0};
+  uint64_t drain_ms_total_{0};
+  uint32_t longest_drain_ms_{0};
+  uint64_t wire_bytes_total_{0};
+};
+
+// Ledger and tuner figures for the report service
+struct AirtimeSummary {
+  float share[AIRTIME_STATE_COUNT];  // Fraction of the tracked time
+  float content_ratio;               // Content per transition time, as measured
+  float fixed_ratio;                 // The same if every recorded transition had lasted the fixed duration
+  uint32_t tracked_s;
+  uint32_t transitions;
+  uint32_t late;
+  uint32_t planned_ms;
+  uint32_t average_drain_ms;
+};
+
+AirtimeSummary summarize_airtime(const B48AirtimeLedger &ledger, const B48TransitionTuner &tuner, uint32_t now_ms);
+
+}  // namespace b48_display_controller
+}  // namespace esphome
@@ -0,0 +1,452 @@
+#include "b48_content_pack.h"
+#include "buse120_serial_protocol.h"
+#include "esphome/core/log.h"
+#include <cstring>
+#include <algorithm>
+
+#ifdef USE_HOST
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <esp_task_wdt.h>  // For esp_task_wdt_reset()
+#endif
+
+namespace esphome {
+namespace b48_display_controller {
+
+static const char *const TAG = "b48c.pack";
+
+static const size_t FLASH_SECTOR_SIZE = 4096;
+#ifdef USE_HOST
+static const size_t HOST_PARTITION_SIZE = 0x20000;  // Same as b48pack in b48c_partitions.csv
+#endif
+
+B48ContentPack::~B48ContentPack() { this->close(); }
+
+uint32_t B48ContentPack::crc32(const uint8_t *data, size_t length) {
+  return ~crc32_update(0xFFFFFFFFu, data, length);
+}
+
+uint32_t B48ContentPack::crc32_update(uint32_t crc, const uint8_t *data, size_t length) {
+  // Bitwise CRC-32 (IEEE 802.3); runs once per load, so no table is kept in RAM
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+#ifndef USE_HOST
+    if ((i & 0x3FFF) == 0) {
+      esp_task_wdt_reset();
+    }
+#endif
+  }
+  return crc;
+}
+
+bool B48ContentPack::validate(const uint8_t *base, size_t available) const {
+  if (available < sizeof(ContentPackHeader)) {
+    ESP_LOGE(TAG, "Partition too small for a content pack header");
+    return false;
+  }
+
+  ContentPackHeader header;
+  memcpy(&header, base, sizeof(header));
+
+  if (header.magic != CONTENT_PACK_MAGIC) {
+    ESP_LOGD(TAG, "No content pack in slot (magic 0x%08X)", (unsigned) header.magic);
+    return false;
+  }
+  if (header.format_version != CONTENT_PACK_FORMAT_VERSION) {
+    ESP_LOGE(TAG, "Unsupported content pack format version %u", header.format_version);
+    return false;
+  }
+  size_t records_end = sizeof(ContentPackHeader) + (size_t) header.record_count * sizeof(ContentPackRecord);
+  if (header.total_size > available || header.total_size < records_end) {
+    ESP_LOGE(TAG, "Content pack size %u is invalid (partition %zu bytes)", (unsigned) header.total_size, available);
+    return false;
+  }
+
+  uint32_t crc = crc32(base + sizeof(ContentPackHeader), header.total_size - sizeof(ContentPackHeader));
+  if (crc != header.body_crc32) {
+    ESP_LOGE(TAG, "Content pack CRC mismatch (stored 0x%08X, computed 0x%08X)", (unsigned) header.body_crc32,
+             (unsigned) crc);
+    return false;
+  }
+
+  const ContentPackRecord *records = reinterpret_cast<const ContentPackRecord *>(base + sizeof(ContentPackHeader));
+  for (uint16_t i = 0; i < header.record_count; i++) {
+    const ContentPackRecord &record = records[i];
+    if (record.frames_offset < records_end ||
+        (size_t) record.frames_offset + record.frames_length > header.total_size) {
+      ESP_LOGE(TAG, "Content pack record %u points outside the pack", i);
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t B48ContentPack::slot_size() const {
+  return this->partition_size_ / 2 / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE;
+}
+
+bool B48ContentPack::find_partition(const std::string &partition_label) {
+  this->partition_label_ = partition_label;
+#ifdef USE_HOST
+  if (this->fd_ >= 0) {
+    return true;
+  }
+  std::string path = partition_label + ".pack";
+  this->fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  struct stat st;
+  if (this->fd_ < 0 || fstat(this->fd_, &st) != 0) {
+    ESP_LOGE(TAG, "Cannot open content pack file '%s'", path.c_str());
+    return false;
+  }
+  if ((size_t) st.st_size < HOST_PARTITION_SIZE && ftruncate(this->fd_, HOST_PARTITION_SIZE) != 0) {
+    ESP_LOGE(TAG, "Cannot size content pack file '%s'", path.c_str());
+    return false;
+  }
+  this->partition_size_ = HOST_PARTITION_SIZE;
+#else
+  if (this->partition_) {
+    return true;
+  }
+  this->partition_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                              partition_label.c_str());
+  if (!this->partition_) {
+    ESP_LOGW(TAG, "Content pack partition '%s' not found in partition table", partition_label.c_str());
+    return false;
+  }
+  this->partition_size_ = this->partition_->size;
+#endif
+  return true;
+}
+
+bool B48ContentPack::erase_range(size_t offset, size_t length) {
+#ifdef USE_HOST
+  std::vector<uint8_t> erased(length, 0xFF);
+  return pwrite(this->fd_, erased.data(), length, offset) == (ssize_t) length;
+#else
+  return esp_partition_erase_range(this->partition_, offset, length) == ESP_OK;
+#endif
+}
+
+bool B48ContentPack::write_range(size_t offset, const void *data, size_t length) {
+#ifdef USE_HOST
+  return pwrite(this->fd_, data, length, offset) == (ssize_t) length;
+#else
+  return esp_partition_write(this->partition_, offset, data, length) == ESP_OK;
+#endif
+}
+
+bool B48ContentPack::read_range(size_t offset, void *data, size_t length) const {
+#ifdef USE_HOST
+  return pread(this->fd_, data, length, offset) == (ssize_t) length;
+#else
+  return esp_partition_read(this->partition_, offset, data, length) == ESP_OK;
+#endif
+}
+
+bool B48ContentPack::open(const std::string &partition_label) {
+  this->close();
+  if (!this->find_partition(partition_label)) {
+    return false;
+  }
+
+#ifdef USE_HOST
+  this->map_length_ = this->partition_size_;
+  void *mapped = mmap(nullptr, this->map_length_, PROT_READ, MAP_SHARED, this->fd_, 0);
+  if (mapped == MAP_FAILED) {
+    ESP_LOGE(TAG, "Failed to mmap content pack file '%s.pack'", partition_label.c_str());
+    this->close();
+    return false;
+  }
+  this->base_ = static_cast<const uint8_t *>(mapped);
+#else
+  const void *mapped = nullptr;
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_err_t err = esp_partition_mmap(this->partition_, 0, this->partition_->size, ESP_PARTITION_MMAP_DATA, &mapped,
+                                     &this->mmap_handle_);
+#else
+  esp_err_t err = esp_partition_mmap(this->partition_, 0, this->partition_->size, SPI_FLASH_MMAP_DATA, &mapped,
+                                     &this->mmap_handle_);
+#endif
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "esp_partition_mmap failed for '%s': %d", partition_label.c_str(), err);
+    this->partition_ = nullptr;
+    return false;
+  }
+  this->base_ = static_cast<const uint8_t *>(mapped);
+#endif
+
+  // The newer of two valid slots is live; the other one is the previous pack or a staged upload
+  uint32_t best_generation = 0;
+  for (int slot = 0; slot < 2; slot++) {
+    const uint8_t *slot_base = this->base_ + slot * this->slot_size();
+    if (!this->validate(slot_base, this->slot_size())) {
+      continue;
+    }
+    const ContentPackHeader *header = reinterpret_cast<const ContentPackHeader *>(slot_base);
+    if (this->active_slot_ < 0 || header->generation > best_generation) {
+      this->active_slot_ = slot;
+      best_generation = header->generation;
+    }
+  }
+  if (this->active_slot_ < 0) {
+    ESP_LOGW(TAG, "No valid content pack in partition '%s'", partition_label.c_str());
+    this->close();
+    return false;
+  }
+
+  this->header_ = reinterpret_cast<const ContentPackHeader *>(this->base_ + this->active_slot_ * this->slot_size());
+  ESP_LOGI(TAG, "Mapped content pack '%s' slot %d: %u records, %u bytes, generation %u", partition_label.c_str(),
+           this->active_slot_, this->header_->record_count, (unsigned) this->header_->total_size,
+           (unsigned) this->header_->generation);
+  return true;
+}
+
+void B48ContentPack::close() {
+  this->header_ = nullptr;
+  this->active_slot_ = -1;
+#ifdef USE_HOST
+  if (this->base_) {
+    munmap(const_cast<uint8_t *>(this->base_), this->map_length_);
+  }
+  if (this->fd_ >= 0 && this->update_size_ == 0) {
+    ::close(this->fd_);
+    this->fd_ = -1;
+  }
+  this->map_length_ = 0;
+#else
+  if (this->base_) {
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_partition_munmap(this->mmap_handle_);
+#else
+    spi_flash_munmap(this->mmap_handle_);
+#endif
+    this->mmap_handle_ = 0;
+  }
+#endif
+  this->base_ = nullptr;
+}
+
+std::vector<MessageEntry> B48ContentPack::entries() const {
+  std::vector<MessageEntry> result;
+  if (!this->header_) {
+    return result;
+  }
+
+  const uint8_t *pack = reinterpret_cast<const uint8_t *>(this->header_);
+  const ContentPackRecord *records = reinterpret_cast<const ContentPackRecord *>(pack + sizeof(ContentPackHeader));
+  result.reserve(this->header_->record_count);
+  for (uint16_t i = 0; i < this->header_->record_count; i++) {
+    const ContentPackRecord &record = records[i];
+    MessageEntry entry;
+    entry.is_ephemeral = false;
+    entry.message_id = CONTENT_PACK_MESSAGE_ID_BASE + i;
+    entry.priority = record.priority;
+    entry.prebuilt_frames = pack + record.frames_offset;
+    entry.prebuilt_frames_length = record.frames_length;
+    entry.prebuilt_scroll_length = record.scroll_length;
+    entry.variant_group = record.variant_group;
+    result.push_back(entry);
+  }
+  return result;
+}
+
+std::vector<int> B48ContentPack::source_message_ids() const {
+  std::vector<int> ids;
+  if (!this->header_) {
+    return ids;
+  }
+  const ContentPackRecord *records = reinterpret_cast<const ContentPackRecord *>(
+      reinterpret_cast<const uint8_t *>(this->header_) + sizeof(ContentPackHeader));
+  for (uint16_t i = 0; i < this->header_->record_count; i++) {
+    if (records[i].source_message_id != 0) {
+      ids.push_back(static_cast<int>(records[i].source_message_id));
+    }
+  }
+  std::sort(ids.begin(), ids.end());
+  return ids;
+}
+
+std::vector<uint8_t> B48ContentPack::build(const std::vector<MessageEntry> &messages, uint32_t generation) {
+  // Encode every message exactly as the live send path would
+  std::vector<std::string> frames;
+  frames.reserve(messages.size());
+  for (const auto &msg : messages) {
+    std::string wire;
+    wire += BUSE120SerialProtocol::build_wire_frame(BUSE120SerialProtocol::line_number_payload(msg.line_number));
+    wire += BUSE120SerialProtocol::build_wire_frame(BUSE120SerialProtocol::tarif_zone_payload(msg.tarif_zone));
+    wire += BUSE120SerialProtocol::build_wire_frame(BUSE120SerialProtocol::static_intro_payload(msg.static_intro));
+    wire += BUSE120SerialProtocol::build_wire_frame(
+        BUSE120SerialProtocol::scrolling_message_payload(msg.scrolling_message));
+    wire += BUSE120SerialProtocol::build_wire_frame(
+        BUSE120SerialProtocol::next_message_hint_payload(msg.next_message_hint));
+    frames.push_back(wire);
+  }
+
+  size_t record_count = std::min<size_t>(messages.size(), 0xFFFF);
+  size_t frames_start = sizeof(ContentPackHeader) + record_count * sizeof(ContentPackRecord);
+  size_t total_size = frames_start;
+  for (size_t i = 0; i < record_count; i++) {
+    total_size += frames[i].size();
+  }
+
+  std::vector<uint8_t> image(total_size, 0);
+  size_t frames_offset = frames_start;
+  for (size_t i = 0; i < record_count; i++) {
+    ContentPackRecord record;
+    memset(&record, 0, sizeof(record));
+    record.priority = static_cast<uint8_t>(std::max(0, std::min(messages[i].priority, 100)));
+    record.frame_count = 5;
+    record.frames_length = static_cast<uint16_t>(frames[i].size());
+    record.frames_offset = static_cast<uint32_t>(frames_offset);
+    record.scroll_length = static_cast<uint16_t>(std::min<size_t>(messages[i].scrolling_message.length(), 0xFFFF));
+    record.source_message_id = messages[i].message_id > 0 ? messages[i].message_id : 0;
+    record.variant_group = messages[i].variant_group;
+    memcpy(&image[sizeof(ContentPackHeader) + i * sizeof(ContentPackRecord)], &record, sizeof(record));
+    memcpy(&image[frames_offset], frames[i].data(), frames[i].size());
+    frames_offset += frames[i].size();
+  }
+
+  ContentPackHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = CONTENT_PACK_MAGIC;
+  header.format_version = CONTENT_PACK_FORMAT_VERSION;
+  header.record_count = static_cast<uint16_t>(record_count);
+  header.total_size = static_cast<uint32_t>(total_size);
+  header.body_crc32 = crc32(image.data() + sizeof(ContentPackHeader), total_size - sizeof(ContentPackHeader));
+  header.generation = generation;
+  memcpy(image.data(), &header, sizeof(header));
+  return image;
+}
+
+bool B48ContentPack::begin_update(const std::string &partition_label, size_t total_size) {
+  this->update_size_ = 0;
+  if (partition_label != this->partition_label_) {
+    if (this->base_) {
+      ESP_LOGE(TAG, "Cannot stage into '%s' while '%s' is mapped", partition_label.c_str(),
+               this->partition_label_.c_str());
+      return false;
+    }
+    this->close();
+#ifndef USE_HOST
+    this->partition_ = nullptr;
+#endif
+  }
+  if (!this->find_partition(partition_label)) {
+    return false;
+  }
+  if (total_size < sizeof(ContentPackHeader) || total_size > this->slot_size()) {
+    ESP_LOGE(TAG, "Content pack of %zu bytes does not fit a slot of '%s' (%zu bytes)", total_size,
+             partition_label.c_str(), this->slot_size());
+    return false;
+  }
+
+  // Stage into the slot that is not live; the live pack stays mapped and in rotation
+  int slot = this->active_slot_ == 0 ? 1 : 0;
+  size_t erase_size = (total_size + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE;
+  if (!this->erase_range(slot * this->slot_size(), erase_size)) {
+    ESP_LOGE(TAG, "Failed to erase content pack slot %d", slot);
+    return false;
+  }
+
+  this->update_slot_ = slot;
+  this->update_received_ = 0;
+  memset(&this->update_header_, 0, sizeof(this->update_header_));
+  this->update_size_ = total_size;
+  ESP_LOGI(TAG, "Content pack update started: %zu bytes into '%s' slot %d", total_size, partition_label.c_str(),
+           slot);
+  return true;
+}
+
+bool B48ContentPack::write_chunk(size_t offset, const uint8_t *data, size_t length) {
+  if (this->update_size_ == 0) {
+    ESP_LOGE(TAG, "Content pack chunk received without begin_update()");
+    return false;
+  }
+  if (offset + length > this->update_size_) {
+    ESP_LOGE(TAG, "Content pack chunk at %zu (+%zu) exceeds announced size %zu", offset, length, this->update_size_);
+    return false;
+  }
+
+  // The header is kept in RAM until finish_update() has checked the body against it
+  this->update_received_ += length;
+  if (offset < sizeof(ContentPackHeader)) {
+    size_t header_part = std::min(length, sizeof(ContentPackHeader) - offset);
+    memcpy(reinterpret_cast<uint8_t *>(&this->update_header_) + offset, data, header_part);
+    offset += header_part;
+    data += header_part;
+    length -= header_part;
+  }
+  if (length > 0 && !this->write_range(this->update_slot_ * this->slot_size() + offset, data, length)) {
+    ESP_LOGE(TAG, "Failed to write content pack chunk at %zu", offset);
+    return false;
+  }
+  return true;
+}
+
+bool B48ContentPack::finish_update() {
+  if (this->update_size_ == 0) {
+    ESP_LOGE(TAG, "No content pack update in progress");
+    return false;
+  }
+  size_t total_size = this->update_size_;
+  size_t slot_offset = this->update_slot_ * this->slot_size();
+  this->update_size_ = 0;
+
+  ContentPackHeader &header = this->update_header_;
+  if (this->update_received_ < total_size || header.magic != CONTENT_PACK_MAGIC ||
+      header.format_version != CONTENT_PACK_FORMAT_VERSION || header.total_size != total_size) {
+    ESP_LOGE(TAG, "Content pack upload incomplete or malformed (%zu of %zu bytes, magic 0x%08X), keeping the live "
+             "pack", this->update_received_, total_size, (unsigned) header.magic);
+    return false;
+  }
+
+  // Read the staged body back from flash, so a bad write is caught as well as a bad upload
+  uint8_t buffer[256];
+  uint32_t crc = 0xFFFFFFFFu;
+  for (size_t offset = sizeof(ContentPackHeader); offset < total_size; offset += sizeof(buffer)) {
+    size_t length = std::min(sizeof(buffer), total_size - offset);
+    if (!this->read_range(slot_offset + offset, buffer, length)) {
+      ESP_LOGE(TAG, "Failed to read back content pack slot %d", this->update_slot_);
+      return false;
+    }
+    crc = crc32_update(crc, buffer, length);
+  }
+  crc = ~crc;
+  if (crc != header.body_crc32) {
+    ESP_LOGE(TAG, "Staged content pack CRC mismatch (header 0x%08X, body 0x%08X), keeping the live pack",
+             (unsigned) header.body_crc32, (unsigned) crc);
+    return false;
+  }
+
+  // Outside the CRC, so it can be raised to make the staged pack the newer one
+  if (this->header_ && header.generation <= this->header_->generation) {
+    header.generation = this->header_->generation + 1;
+  }
+  if (!this->write_range(slot_offset, &header, sizeof(header))) {
+    ESP_LOGE(TAG, "Failed to write content pack header to slot %d", this->update_slot_);
+    return false;
+  }
+  ESP_LOGI(TAG, "Content pack generation %u committed to slot %d", (unsigned) header.generation,
+           this->update_slot_);
+  return true;
+}
+
+bool B48ContentPack::write_image(const std::string &partition_label, const std::vector<uint8_t> &image) {
+  if (!this->begin_update(partition_label, image.size())) {
+    return false;
+  }
+  if (!this->write_chunk(0, image.data(), image.size())) {
+    this->update_size_ = 0;
+    return false;
+  }
+  return this->finish_update();
+}
+
+}  // namespace b48_display_controller
+}  // namespace esphome
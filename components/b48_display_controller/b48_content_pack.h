@@ -0,0 +1,153 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "b48_database_manager.h"  // For MessageEntry
+
+#ifndef USE_HOST
+#include <esp_partition.h>
+#include <esp_idf_version.h>
+#endif
+
+namespace esphome {
+namespace b48_display_controller {
+
+// Message IDs of content pack entries start here so they never collide with SQLite row IDs
+static const int CONTENT_PACK_MESSAGE_ID_BASE = 0x40000000;
+
+static const uint32_t CONTENT_PACK_MAGIC = 0x50383442;  // "B48P" little-endian
+static const uint16_t CONTENT_PACK_FORMAT_VERSION = 2;
+
+// On-flash layout (little-endian, all offsets from the start of the pack):
+//   ContentPackHeader | ContentPackRecord[record_count] | frame blob
+// Each record's frames are the complete wire bytes (payload, CR, checksum) for l, e, zI, zM and v,
+// so a message is sent with a single UART write straight out of mapped flash.
+// The partition holds two such slots of half its size each; the valid one with the higher generation is live.
+struct ContentPackHeader {
+  uint32_t magic;
+  uint16_t format_version;
+  uint16_t record_count;
+  uint32_t total_size;  // Header + records + frames
+  uint32_t body_crc32;  // CRC-32 of everything after the header
+  uint32_t generation;  // Incremented on every replacement; the higher of two valid slots is live
+  uint32_t reserved[3];
+};
+
+struct ContentPackRecord {
+  uint8_t priority;
+  uint8_t frame_count;
+  uint16_t frames_length;
+  uint32_t frames_offset;
+  uint16_t scroll_length;  // Unencoded scroll text length
+  uint16_t reserved;
+  uint32_t variant_group;      // variant_group_id() of the group key, so pack and SQLite variants share a slot
+  uint32_t source_message_id;  // SQLite ID the record was exported from (0 if unknown)
+};
+
+static_assert(sizeof(ContentPackHeader) == 32, "ContentPackHeader must stay 32 bytes");
+static_assert(sizeof(ContentPackRecord) == 20, "ContentPackRecord must stay 20 bytes");
+
+/**
+ * @brief Read-only, memory-mapped pack of pre-encoded messages in its own flash partition.
+ *
+ * The pack is mapped with esp_partition_mmap (plain mmap of "<label>.pack" in host builds) and
+ * read in place. It can be replaced at runtime - either exported from the SQLite cache or
+ * uploaded in chunks over the API - without reflashing the application. A replacement is staged in the
+ * slot that is not live and its header is written last, once the body CRC checks out, so a failed or
+ * interrupted upload leaves the live pack in place.
+ */
+class B48ContentPack {
+ public:
+  B48ContentPack() = default;
+  ~B48ContentPack();
+
+  /**
+   * @brief Map the partition and validate the pack
+   * @param partition_label Label of the data partition holding the pack
+   * @return true if a valid pack is mapped
+   */
+  bool open(const std::string &partition_label);
+
+  /**
+   * @brief Unmap the partition. Pointers handed out by entries() become invalid.
+   */
+  void close();
+
+  bool is_loaded() const { return this->header_ != nullptr; }
+  uint16_t record_count() const { return this->header_ ? this->header_->record_count : 0; }
+  uint32_t generation() const { return this->header_ ? this->header_->generation : 0; }
+  size_t mapped_size() const { return this->header_ ? this->header_->total_size : 0; }
+  size_t partition_size() const { return this->partition_size_; }
+  size_t slot_size() const;   // Largest pack that fits: half the partition, in whole flash sectors
+  int active_slot() const { return this->active_slot_; }  // -1 without a valid pack
+
+  /**
+   * @brief Build scheduler entries that point into mapped flash (no text copies)
+   */
+  std::vector<MessageEntry> entries() const;
+
+  // SQLite message IDs the records were exported from, sorted (uploads built elsewhere may carry none)
+  std::vector<int> source_message_ids() const;
+
+  /**
+   * @brief Serialize messages into pack format (frames are encoded exactly as they go on the wire)
+   * @param messages Source messages, usually the persistent cache
+   * @param generation Generation number stored in the header
+   * @return The complete pack image
+   */
+  static std::vector<uint8_t> build(const std::vector<MessageEntry> &messages, uint32_t generation);
+
+  // --- Over-the-air replacement ---
+  // begin_update() erases the slot that is not live, write_chunk() programs the body there and keeps the header
+  // in RAM, finish_update() checks the staged body against it and writes the header last. The live pack stays
+  // mapped throughout; open() afterwards switches to the new one. A staged pack that fails its checks never
+  // gets a header, so open() keeps ignoring it.
+  bool begin_update(const std::string &partition_label, size_t total_size);
+  bool write_chunk(size_t offset, const uint8_t *data, size_t length);
+  bool finish_update();
+  bool write_image(const std::string &partition_label, const std::vector<uint8_t> &image);
+
+  static uint32_t crc32(const uint8_t *data, size_t length);
+  static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t length);  // Start and end with ~crc
+
+ protected:
+  bool validate(const uint8_t *base, size_t available) const;
+
+  // Partition access; offsets are from the start of the partition
+  bool find_partition(const std::string &partition_label);
+  bool erase_range(size_t offset, size_t length);
+  bool write_range(size_t offset, const void *data, size_t length);
+  bool read_range(size_t offset, void *data, size_t length) const;
+
+  std::string partition_label_;
+  const uint8_t *base_{nullptr};  // Whole partition
+  const ContentPackHeader *header_{nullptr};  // Live slot
+  int active_slot_{-1};
+  size_t partition_size_{0};
+  size_t update_size_{0};  // Expected size of an upload in progress (0 = none)
+  int update_slot_{-1};
+  size_t update_received_{0};
+  ContentPackHeader update_header_{};  // Held back until the staged body is verified
+
+#ifdef USE_HOST
+  int fd_{-1};
+  size_t map_length_{0};
+#else
+  const esp_partition_t *partition_{nullptr};
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_partition_mmap_handle_t mmap_handle_{0};
+#else
+  spi_flash_mmap_handle_t mmap_handle_{0};
+#endif
+#endif
+
+  // Disable copy and assign
+  B48ContentPack(const B48ContentPack &) = delete;
+  B48ContentPack &operator=(const B48ContentPack &) = delete;
+};
+
+}  // namespace b48_display_controller
+}  // namespace esphome
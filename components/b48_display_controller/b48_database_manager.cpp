@@ -1,8 +1,11 @@
 #include "b48_database_manager.h"
 #include "character_mappings.h"
+#include "b48_log_ring.h"
 #include "esphome/core/log.h"
 #include <sqlite3.h>
 #include <utility>         // For std::move
+#include <algorithm>       // For std::transform
+#include <cstring>         // For strstr
 #include <ctime>           // Required for time(nullptr) in add_persistent_message call if used there.
 #include <Arduino.h>       // For delay() and yield()
 #include <esp_task_wdt.h>  // For esp_task_wdt_reset()
@@ -12,6 +15,149 @@ namespace b48_display_controller {
 
 static const char *const TAG = "b48c.db";  // Tag for database manager
 
+// --- Schema Migrations ---
+// Each step brings the schema from (version - 1) to version. The DDL must be cheap (ALTER TABLE ADD COLUMN,
+// CREATE INDEX on small tables) because it runs inside setup(). Anything that has to touch every row goes
+// into backfill_sql, which is executed over message_id ranges: ?1 = exclusive lower bound, ?2 = inclusive
+// upper bound. Backfill statements must be idempotent, since a chunk may be repeated after a power loss.
+// Readers must cope with rows that have not been backfilled yet (new columns are NULL until then).
+// An optional step whose DDL fails (e.g. SQLite built without FTS5) is recorded as done without its
+// feature; the code using it must check for its tables and fall back.
+struct SchemaMigration {
+  int version;
+  const char *description;
+  const char *ddl;
+  const char *backfill_sql;  // nullptr if the step needs no backfill
+  bool optional;
+};
+
+static const SchemaMigration SCHEMA_MIGRATIONS[] = {
+    {2, "content_hash for indexed duplicate checks",
+     R"SQL(
+       ALTER TABLE messages ADD COLUMN content_hash INTEGER DEFAULT NULL;
+       CREATE INDEX IF NOT EXISTS idx_messages_content_hash ON messages (is_enabled, content_hash);
+     )SQL",
+     R"SQL(
+       UPDATE messages SET content_hash = b48_hash(scrolling_message)
+       WHERE message_id > ?1 AND message_id <= ?2 AND content_hash IS NULL;
+     )SQL",
+     false},
+    {3, "variant_group linking translations of one message",
+     R"SQL(
+       ALTER TABLE messages ADD COLUMN variant_group TEXT DEFAULT NULL;
+     )SQL",
+     // Older databases hold the bootstrap set without group keys; link its Czech/English pairs
+     R"SQL(
+       UPDATE messages SET variant_group = CASE
+           WHEN priority = 40 AND next_message_hint = 'Loading' THEN 'support'
+           WHEN priority = 36 AND next_message_hint = 'Loading' THEN 'barbecue'
+           WHEN priority = 38 AND next_message_hint = 'Cleaning' THEN 'cleanup'
+         END
+       WHERE message_id > ?1 AND message_id <= ?2 AND variant_group IS NULL AND source_info = 'SQLiteBootstrap';
+     )SQL",
+     false},
+    // External-content index over enabled rows (the text stays in messages only). A row is indexed iff it is
+    // enabled and the backfill has reached it, so the triggers only remove rows that really are in the index.
+    // The backfill INSERT is not idempotent by itself; it relies on committing together with its progress.
+    {4, "messages_fts full-text index for search_messages",
+     R"SQL(
+       CREATE VIRTUAL TABLE messages_fts USING fts5(static_intro, scrolling_message, content = 'messages',
+                                                    content_rowid = 'message_id', columnsize = 0,
+                                                    tokenize = 'unicode61 remove_diacritics 2');
+       CREATE TRIGGER messages_fts_insert AFTER INSERT ON messages BEGIN
+         INSERT INTO messages_fts (rowid, static_intro, scrolling_message)
+         SELECT new.message_id, new.static_intro, new.scrolling_message
+         WHERE new.is_enabled = 1 AND EXISTS (SELECT 1 FROM schema_migrations WHERE version = 4
+                                              AND (completed = 1 OR backfilled_up_to >= new.message_id));
+       END;
+       CREATE TRIGGER messages_fts_update AFTER UPDATE OF is_enabled, static_intro, scrolling_message ON messages
+       BEGIN
+         INSERT INTO messages_fts (messages_fts, rowid, static_intro, scrolling_message)
+         SELECT 'delete', old.message_id, old.static_intro, old.scrolling_message
+         WHERE old.is_enabled = 1 AND EXISTS (SELECT 1 FROM schema_migrations WHERE version = 4
+                                              AND (completed = 1 OR backfilled_up_to >= old.message_id));
+         INSERT INTO messages_fts (rowid, static_intro, scrolling_message)
+         SELECT new.message_id, new.static_intro, new.scrolling_message
+         WHERE new.is_enabled = 1 AND EXISTS (SELECT 1 FROM schema_migrations WHERE version = 4
+                                              AND (completed = 1 OR backfilled_up_to >= new.message_id));
+       END;
+       CREATE TRIGGER messages_fts_delete AFTER DELETE ON messages BEGIN
+         INSERT INTO messages_fts (messages_fts, rowid, static_intro, scrolling_message)
+         SELECT 'delete', old.message_id, old.static_intro, old.scrolling_message
+         WHERE old.is_enabled = 1 AND EXISTS (SELECT 1 FROM schema_migrations WHERE version = 4
+                                              AND (completed = 1 OR backfilled_up_to >= old.message_id));
+       END;
+     )SQL",
+     R"SQL(
+       INSERT INTO messages_fts (rowid, static_intro, scrolling_message)
+       SELECT message_id, static_intro, scrolling_message FROM messages
+       WHERE message_id > ?1 AND message_id <= ?2 AND is_enabled = 1;
+     )SQL",
+     true},
+    // Counts are flushed from RAM in batches, so display_count may trail the real number by one flush interval
+    {5, "max_displays and display_count for count-limited messages",
+     R"SQL(
+       ALTER TABLE messages ADD COLUMN max_displays INTEGER DEFAULT NULL;
+       ALTER TABLE messages ADD COLUMN display_count INTEGER NOT NULL DEFAULT 0;
+     )SQL",
+     nullptr, false},
+    // Add future migrations here, with strictly increasing versions
+};
+
+// Messages written into an empty database
+struct BootstrapMessage {
+  int priority;
+  int line_number;
+  int tarif_zone;
+  const char *static_intro;
+  const char *scrolling_message;
+  const char *next_message_hint;
+  int duration_seconds;
+  const char *source_info;
+  const char *variant_group;  // Translations of one message share a key
+};
+
+static const BootstrapMessage BOOTSTRAP_MESSAGES[] = {
+    // Priority, Line number, Tarif zone, Destination, Scroll message, Next message hint, Duration, Source info,
+    // Variant group
+    {40, 48, 101, "Base48", "Podporuj svuj mistni hackerspace! Podporuj Base48.", "Loading", 0, "SQLiteBootstrap",
+     "support"},
+    {40, 48, 101, "Base48", "Support your local hackerspace! Support Base48.", "Loading", 0, "SQLiteBootstrap",
+     "support"},
+    {36, 48, 101, "Grilovacka", "Grilovacka v Base48 kazdy patek. . . Hackeri a pratele vitani !", "Loading", 0,
+     "SQLiteBootstrap", "barbecue"},
+    {36, 48, 101, "Barbecue", "Barbecue at Base48 every Friday. Food, hackers, friends, music, chill.", "Loading", 0,
+     "SQLiteBootstrap", "barbecue"},
+    {38, 48, 101, "Uklid", "Udrzujte poradek a cistotu, uklizejte na stolech.", "Cleaning", 0, "SQLiteBootstrap",
+     "cleanup"},
+    {38, 48, 101, "Cleanup", "Maintain order and cleanliness, clean the tables.", "Cleaning", 0, "SQLiteBootstrap",
+     "cleanup"},
+    {34, 48, 101, "Tech Stack",
+     "Running ESPHome on o. g. ESP32. Messages saved in SQLite on LittleFS. Filesystem Partition 512 KB. Exposes "
+     "interface to Home Assistant. ASCII messages and DPMB 2005 Firmware.",
+     "UART2_TX_OVERF", 0, "SQLiteBootstrap", ""},
+    {34, 48, 101, "Credits",
+     "Panel and research - Filip. Serial IBIS protocol research by pavlik.space. Initial HW assistance by Vega "
+     "(vega76.cz). ESP - ESPHome - HA software is C++ vibecoded by Thebys. ",
+     "GOTO 0xBEEF", 0, "SQLiteBootstrap", ""},
+    // Additional messages can be added here in the future
+};
+
+static const int BOOTSTRAP_MESSAGE_COUNT = sizeof(BOOTSTRAP_MESSAGES) / sizeof(BOOTSTRAP_MESSAGES[0]);
+
+
+static const int SCHEMA_MIGRATION_COUNT = sizeof(SCHEMA_MIGRATIONS) / sizeof(SchemaMigration);
+
+// SQL wrapper around B48DatabaseManager::content_hash(), used by backfills
+static void sqlite_b48_hash(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+  if (argc != 1 || sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+    sqlite3_result_null(ctx);
+    return;
+  }
+  const char *text = reinterpret_cast<const char *>(sqlite3_value_text(argv[0]));
+  sqlite3_result_int64(ctx, B48DatabaseManager::content_hash(text ? text : ""));
+}
+
 B48DatabaseManager::B48DatabaseManager(const std::string &db_path) : database_path_(db_path) {}
 
 B48DatabaseManager::~B48DatabaseManager() {
@@ -41,6 +187,13 @@ bool B48DatabaseManager::initialize() {
   yield();
   esp_task_wdt_reset();
 
+  // Re-initialization (e.g. after wipe_database) must not leak the previous connection
+  if (this->db_) {
+    ESP_LOGD(TAG, "Closing existing database connection before reopening");
+    sqlite3_close(this->db_);
+    this->db_ = nullptr;
+  }
+
   ESP_LOGD(TAG, "Opening database connection");
   int rc = sqlite3_open(this->database_path_.c_str(), &this->db_);
   if (rc != SQLITE_OK) {
@@ -51,6 +204,16 @@ bool B48DatabaseManager::initialize() {
   }
   ESP_LOGI(TAG, "Successfully opened database connection at '%s'", this->database_path_.c_str());
 
+  rc = sqlite3_create_function(this->db_, "b48_hash", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr,
+                               sqlite_b48_hash, nullptr, nullptr);
+  if (rc != SQLITE_OK) {
+    // The v2 (content_hash) backfill calls it; without it every backfill step would fail the same way
+    ESP_LOGE(TAG, "Failed to register b48_hash() SQL function: %s", sqlite3_errmsg(this->db_));
+    sqlite3_close(this->db_);
+    this->db_ = nullptr;
+    return false;
+  }
+
   // Reset watchdog after opening database
   yield();
   esp_task_wdt_reset();
@@ -58,7 +221,7 @@ bool B48DatabaseManager::initialize() {
   // --- Set Page Size ---
   char *err_msg = nullptr;
   const char *pragma_page_size = "PRAGMA page_size=512;";
-  rc = sqlite3_exec(this->db_, pragma_page_size, nullptr, nullptr, &err_msg);
+  rc = this->exec_statement(pragma_page_size, nullptr, nullptr, &err_msg);
   if (rc != SQLITE_OK) {
     // This might fail harmlessly if the DB already exists with a different page size.
     ESP_LOGW(TAG, "Failed to set page_size=512: %s. This is expected if DB already exists.", err_msg);
@@ -68,6 +231,12 @@ bool B48DatabaseManager::initialize() {
   }
   // --- End Set Page Size ---
 
+  // Freed pages are reclaimed in small steps by vacuum_step(); only takes effect before the first table exists
+  if (this->exec_statement("PRAGMA auto_vacuum=INCREMENTAL;", nullptr, nullptr, &err_msg) != SQLITE_OK) {
+    ESP_LOGW(TAG, "Failed to set auto_vacuum=INCREMENTAL: %s", err_msg);
+    sqlite3_free(err_msg);
+  }
+
   // Reset watchdog after setting page size
   yield();
   esp_task_wdt_reset();
@@ -83,8 +252,14 @@ bool B48DatabaseManager::initialize() {
   yield();
   esp_task_wdt_reset();
 
-  // Bootstrap default messages if needed
-  if (!bootstrap_default_messages()) {
+  if (!ensure_incremental_vacuum()) {
+    ESP_LOGW(TAG, "Database stays without incremental vacuum; purges will not shrink the file");  // Not fatal
+  }
+
+  // Bootstrap default messages if needed, unless the caller runs it as a background job
+  if (this->defer_bootstrap_) {
+    ESP_LOGD(TAG, "Bootstrap deferred to the caller");
+  } else if (!bootstrap_default_messages()) {
     ESP_LOGW(TAG, "Failed to bootstrap default messages. Some functionality may be limited.");
     // We continue even if bootstrap fails - this is not a fatal error
   }
@@ -104,10 +279,15 @@ bool B48DatabaseManager::wipe_database() {
   yield();               // Yield to the OS before potentially long operation
   esp_task_wdt_reset();  // Reset watchdog timer
 
-  const char *drop_tables = "DROP TABLE IF EXISTS messages;";
+  const char *drop_tables = R"SQL(
+    DROP TABLE IF EXISTS messages_fts;
+    DROP TABLE IF EXISTS messages;
+    DROP TABLE IF EXISTS schema_migrations;
+    PRAGMA user_version = 0;
+  )SQL";
   char *err_msg = nullptr;
 
-  int rc = sqlite3_exec(this->db_, drop_tables, nullptr, nullptr, &err_msg);
+  int rc = this->exec_statement(drop_tables, nullptr, nullptr, &err_msg);
   if (rc != SQLITE_OK) {
     ESP_LOGE(TAG, "SQL error during wipe: %s", err_msg);
     sqlite3_free(err_msg);
@@ -117,6 +297,7 @@ bool B48DatabaseManager::wipe_database() {
   yield();               // Yield again after the operation
   esp_task_wdt_reset();  // Reset watchdog timer
 
+  this->pending_backfill_version_ = 0;
   ESP_LOGI(TAG, "Database tables successfully dropped");
   return true;
 }
@@ -140,7 +321,7 @@ bool B48DatabaseManager::check_and_create_schema() {
     return 0;
   };
 
-  int rc = sqlite3_exec(this->db_, query, callback, &user_version, &err_msg);
+  int rc = this->exec_statement(query, callback, &user_version, &err_msg);
   if (rc != SQLITE_OK) {
     ESP_LOGE(TAG, "SQL error: %s", err_msg);
     sqlite3_free(err_msg);
@@ -150,8 +331,9 @@ bool B48DatabaseManager::check_and_create_schema() {
   ESP_LOGI(TAG, "Database schema version: %d", user_version);
   esp_task_wdt_reset();  // Reset watchdog timer after version check
 
-  // Create tables if they don't exist or update schema
-  if (user_version < 2) {
+  // Create the base (version 1) tables if they don't exist yet
+  bool fresh_schema = false;
+  if (user_version < 1) {
     yield();               // Yield before potentially long operation
     esp_task_wdt_reset();  // Reset watchdog timer
 
@@ -188,7 +370,7 @@ bool B48DatabaseManager::check_and_create_schema() {
     yield();
     esp_task_wdt_reset();  // Reset watchdog timer before SQL exec
 
-    rc = sqlite3_exec(this->db_, create_tables, nullptr, nullptr, &err_msg);
+    rc = this->exec_statement(create_tables, nullptr, nullptr, &err_msg);
     yield();
     esp_task_wdt_reset();  // Reset watchdog timer after SQL exec
 
@@ -198,20 +380,298 @@ bool B48DatabaseManager::check_and_create_schema() {
       return false;
     }
 
+    user_version = 1;
+    fresh_schema = true;
     ESP_LOGI(TAG, "Database schema created successfully");
   }
 
-  // Implement schema upgrades as needed for future versions
+  // Progress of the chunked backfills lives next to the data so it survives reboots
+  const char *create_migrations_table = R"SQL(
+    CREATE TABLE IF NOT EXISTS schema_migrations (
+      version INTEGER PRIMARY KEY,
+      backfilled_up_to INTEGER NOT NULL DEFAULT 0,
+      completed INTEGER NOT NULL DEFAULT 0
+    );
+  )SQL";
+  if (!exec_simple(create_migrations_table, "create schema_migrations")) {
+    return false;
+  }
+
+  // Apply the DDL part of any newer migrations; backfills continue from loop()
+  if (!apply_pending_migrations(user_version, fresh_schema)) {
+    return false;
+  }
+
+  if (!load_migration_state()) {
+    return false;
+  }
+
+  int fts_tables = 0;
+  this->search_index_available_ =
+      this->query_int("SELECT COUNT(*) FROM sqlite_master WHERE name = 'messages_fts';", fts_tables) && fts_tables > 0;
+  ESP_LOGD(TAG, "Full-text search index: %s", this->search_index_available_ ? "available" : "not available");
+
   yield();               // Final yield
   esp_task_wdt_reset();  // Final watchdog reset
 
   return true;
 }
 
+int B48DatabaseManager::step_statement(sqlite3_stmt *stmt) {
+#ifdef B48_FAULT_INJECTION
+  if (global_fault_injector != nullptr) {
+    int fault = global_fault_injector->sqlite_step_fault(!sqlite3_stmt_readonly(stmt));
+    if (fault != SQLITE_OK) {
+      B48_RLOGV(TAG, "Injected SQLite fault %d", fault);
+      return fault;
+    }
+  }
+#endif
+  return sqlite3_step(stmt);
+}
+
+int B48DatabaseManager::exec_statement(const char *sql, int (*callback)(void *, int, char **, char **), void *arg,
+                                       char **err_msg) {
+#ifdef B48_FAULT_INJECTION
+  if (global_fault_injector != nullptr) {
+    int fault = global_fault_injector->sqlite_exec_fault(sql);
+    if (fault != SQLITE_OK) {
+      B48_RLOGV(TAG, "Injected SQLite fault %d", fault);
+      if (err_msg != nullptr) {
+        *err_msg = sqlite3_mprintf("injected fault: %s", sqlite3_errstr(fault));
+      }
+      return fault;
+    }
+  }
+#endif
+  return sqlite3_exec(this->db_, sql, callback, arg, err_msg);
+}
+
+bool B48DatabaseManager::exec_simple(const char *sql, const char *context) {
+  char *err_msg = nullptr;
+  int rc = this->exec_statement(sql, nullptr, nullptr, &err_msg);
+  if (rc != SQLITE_OK) {
+    ESP_LOGE(TAG, "SQL error during %s: %s", context, err_msg ? err_msg : sqlite3_errmsg(this->db_));
+    sqlite3_free(err_msg);
+    return false;
+  }
+  return true;
+}
+
+bool B48DatabaseManager::apply_pending_migrations(int user_version, bool fresh_schema) {
+  for (int i = 0; i < SCHEMA_MIGRATION_COUNT; i++) {
+    const SchemaMigration &migration = SCHEMA_MIGRATIONS[i];
+    if (migration.version <= user_version) {
+      continue;
+    }
+
+    ESP_LOGI(TAG, "Applying schema migration v%d: %s", migration.version, migration.description);
+    esp_task_wdt_reset();
+
+    if (!exec_simple("BEGIN;", "migration begin")) {
+      return false;
+    }
+
+    char bookkeeping[160];
+    snprintf(bookkeeping, sizeof(bookkeeping),
+             "INSERT OR REPLACE INTO schema_migrations (version, backfilled_up_to, completed) VALUES (%d, 0, %d);"
+             "PRAGMA user_version = %d;",
+             migration.version, (migration.backfill_sql && !fresh_schema) ? 0 : 1, migration.version);
+
+    bool ddl_ok = exec_simple(migration.ddl, "migration DDL");
+    bool skipped = false;
+    if (!ddl_ok && migration.optional) {
+      ESP_LOGW(TAG, "Optional schema migration v%d not supported by this SQLite build, skipping it",
+               migration.version);
+      exec_simple("ROLLBACK;", "migration rollback");
+      if (!exec_simple("BEGIN;", "migration begin")) {
+        return false;
+      }
+      snprintf(bookkeeping, sizeof(bookkeeping),
+               "INSERT OR REPLACE INTO schema_migrations (version, backfilled_up_to, completed) VALUES (%d, 0, 1);"
+               "PRAGMA user_version = %d;",
+               migration.version, migration.version);
+      ddl_ok = true;
+      skipped = true;
+    }
+    if (!ddl_ok || !exec_simple(bookkeeping, "migration bookkeeping")) {
+      exec_simple("ROLLBACK;", "migration rollback");
+      return false;
+    }
+
+    if (!exec_simple("COMMIT;", "migration commit")) {
+      exec_simple("ROLLBACK;", "migration rollback");
+      return false;
+    }
+
+    yield();
+    esp_task_wdt_reset();
+    ESP_LOGI(TAG, "Schema is now at version %d%s", migration.version,
+             skipped ? " (step skipped)" : (migration.backfill_sql && !fresh_schema) ? " (backfill pending)" : "");
+  }
+  return true;
+}
+
+bool B48DatabaseManager::load_migration_state() {
+  this->pending_backfill_version_ = 0;
+
+  sqlite3_stmt *stmt = nullptr;
+  const char *query = "SELECT MIN(version) FROM schema_migrations WHERE completed = 0;";
+  int rc = sqlite3_prepare_v2(this->db_, query, -1, &stmt, nullptr);
+  if (rc != SQLITE_OK) {
+    ESP_LOGE(TAG, "Failed to prepare migration state query: %s", sqlite3_errmsg(this->db_));
+    return false;
+  }
+
+  if (this->step_statement(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+    this->pending_backfill_version_ = sqlite3_column_int(stmt, 0);
+    ESP_LOGI(TAG, "Backfill for schema v%d is pending and will continue in the background",
+             this->pending_backfill_version_);
+  }
+  sqlite3_finalize(stmt);
+  return true;
+}
+
+bool B48DatabaseManager::is_migration_complete(int version) const {
+  // Migrations complete in order, so everything below the pending one is done
+  return this->pending_backfill_version_ == 0 || version < this->pending_backfill_version_;
+}
+
+int B48DatabaseManager::advance_migrations(int max_rows) {
+  if (!this->db_ || this->pending_backfill_version_ == 0) {
+    return 0;
+  }
+
+  const SchemaMigration *migration = nullptr;
+  for (int i = 0; i < SCHEMA_MIGRATION_COUNT; i++) {
+    if (SCHEMA_MIGRATIONS[i].version == this->pending_backfill_version_) {
+      migration = &SCHEMA_MIGRATIONS[i];
+      break;
+    }
+  }
+
+  if (!migration || !migration->backfill_sql) {
+    // Unknown to this firmware (downgrade) or nothing to backfill - just close it out
+    ESP_LOGW(TAG, "No backfill known for schema v%d, marking it complete", this->pending_backfill_version_);
+    char sql[96];
+    snprintf(sql, sizeof(sql), "UPDATE schema_migrations SET completed = 1 WHERE version = %d;",
+             this->pending_backfill_version_);
+    if (!exec_simple(sql, "migration completion")) {
+      return -1;
+    }
+    return load_migration_state() ? 0 : -1;
+  }
+
+  // Where did the previous chunk stop?
+  long long lower = 0;
+  sqlite3_stmt *stmt = nullptr;
+  int rc = sqlite3_prepare_v2(this->db_, "SELECT backfilled_up_to FROM schema_migrations WHERE version = ?;", -1,
+                              &stmt, nullptr);
+  if (rc != SQLITE_OK) {
+    ESP_LOGE(TAG, "Failed to prepare backfill progress query: %s", sqlite3_errmsg(this->db_));
+    return -1;
+  }
+  sqlite3_bind_int(stmt, 1, migration->version);
+  if (this->step_statement(stmt) == SQLITE_ROW) {
+    lower = sqlite3_column_int64(stmt, 0);
+  }
+  sqlite3_finalize(stmt);
+
+  // Find the upper bound of the next chunk
+  const char *bound_query = R"SQL(
+    SELECT MAX(message_id), COUNT(*) FROM (
+      SELECT message_id FROM messages WHERE message_id > ? ORDER BY message_id LIMIT ?
+    );
+  )SQL";
+  rc = sqlite3_prepare_v2(this->db_, bound_query, -1, &stmt, nullptr);
+  if (rc != SQLITE_OK) {
+    ESP_LOGE(TAG, "Failed to prepare backfill bound query: %s", sqlite3_errmsg(this->db_));
+    return -1;
+  }
+  sqlite3_bind_int64(stmt, 1, lower);
+  sqlite3_bind_int(stmt, 2, max_rows > 0 ? max_rows : 1);
+
+  long long upper = lower;
+  int rows = 0;
+  if (this->step_statement(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+    upper = sqlite3_column_int64(stmt, 0);
+    rows = sqlite3_column_int(stmt, 1);
+  }
+  sqlite3_finalize(stmt);
+
+  if (rows == 0) {
+    ESP_LOGI(TAG, "Backfill for schema v%d finished", migration->version);
+    char sql[96];
+    snprintf(sql, sizeof(sql), "UPDATE schema_migrations SET completed = 1 WHERE version = %d;", migration->version);
+    if (!exec_simple(sql, "migration completion")) {
+      return -1;
+    }
+    return load_migration_state() ? 0 : -1;
+  }
+
+  // Backfill the chunk and record progress in the same transaction
+  if (!exec_simple("BEGIN;", "backfill begin")) {
+    return -1;
+  }
+
+  bool ok = false;
+  rc = sqlite3_prepare_v2(this->db_, migration->backfill_sql, -1, &stmt, nullptr);
+  if (rc == SQLITE_OK) {
+    sqlite3_bind_int64(stmt, 1, lower);
+    sqlite3_bind_int64(stmt, 2, upper);
+    rc = this->step_statement(stmt);
+    ok = (rc == SQLITE_DONE);
+    if (!ok) {
+      ESP_LOGE(TAG, "Backfill chunk for schema v%d failed: %s", migration->version, sqlite3_errmsg(this->db_));
+    }
+    sqlite3_finalize(stmt);
+  } else {
+    ESP_LOGE(TAG, "Failed to prepare backfill for schema v%d: %s", migration->version, sqlite3_errmsg(this->db_));
+  }
+
+  if (ok) {
+    rc = sqlite3_prepare_v2(this->db_, "UPDATE schema_migrations SET backfilled_up_to = ? WHERE version = ?;", -1,
+                            &stmt, nullptr);
+    ok = (rc == SQLITE_OK);
+    if (ok) {
+      sqlite3_bind_int64(stmt, 1, upper);
+      sqlite3_bind_int(stmt, 2, migration->version);
+      ok = (this->step_statement(stmt) == SQLITE_DONE);
+      sqlite3_finalize(stmt);
+    }
+  }
+
+  if (!ok || !exec_simple("COMMIT;", "backfill commit")) {
+    exec_simple("ROLLBACK;", "backfill rollback");
+    return -1;
+  }
+
+  ESP_LOGD(TAG, "Backfilled schema v%d rows (%lld, %lld] (%d rows)", migration->version, lower, upper, rows);
+  return rows;
+}
+
+uint32_t B48DatabaseManager::content_hash(const std::string &text) {
+  uint32_t hash = 2166136261u;
+  for (unsigned char c : text) {
+    hash ^= c;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+uint32_t B48DatabaseManager::variant_group_id(const std::string &key) {
+  if (key.empty()) {
+    return 0;
+  }
+  uint32_t id = content_hash(key);
+  return id != 0 ? id : 1;  // 0 means "not grouped"
+}
+
 bool B48DatabaseManager::add_persistent_message(int priority, int line_number, int tarif_zone,
                                                 const std::string &static_intro, const std::string &scrolling_message,
                                                 const std::string &next_message_hint, int duration_seconds,
-                                                const std::string &source_info, bool check_duplicates) {
+                                                const std::string &source_info, bool check_duplicates,
+                                                const std::string &variant_group, int max_displays) {
   yield();               // Allow watchdog to reset before operation starts
   esp_task_wdt_reset();  // Reset watchdog timer
 
@@ -224,9 +684,8 @@ bool B48DatabaseManager::add_persistent_message(int priority, int line_number, i
 
   // Log original vs sanitized if there were changes
   if (safe_scrolling_message != scrolling_message) {
-    ESP_LOGW(TAG, "Original message contained non-Czech characters, sanitized: '%s%s' -> '%s%s'",
-             scrolling_message.substr(0, 30).c_str(), scrolling_message.length() > 30 ? "..." : "",
-             safe_scrolling_message.substr(0, 30).c_str(), safe_scrolling_message.length() > 30 ? "..." : "");
+    B48_RLOGW(TAG, "Original message contained non-Czech characters, sanitized: '%.30s' -> '%.30s'",
+              scrolling_message.c_str(), safe_scrolling_message.c_str());
     ESP_LOGW(TAG, "Message lengths: original=%zu, sanitized=%zu", scrolling_message.length(),
              safe_scrolling_message.length());
   }
@@ -237,27 +696,37 @@ bool B48DatabaseManager::add_persistent_message(int priority, int line_number, i
     return false;
   }
 
-  ESP_LOGI(TAG, "Adding message: Priority=%d, Line=%d, Zone=%d, Text='%s%s' (len=%zu), CheckDup=%s", priority,
-           line_number, tarif_zone, safe_scrolling_message.substr(0, 30).c_str(),
-           safe_scrolling_message.length() > 30 ? "..." : "", safe_scrolling_message.length(),
-           check_duplicates ? "true" : "false");
+  B48_RLOGI(TAG, "Adding message: Priority=%d, Line=%d, Zone=%d, Text='%.30s%s' (len=%zu), CheckDup=%s", priority,
+            line_number, tarif_zone, safe_scrolling_message.c_str(), safe_scrolling_message.length() > 30 ? "..." : "",
+            safe_scrolling_message.length(), check_duplicates ? "true" : "false");
 
   // Check for duplicates only if flag is set
   if (check_duplicates) {
-    // Check for exact scrolling message text match among ALL active messages
-    const char *check_query = R"SQL(
+    // Check for exact scrolling message text match among ALL active messages.
+    // The hash index narrows the search; rows not yet backfilled (content_hash IS NULL) are
+    // compared by text until the v2 migration completes.
+    const char *check_query = is_migration_complete(2) ? R"SQL(
       SELECT COUNT(*) FROM messages
       WHERE 
         is_enabled = 1 AND
-        scrolling_message = ?
+        content_hash = ?1 AND
+        scrolling_message = ?2
+    )SQL"
+                                                       : R"SQL(
+      SELECT COUNT(*) FROM messages
+      WHERE 
+        is_enabled = 1 AND
+        (content_hash = ?1 OR content_hash IS NULL) AND
+        scrolling_message = ?2
     )SQL";
 
     sqlite3_stmt *check_stmt;
     int rc = sqlite3_prepare_v2(this->db_, check_query, -1, &check_stmt, nullptr);
     if (rc == SQLITE_OK) {
-      sqlite3_bind_text(check_stmt, 1, safe_scrolling_message.c_str(), -1, SQLITE_STATIC);
+      sqlite3_bind_int64(check_stmt, 1, content_hash(safe_scrolling_message));
+      sqlite3_bind_text(check_stmt, 2, safe_scrolling_message.c_str(), -1, SQLITE_STATIC);
 
-      if (sqlite3_step(check_stmt) == SQLITE_ROW) {
+      if (this->step_statement(check_stmt) == SQLITE_ROW) {
         int count = sqlite3_column_int(check_stmt, 0);
         ESP_LOGD(TAG, "Duplicate check: found %d similar messages", count);
         if (count > 0) {
@@ -275,8 +744,8 @@ bool B48DatabaseManager::add_persistent_message(int priority, int line_number, i
   const char *query = R"SQL(
     INSERT INTO messages (
       is_enabled, priority, line_number, tarif_zone, static_intro, scrolling_message, 
-      next_message_hint, datetime_added, duration_seconds, source_info
-    ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?);
+      next_message_hint, datetime_added, duration_seconds, source_info, content_hash, variant_group, max_displays
+    ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);
   )SQL";
 
   sqlite3_stmt *stmt;
@@ -299,7 +768,7 @@ bool B48DatabaseManager::add_persistent_message(int priority, int line_number, i
   sqlite3_bind_text(stmt, 7, safe_next_message_hint.c_str(), -1, SQLITE_STATIC);
 
   // Get current time (timestamp) and log it for debugging
-  time_t now = time(nullptr);
+  time_t now = this->current_time();
   ESP_LOGI(TAG, "Current timestamp: %lld", (long long) now);
   sqlite3_bind_int64(stmt, 8, now);
 
@@ -316,10 +785,24 @@ bool B48DatabaseManager::add_persistent_message(int priority, int line_number, i
     sqlite3_bind_null(stmt, 10);
   }
 
+  sqlite3_bind_int64(stmt, 11, content_hash(safe_scrolling_message));
+
+  if (!variant_group.empty()) {
+    sqlite3_bind_text(stmt, 12, variant_group.c_str(), -1, SQLITE_STATIC);
+  } else {
+    sqlite3_bind_null(stmt, 12);
+  }
+
+  if (max_displays > 0) {
+    sqlite3_bind_int(stmt, 13, max_displays);
+  } else {
+    sqlite3_bind_null(stmt, 13);
+  }
+
   yield();               // Allow watchdog to reset after binding params
   esp_task_wdt_reset();  // Reset watchdog timer
 
-  rc = sqlite3_step(stmt);
+  rc = this->step_statement(stmt);
 
   yield();               // Allow watchdog to reset after step
   esp_task_wdt_reset();  // Reset watchdog timer
@@ -351,7 +834,8 @@ bool B48DatabaseManager::update_persistent_message(int message_id, int priority,
       scrolling_message = ?,
       next_message_hint = ?,
       duration_seconds = ?,
-      source_info = ?
+      source_info = ?,
+      content_hash = ?
     WHERE message_id = ?;
   )SQL";
 
@@ -383,9 +867,10 @@ bool B48DatabaseManager::update_persistent_message(int message_id, int priority,
     sqlite3_bind_null(stmt, 9);
   }
 
-  sqlite3_bind_int(stmt, 10, message_id);
+  sqlite3_bind_int64(stmt, 10, content_hash(scrolling_message));
+  sqlite3_bind_int(stmt, 11, message_id);
 
-  rc = sqlite3_step(stmt);
+  rc = this->step_statement(stmt);
   sqlite3_finalize(stmt);
 
   if (rc != SQLITE_DONE) {
@@ -410,7 +895,7 @@ bool B48DatabaseManager::delete_persistent_message(int message_id) {
 
   sqlite3_bind_int(stmt, 1, message_id);
 
-  rc = sqlite3_step(stmt);
+  rc = this->step_statement(stmt);
   sqlite3_finalize(stmt);
 
   if (rc != SQLITE_DONE) {
@@ -422,14 +907,45 @@ bool B48DatabaseManager::delete_persistent_message(int message_id) {
   return true;
 }
 
-std::vector<std::shared_ptr<MessageEntry>> B48DatabaseManager::get_active_persistent_messages() {
-  std::vector<std::shared_ptr<MessageEntry>> messages;
+MessageEntry B48DatabaseManager::read_message_row(sqlite3_stmt *stmt) {
+  MessageEntry entry;
+  entry.is_ephemeral = false;
+  entry.message_id = sqlite3_column_int(stmt, 0);
+  entry.priority = sqlite3_column_int(stmt, 1);
+  entry.line_number = sqlite3_column_int(stmt, 2);
+  entry.tarif_zone = sqlite3_column_int(stmt, 3);
+  const char *static_intro = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 4));
+  if (static_intro)
+    entry.static_intro = static_intro;
+  const char *scrolling_message = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 5));
+  if (scrolling_message)
+    entry.scrolling_message = scrolling_message;
+  const char *next_hint = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 6));
+  if (next_hint)
+    entry.next_message_hint = next_hint;
+  time_t added_time = static_cast<time_t>(sqlite3_column_int64(stmt, 7));
+  int duration_seconds = sqlite3_column_type(stmt, 8) == SQLITE_NULL ? 0 : sqlite3_column_int(stmt, 8);
+  if (duration_seconds > 0)
+    entry.expiry_time = added_time + duration_seconds;
+  const char *variant_group = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 9));
+  entry.variant_group = variant_group_id(variant_group ? variant_group : "");
+  entry.max_displays = sqlite3_column_type(stmt, 10) == SQLITE_NULL ? 0 : sqlite3_column_int(stmt, 10);
+  entry.display_count = sqlite3_column_int(stmt, 11);
+  return entry;
+}
+
+std::vector<MessageEntry> B48DatabaseManager::get_active_persistent_messages(bool *ok) {
+  std::vector<MessageEntry> messages;
+  if (ok != nullptr) {
+    *ok = false;
+  }
   // Filter active (enabled and not expired) messages using SQL
-  time_t now_ts = time(nullptr);
+  time_t now_ts = this->current_time();
   ESP_LOGD(TAG, "Filtering active messages with timestamp: %lld", (long long) now_ts);
   const char *query = R"SQL(
     SELECT message_id, priority, line_number, tarif_zone, static_intro,
-           scrolling_message, next_message_hint, datetime_added, duration_seconds
+           scrolling_message, next_message_hint, datetime_added, duration_seconds, variant_group,
+           max_displays, display_count
     FROM messages
     WHERE is_enabled = 1
       AND (
@@ -437,6 +953,7 @@ std::vector<std::shared_ptr<MessageEntry>> B48DatabaseManager::get_active_persis
         OR duration_seconds = 0
         OR (datetime_added + duration_seconds) > ?
       )
+      AND (max_displays IS NULL OR display_count < max_displays)
     ORDER BY priority DESC, message_id ASC
   )SQL";
 
@@ -449,41 +966,27 @@ std::vector<std::shared_ptr<MessageEntry>> B48DatabaseManager::get_active_persis
   }
   ESP_LOGI(TAG, "Now_ts (epoch): %lld", (long long) now_ts);
   sqlite3_bind_int64(stmt, 1, now_ts);
-  ESP_LOGI(TAG, "Expanded SQL: %s", sqlite3_expanded_sql(stmt));
+  char *expanded_sql = sqlite3_expanded_sql(stmt);  // Heap string owned by the caller
+  ESP_LOGD(TAG, "Expanded SQL: %s", expanded_sql ? expanded_sql : "(unavailable)");
+  sqlite3_free(expanded_sql);
 
   int count = 0;
   ESP_LOGD(TAG, "Starting to fetch messages from database");
 
   int step_result;
-  while ((step_result = sqlite3_step(stmt)) == SQLITE_ROW) {
+  while ((step_result = this->step_statement(stmt)) == SQLITE_ROW) {
     esp_task_wdt_reset();
     yield();
-    auto entry = std::make_shared<MessageEntry>();
-    entry->is_ephemeral = false;
-    entry->message_id = sqlite3_column_int(stmt, 0);
-    entry->priority = sqlite3_column_int(stmt, 1);
-    entry->line_number = sqlite3_column_int(stmt, 2);
-    entry->tarif_zone = sqlite3_column_int(stmt, 3);
-    const char *static_intro = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 4));
-    if (static_intro)
-      entry->static_intro = static_intro;
-    const char *scrolling_message = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 5));
-    if (scrolling_message)
-      entry->scrolling_message = scrolling_message;
-    const char *next_hint = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 6));
-    if (next_hint)
-      entry->next_message_hint = next_hint;
-    time_t added_time = static_cast<time_t>(sqlite3_column_int64(stmt, 7));
-    int duration_seconds = sqlite3_column_type(stmt, 8) == SQLITE_NULL ? 0 : sqlite3_column_int(stmt, 8);
-    if (duration_seconds > 0)
-      entry->expiry_time = added_time + duration_seconds;
-    ESP_LOGD(TAG, "Loaded message ID=%d, Priority=%d, Duration=%d", entry->message_id, entry->priority,
-             duration_seconds);
-    messages.push_back(entry);
+    MessageEntry entry = read_message_row(stmt);
+    B48_RLOGD(TAG, "Loaded message ID=%d, Priority=%d, Expiry=%ld", entry.message_id, entry.priority,
+              (long) entry.expiry_time);
+    messages.push_back(std::move(entry));
     count++;
   }
   if (step_result != SQLITE_DONE) {
-    ESP_LOGE(TAG, "SQLite error in get_active_persistent_messages: %s", sqlite3_errmsg(this->db_));
+    ESP_LOGE(TAG, "SQLite error %d in get_active_persistent_messages: %s", step_result, sqlite3_errmsg(this->db_));
+  } else if (ok != nullptr) {
+    *ok = true;
   }
   sqlite3_finalize(stmt);
   esp_task_wdt_reset();
@@ -492,6 +995,206 @@ std::vector<std::shared_ptr<MessageEntry>> B48DatabaseManager::get_active_persis
 }
 
 // Expire messages whose duration has elapsed and log detailed info
+bool B48DatabaseManager::get_active_persistent_messages_page(int after_id, int limit,
+                                                             std::vector<MessageEntry> &out) {
+  // Same filter as get_active_persistent_messages, walked by message_id so a load can stop between pages
+  const char *query = R"SQL(
+    SELECT message_id, priority, line_number, tarif_zone, static_intro,
+           scrolling_message, next_message_hint, datetime_added, duration_seconds, variant_group,
+           max_displays, display_count
+    FROM messages
+    WHERE is_enabled = 1
+      AND message_id > ?2
+      AND (
+        duration_seconds IS NULL
+        OR duration_seconds = 0
+        OR (datetime_added + duration_seconds) > ?1
+      )
+      AND (max_displays IS NULL OR display_count < max_displays)
+    ORDER BY message_id ASC
+    LIMIT ?3
+  )SQL";
+
+  sqlite3_stmt *stmt = nullptr;
+  if (sqlite3_prepare_v2(this->db_, query, -1, &stmt, nullptr) != SQLITE_OK) {
+    ESP_LOGE(TAG, "Failed to prepare message page statement: %s", sqlite3_errmsg(this->db_));
+    return false;
+  }
+  sqlite3_bind_int64(stmt, 1, this->current_time());
+  sqlite3_bind_int(stmt, 2, after_id);
+  sqlite3_bind_int(stmt, 3, limit);
+
+  int step_result;
+  while ((step_result = this->step_statement(stmt)) == SQLITE_ROW) {
+    out.push_back(read_message_row(stmt));
+  }
+  sqlite3_finalize(stmt);
+  if (step_result != SQLITE_DONE) {
+    ESP_LOGE(TAG, "SQLite error %d loading messages after ID %d: %s", step_result, after_id,
+             sqlite3_errmsg(this->db_));
+    return false;
+  }
+  return true;
+}
+
+bool B48DatabaseManager::search_index_ready() const {
+  return this->search_index_available_ && this->is_migration_complete(SEARCH_INDEX_SCHEMA_VERSION);
+}
+
+std::string B48DatabaseManager::build_match_query(const std::string &query) {
+  // Every word as a quoted prefix term, so user input can never be FTS5 syntax: bbq pat -> "bbq"* "pat"*
+  std::string match;
+  size_t pos = 0;
+  while (pos < query.size()) {
+    size_t start = query.find_first_not_of(" \t\r\n", pos);
+    if (start == std::string::npos) {
+      break;
+    }
+    size_t end = query.find_first_of(" \t\r\n", start);
+    if (end == std::string::npos) {
+      end = query.size();
+    }
+    if (!match.empty()) {
+      match += ' ';
+    }
+    match += '"';
+    for (size_t i = start; i < end; i++) {
+      if (query[i] == '"') {
+        match += '"';  // Doubled quote is a literal quote inside a string
+      }
+      match += query[i];
+    }
+    match += "\"*";
+    pos = end;
+  }
+  return match;
+}
+
+std::string B48DatabaseManager::make_snippet(const std::string &text, size_t match_pos, size_t match_len) {
+  // Same shape as FTS5 snippet(): a few words of context and the hit in [brackets]
+  const size_t context = 24;
+  size_t start = match_pos > context ? match_pos - context : 0;
+  size_t end = std::min(text.size(), match_pos + match_len + context);
+  while (start > 0 && (static_cast<uint8_t>(text[start]) & 0xC0) == 0x80) {
+    start--;  // Do not cut a UTF-8 sequence
+  }
+  while (end < text.size() && (static_cast<uint8_t>(text[end]) & 0xC0) == 0x80) {
+    end++;
+  }
+  return (start > 0 ? "..." : "") + text.substr(start, match_pos - start) + "[" +
+         text.substr(match_pos, match_len) + "]" + text.substr(match_pos + match_len, end - match_pos - match_len) +
+         (end < text.size() ? "..." : "");
+}
+
+bool B48DatabaseManager::search_messages(const std::string &query, int limit, std::vector<SearchHit> &hits,
+                                         bool *used_index) {
+  hits.clear();
+  bool use_index = this->search_index_ready();
+  if (used_index) {
+    *used_index = use_index;
+  }
+  if (!this->db_) {
+    ESP_LOGE(TAG, "Database connection is not open. Cannot search.");
+    return false;
+  }
+
+  std::string match = build_match_query(query);
+  if (match.empty()) {
+    return true;  // Nothing to look for
+  }
+
+  const char *index_query = R"SQL(
+    SELECT rowid, snippet(messages_fts, -1, '[', ']', '...', 10)
+    FROM messages_fts WHERE messages_fts MATCH ?1 ORDER BY rowid DESC LIMIT ?2
+  )SQL";
+  // Without the index (SQLite lacks FTS5, or the backfill is still running): enabled rows, ASCII case-folding only
+  const char *scan_query = R"SQL(
+    SELECT message_id, static_intro, scrolling_message FROM messages
+    WHERE is_enabled = 1 AND (static_intro LIKE ?1 ESCAPE '\' OR scrolling_message LIKE ?1 ESCAPE '\')
+    ORDER BY message_id DESC LIMIT ?2
+  )SQL";
+
+  sqlite3_stmt *stmt = nullptr;
+  if (sqlite3_prepare_v2(this->db_, use_index ? index_query : scan_query, -1, &stmt, nullptr) != SQLITE_OK) {
+    ESP_LOGE(TAG, "Failed to prepare search statement: %s", sqlite3_errmsg(this->db_));
+    return false;
+  }
+
+  std::string needle;  // Lower-case query for locating the hit in scan results
+  if (use_index) {
+    sqlite3_bind_text(stmt, 1, match.c_str(), -1, SQLITE_TRANSIENT);
+  } else {
+    size_t first = query.find_first_not_of(" \t\r\n");
+    size_t last = query.find_last_not_of(" \t\r\n");
+    needle = query.substr(first, last - first + 1);
+    std::string pattern = "%";
+    for (char c : needle) {
+      if (c == '%' || c == '_' || c == '\\') {
+        pattern += '\\';
+      }
+      pattern += c;
+    }
+    pattern += '%';
+    sqlite3_bind_text(stmt, 1, pattern.c_str(), -1, SQLITE_TRANSIENT);
+    std::transform(needle.begin(), needle.end(), needle.begin(), ::tolower);
+  }
+  sqlite3_bind_int(stmt, 2, limit);
+
+  int step_result;
+  while ((step_result = this->step_statement(stmt)) == SQLITE_ROW) {
+    SearchHit hit;
+    hit.message_id = sqlite3_column_int(stmt, 0);
+    if (use_index) {
+      const char *snippet = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+      hit.snippet = snippet ? snippet : "";
+    } else {
+      for (int column = 2; column >= 1 && hit.snippet.empty(); column--) {
+        const char *text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, column));
+        std::string value = text ? text : "";
+        std::string lower = value;
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        size_t pos = lower.find(needle);
+        if (pos != std::string::npos) {
+          hit.snippet = make_snippet(value, pos, needle.size());
+        }
+      }
+    }
+    hits.push_back(std::move(hit));
+  }
+  sqlite3_finalize(stmt);
+  if (step_result != SQLITE_DONE) {
+    ESP_LOGE(TAG, "SQLite error %d during search: %s", step_result, sqlite3_errmsg(this->db_));
+    return false;
+  }
+  return true;
+}
+
+int B48DatabaseManager::search_index_bytes() {
+  if (!this->search_index_available_) {
+    return -1;
+  }
+  // Payload of the FTS5 shadow tables (segments and their term index); page slack is not counted. The text
+  // itself is not copied (external content) and columnsize=0 drops the per-row size table.
+  const char *size_query = R"SQL(
+    SELECT (SELECT COALESCE(SUM(length(block)), 0) FROM messages_fts_data)
+         + (SELECT COALESCE(SUM(length(term)) + 16 * COUNT(*), 0) FROM messages_fts_idx);
+  )SQL";
+  int bytes = -1;
+  if (!this->query_int(size_query, bytes)) {
+    return -1;
+  }
+  return bytes;
+}
+
+int B48DatabaseManager::database_bytes() {
+  int pages = 0;
+  int page_size = 0;
+  if (!this->db_ || !this->query_int("PRAGMA page_count;", pages) || !this->query_int("PRAGMA page_size;", page_size)) {
+    return -1;
+  }
+  return pages * page_size;
+}
+
 int B48DatabaseManager::expire_old_messages() {
   ESP_LOGI(TAG, "Expiring old messages");
 
@@ -502,7 +1205,7 @@ int B48DatabaseManager::expire_old_messages() {
   }
 
   // Get current time for expiry check
-  time_t now_ts = time(nullptr);
+  time_t now_ts = this->current_time();
   ESP_LOGD(TAG, "Current timestamp for expiry check: %lld", (long long) now_ts);
 
   // --- PART 1: Find messages that will expire and update them one by one ---
@@ -510,13 +1213,17 @@ int B48DatabaseManager::expire_old_messages() {
   std::vector<int> message_ids_to_expire;
 
   {
+    // Time-limited messages past their duration, and count-limited ones that reached max_displays
     const char *select_sql = R"SQL(
-      SELECT message_id, datetime_added, duration_seconds
+      SELECT message_id, datetime_added, duration_seconds, display_count, max_displays
       FROM messages
       WHERE is_enabled = 1
-        AND duration_seconds IS NOT NULL
-        AND duration_seconds > 0
-        AND (datetime_added + duration_seconds) <= ?
+        AND (
+          (duration_seconds IS NOT NULL
+           AND duration_seconds > 0
+           AND (datetime_added + duration_seconds) <= ?)
+          OR (max_displays IS NOT NULL AND display_count >= max_displays)
+        )
     )SQL";
 
     sqlite3_stmt *sel_stmt = nullptr;
@@ -536,14 +1243,20 @@ int B48DatabaseManager::expire_old_messages() {
     }
 
     // Loop through results and collect message IDs
-    while ((rc = sqlite3_step(sel_stmt)) == SQLITE_ROW) {
+    while ((rc = this->step_statement(sel_stmt)) == SQLITE_ROW) {
       int msg_id = sqlite3_column_int(sel_stmt, 0);
       long long added = sqlite3_column_int64(sel_stmt, 1);
       int dur = sqlite3_column_int(sel_stmt, 2);
       long long expiry_ts = added + dur;
+      int shown = sqlite3_column_int(sel_stmt, 3);
+      int max_shown = sqlite3_column_int(sel_stmt, 4);
 
-      ESP_LOGW(TAG, "Message ID %d will expire: added_ts=%lld, duration=%d, expiry_ts=%lld", msg_id, added, dur,
-               expiry_ts);
+      if (max_shown > 0 && shown >= max_shown) {
+        ESP_LOGW(TAG, "Message ID %d will expire: shown %d of %d times", msg_id, shown, max_shown);
+      } else {
+        ESP_LOGW(TAG, "Message ID %d will expire: added_ts=%lld, duration=%d, expiry_ts=%lld", msg_id, added, dur,
+                 expiry_ts);
+      }
 
       message_ids_to_expire.push_back(msg_id);
     }
@@ -592,7 +1305,7 @@ int B48DatabaseManager::expire_old_messages() {
     }
 
     // Execute the update
-    rc = sqlite3_step(update_stmt);
+    rc = this->step_statement(update_stmt);
     if (rc != SQLITE_DONE) {
       ESP_LOGE(TAG, "Failed to expire message ID %d: %s", msg_id, sqlite3_errmsg(this->db_));
     } else {
@@ -624,174 +1337,267 @@ int B48DatabaseManager::expire_old_messages() {
   return changes;
 }
 
-int B48DatabaseManager::purge_disabled_messages() {
-  ESP_LOGW(TAG, "Physically purging disabled messages from database...");
-
-  // Ensure database connection is valid
+bool B48DatabaseManager::add_display_counts(const std::map<int, uint32_t> &counts, int &retired) {
+  retired = 0;
   if (!this->db_) {
-    ESP_LOGE(TAG, "Database connection is not open. Cannot purge disabled messages.");
-    return -1;
+    ESP_LOGE(TAG, "Database connection is not open. Cannot store display counts.");
+    return false;
+  }
+  if (counts.empty()) {
+    return true;
   }
 
-  yield();               // Yield to the OS before potentially long operation
-  esp_task_wdt_reset();  // Reset watchdog timer
+  // One transaction for the whole batch: a single journal write instead of one per message
+  if (!exec_simple("BEGIN;", "display count begin")) {
+    return false;
+  }
+  const char *update_sql = "UPDATE messages SET display_count = display_count + ? WHERE message_id = ?;";
+  // Same rule as expire_old_messages(), limited to the batch so the flush never scans the table
+  const char *retire_sql = "UPDATE messages SET is_enabled = 0 WHERE message_id = ? AND is_enabled = 1 "
+                           "AND max_displays > 0 AND display_count >= max_displays;";
+  sqlite3_stmt *stmt = nullptr;
+  sqlite3_stmt *retire_stmt = nullptr;
+  bool ok = sqlite3_prepare_v2(this->db_, update_sql, -1, &stmt, nullptr) == SQLITE_OK &&
+            sqlite3_prepare_v2(this->db_, retire_sql, -1, &retire_stmt, nullptr) == SQLITE_OK;
+  if (!ok) {
+    ESP_LOGE(TAG, "Failed to prepare display count update: %s", sqlite3_errmsg(this->db_));
+  }
+  int disabled = 0;
+  for (auto it = counts.begin(); ok && it != counts.end(); ++it) {
+    sqlite3_reset(stmt);
+    sqlite3_bind_int64(stmt, 1, it->second);
+    sqlite3_bind_int(stmt, 2, it->first);
+    sqlite3_reset(retire_stmt);
+    sqlite3_bind_int(retire_stmt, 1, it->first);
+    ok = this->step_statement(stmt) == SQLITE_DONE && this->step_statement(retire_stmt) == SQLITE_DONE;
+    if (!ok) {
+      ESP_LOGE(TAG, "Failed to store display count of message ID %d: %s", it->first, sqlite3_errmsg(this->db_));
+    } else if (sqlite3_changes(this->db_) > 0) {
+      ESP_LOGI(TAG, "Message ID %d reached max_displays, disabled", it->first);
+      disabled++;
+    }
+  }
+  sqlite3_finalize(stmt);
+  sqlite3_finalize(retire_stmt);
 
-  // First count how many messages will be purged
-  const char *count_sql = "SELECT COUNT(*) FROM messages WHERE is_enabled = 0;";
-  sqlite3_stmt *count_stmt = nullptr;
-  int rc = sqlite3_prepare_v2(this->db_, count_sql, -1, &count_stmt, nullptr);
+  if (!ok || !exec_simple("COMMIT;", "display count commit")) {
+    exec_simple("ROLLBACK;", "display count rollback");
+    return false;
+  }
+  retired = disabled;
+  ESP_LOGD(TAG, "Stored display counts of %zu messages, %d retired", counts.size(), disabled);
+  return true;
+}
 
-  if (rc != SQLITE_OK) {
-    ESP_LOGE(TAG, "Failed to prepare count statement: %s", sqlite3_errmsg(this->db_));
-    return -1;
+bool B48DatabaseManager::query_int(const char *sql, int &value) {
+  sqlite3_stmt *stmt = nullptr;
+  if (sqlite3_prepare_v2(this->db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+    ESP_LOGE(TAG, "Failed to prepare '%s': %s", sql, sqlite3_errmsg(this->db_));
+    return false;
   }
+  bool ok = this->step_statement(stmt) == SQLITE_ROW;
+  if (ok) {
+    value = sqlite3_column_int(stmt, 0);
+  } else {
+    ESP_LOGE(TAG, "Failed to run '%s': %s", sql, sqlite3_errmsg(this->db_));
+  }
+  sqlite3_finalize(stmt);
+  return ok;
+}
 
+int B48DatabaseManager::count_disabled_messages() {
+  if (!this->db_) {
+    ESP_LOGE(TAG, "Database connection is not open. Cannot purge disabled messages.");
+    return -1;
+  }
   int disabled_count = 0;
-  if (sqlite3_step(count_stmt) == SQLITE_ROW) {
-    disabled_count = sqlite3_column_int(count_stmt, 0);
-    ESP_LOGI(TAG, "Found %d disabled messages to purge", disabled_count);
-  } else {
-    ESP_LOGE(TAG, "Failed to count disabled messages: %s", sqlite3_errmsg(this->db_));
-    sqlite3_finalize(count_stmt);
+  if (!this->query_int("SELECT COUNT(*) FROM messages WHERE is_enabled = 0;", disabled_count)) {
     return -1;
   }
-  sqlite3_finalize(count_stmt);
+  return disabled_count;
+}
 
-  if (disabled_count == 0) {
-    ESP_LOGI(TAG, "No disabled messages to purge");
-    return 0;  // Nothing to do
+int B48DatabaseManager::purge_disabled_messages_step(int max_rows) {
+  if (!this->db_) {
+    return -1;
   }
+  // Bounded DELETE so one step stays short even with thousands of disabled rows
+  const char *delete_sql = R"SQL(
+    DELETE FROM messages WHERE message_id IN (
+      SELECT message_id FROM messages WHERE is_enabled = 0 LIMIT ?1
+    )
+  )SQL";
+  sqlite3_stmt *stmt = nullptr;
+  if (sqlite3_prepare_v2(this->db_, delete_sql, -1, &stmt, nullptr) != SQLITE_OK) {
+    ESP_LOGE(TAG, "Failed to prepare purge statement: %s", sqlite3_errmsg(this->db_));
+    return -1;
+  }
+  sqlite3_bind_int(stmt, 1, max_rows);
+  int rc = this->step_statement(stmt);
+  sqlite3_finalize(stmt);
+  esp_task_wdt_reset();
+  if (rc != SQLITE_DONE) {
+    ESP_LOGE(TAG, "SQL error during purge of disabled messages: %s", sqlite3_errmsg(this->db_));
+    return -1;
+  }
+  return sqlite3_changes(this->db_);
+}
 
-  // Execute the deletion operation
-  yield();               // Yield again before deletion
-  esp_task_wdt_reset();  // Reset watchdog timer
-
-  const char *delete_sql = "DELETE FROM messages WHERE is_enabled = 0;";
-  char *err_msg = nullptr;
-
-  rc = sqlite3_exec(this->db_, delete_sql, nullptr, nullptr, &err_msg);
-
-  yield();               // Yield again after operation
-  esp_task_wdt_reset();  // Reset watchdog timer
+bool B48DatabaseManager::ensure_incremental_vacuum() {
+  int auto_vacuum = 0;
+  if (!this->query_int("PRAGMA auto_vacuum;", auto_vacuum)) {
+    return false;
+  }
+  if (auto_vacuum == 2) {
+    return true;
+  }
+  // Databases created before incremental vacuum: one full VACUUM switches them over for good. Done here,
+  // before the background jobs start, because it rewrites the whole file in one statement.
+  ESP_LOGI(TAG, "Converting database to incremental vacuum (one-time full VACUUM)...");
+  uint32_t start_ms = millis();
+  yield();
+  esp_task_wdt_reset();
+  bool ok = this->exec_simple("PRAGMA auto_vacuum=INCREMENTAL;", "auto_vacuum switch") &&
+            this->exec_simple("VACUUM;", "VACUUM");
+  esp_task_wdt_reset();
+  if (ok) {
+    ESP_LOGI(TAG, "Converted to incremental vacuum in %u ms", (unsigned) (millis() - start_ms));
+  }
+  return ok;
+}
 
-  if (rc != SQLITE_OK) {
-    ESP_LOGE(TAG, "SQL error during purge of disabled messages: %s", err_msg);
-    sqlite3_free(err_msg);
+int B48DatabaseManager::vacuum_step(int max_pages) {
+  if (!this->db_) {
     return -1;
   }
+  int auto_vacuum = 0;
+  if (!this->query_int("PRAGMA auto_vacuum;", auto_vacuum)) {
+    return -1;
+  }
+  if (auto_vacuum != 2) {
+    // Conversion failed at boot; a full VACUUM is too long for a job step, so freed pages wait for the next boot
+    ESP_LOGD(TAG, "Database not in incremental vacuum mode, skipping vacuum");
+    return 0;
+  }
 
-  int actually_deleted = sqlite3_changes(this->db_);
-  ESP_LOGI(TAG, "Successfully purged %d disabled messages from database", actually_deleted);
+  char sql[48];
+  snprintf(sql, sizeof(sql), "PRAGMA incremental_vacuum(%d);", max_pages);
+  if (!this->exec_simple(sql, "incremental vacuum")) {
+    return -1;
+  }
+  esp_task_wdt_reset();
+  int free_pages = 0;
+  if (!this->query_int("PRAGMA freelist_count;", free_pages)) {
+    return -1;
+  }
+  return free_pages;
+}
 
-  // Vacuum the database to reclaim space (optional but recommended for infrequent cleanup)
-  ESP_LOGI(TAG, "Performing VACUUM operation to reclaim space...");
+int B48DatabaseManager::purge_disabled_messages() {
+  ESP_LOGW(TAG, "Physically purging disabled messages from database...");
 
-  yield();               // Yield before vacuum
+  yield();               // Yield to the OS before potentially long operation
   esp_task_wdt_reset();  // Reset watchdog timer
 
-  rc = sqlite3_exec(this->db_, "VACUUM;", nullptr, nullptr, &err_msg);
-
-  yield();               // Yield after vacuum
-  esp_task_wdt_reset();  // Reset watchdog timer
+  int disabled_count = this->count_disabled_messages();
+  if (disabled_count < 0) {
+    return -1;
+  }
+  ESP_LOGI(TAG, "Found %d disabled messages to purge", disabled_count);
+  if (disabled_count == 0) {
+    return 0;  // Nothing to do
+  }
 
-  if (rc != SQLITE_OK) {
-    ESP_LOGW(TAG, "VACUUM operation failed: %s", err_msg);
-    sqlite3_free(err_msg);
-    // Continue anyway, this is not critical
-  } else {
-    ESP_LOGI(TAG, "VACUUM operation completed successfully");
+  int actually_deleted = 0;
+  int rows;
+  while ((rows = this->purge_disabled_messages_step(PURGE_CHUNK_ROWS)) > 0) {
+    actually_deleted += rows;
+    yield();
+  }
+  if (rows < 0) {
+    return -1;
   }
+  ESP_LOGI(TAG, "Successfully purged %d disabled messages from database", actually_deleted);
 
+  // Reclaim the freed pages (not critical if it fails)
+  int free_pages;
+  while ((free_pages = this->vacuum_step(VACUUM_CHUNK_PAGES)) > 0) {
+    yield();
+  }
+  if (free_pages < 0) {
+    ESP_LOGW(TAG, "Vacuum failed, freed pages stay in the database file");
+  }
   return actually_deleted;
 }
 
 // --- Bootstrapping ---
 
-bool B48DatabaseManager::bootstrap_default_messages() {
-  ESP_LOGI(TAG, "Checking if default messages need bootstrapping...");
-
+bool B48DatabaseManager::needs_bootstrap(bool *ok) {
+  if (ok) {
+    *ok = false;
+  }
   if (!this->db_) {
     ESP_LOGE(TAG, "Database connection is not open. Cannot bootstrap.");
     return false;
   }
 
-  esp_task_wdt_reset();  // Reset watchdog timer
-
   sqlite3_stmt *stmt;
   const char *count_query = "SELECT COUNT(*) FROM messages WHERE is_enabled = 1;";  // Only count active messages
   int rc = sqlite3_prepare_v2(this->db_, count_query, -1, &stmt, nullptr);
-
   if (rc != SQLITE_OK) {
     ESP_LOGE(TAG, "Failed to prepare count statement: %s", sqlite3_errmsg(this->db_));
     return false;
   }
 
-  esp_task_wdt_reset();  // Reset watchdog timer
-
   int count = 0;
-  if (sqlite3_step(stmt) == SQLITE_ROW) {
+  if (this->step_statement(stmt) == SQLITE_ROW) {
     count = sqlite3_column_int(stmt, 0);
   } else {
     ESP_LOGE(TAG, "Failed to execute count statement: %s", sqlite3_errmsg(this->db_));
     sqlite3_finalize(stmt);
     return false;
   }
-  sqlite3_finalize(stmt);  // Finalize the statement
+  sqlite3_finalize(stmt);
 
+  if (ok) {
+    *ok = true;
+  }
   if (count > 0) {
     ESP_LOGD(TAG, "Database already contains %d active messages, skipping bootstrap.", count);
-    return true;  // Not an error, just no need to bootstrap
+    return false;
   }
+  return true;
+}
 
-  ESP_LOGI(TAG, "Bootstrapping default persistent messages as the table is empty.");
-  esp_task_wdt_reset();  // Reset watchdog timer before inserting messages
-
-  // Define bootstrap messages in a data structure
-  struct BootstrapMessage {
-    int priority;
-    int line_number;
-    int tarif_zone;
-    const char *static_intro;
-    const char *scrolling_message;
-    const char *next_message_hint;
-    int duration_seconds;
-    const char *source_info;
-  };
+int B48DatabaseManager::bootstrap_message_count() { return BOOTSTRAP_MESSAGE_COUNT; }
 
-  // Array of bootstrap messages
-  const BootstrapMessage bootstrap_messages[] = {
-      // Priority, Line number, Tarif zone, Destination, Scroll message, Next message hint, Duration, Source info
-      {40, 48, 101, "Base48", "Podporuj svuj mistni hackerspace! Podporuj Base48.", "Loading", 0, "SQLiteBootstrap"},
-      {40, 48, 101, "Base48", "Support your local hackerspace! Support Base48.", "Loading", 0, "SQLiteBootstrap"},
-      {36, 48, 101, "Grilovacka", "Grilovacka v Base48 kazdy patek. . . Hackeri a pratele vitani !", "Loading", 0,
-       "SQLiteBootstrap"},
-      {36, 48, 101, "Barbecue", "Barbecue at Base48 every Friday. Food, hackers, friends, music, chill.", "Loading", 0,
-       "SQLiteBootstrap"},
-      {38, 48, 101, "Uklid", "Udrzujte poradek a cistotu, uklizejte na stolech.", "Cleaning", 0, "SQLiteBootstrap"},
-      {38, 48, 101, "Cleanup", "Maintain order and cleanliness, clean the tables.", "Cleaning", 0, "SQLiteBootstrap"},
-      {34, 48, 101, "Tech Stack",
-       "Running ESPHome on o. g. ESP32. Messages saved in SQLite on LittleFS. Filesystem Partition 512 KB. Exposes "
-       "interface to Home Assistant. ASCII messages and DPMB 2005 Firmware.",
-       "UART2_TX_OVERF", 0, "SQLiteBootstrap"},
-      {34, 48, 101, "Credits",
-       "Panel and research - Filip. Serial IBIS protocol research by pavlik.space. Initial HW assistance by Vega "
-       "(vega76.cz). ESP - ESPHome - HA software is C++ vibecoded by Thebys. ",
-       "GOTO 0xBEEF", 0, "SQLiteBootstrap"},
-      // Additional messages can be added here in the future
-  };
+bool B48DatabaseManager::add_bootstrap_message(int index) {
+  if (index < 0 || index >= BOOTSTRAP_MESSAGE_COUNT) {
+    return false;
+  }
+  const auto &msg = BOOTSTRAP_MESSAGES[index];
+  ESP_LOGD(TAG, "Adding bootstrap message %d/%d...", index + 1, BOOTSTRAP_MESSAGE_COUNT);
+  return add_persistent_message(msg.priority, msg.line_number, msg.tarif_zone, msg.static_intro,
+                                msg.scrolling_message, msg.next_message_hint, msg.duration_seconds, msg.source_info,
+                                true, msg.variant_group);
+}
 
-  const int message_count = sizeof(bootstrap_messages) / sizeof(BootstrapMessage);
-  bool success = true;
+bool B48DatabaseManager::bootstrap_default_messages() {
+  ESP_LOGI(TAG, "Checking if default messages need bootstrapping...");
+  esp_task_wdt_reset();  // Reset watchdog timer
 
-  // Add messages one by one with yields between operations to prevent watchdog timeout
-  for (int i = 0; i < message_count; i++) {
-    const auto &msg = bootstrap_messages[i];
-    ESP_LOGD(TAG, "Adding bootstrap message %d/%d...", i + 1, message_count);
+  bool ok = false;
+  if (!this->needs_bootstrap(&ok)) {
+    return ok;  // Not an error when messages already exist
+  }
 
-    success &=
-        add_persistent_message(msg.priority, msg.line_number, msg.tarif_zone, msg.static_intro, msg.scrolling_message,
-                               msg.next_message_hint, msg.duration_seconds, msg.source_info, true);
+  ESP_LOGI(TAG, "Bootstrapping default persistent messages as the table is empty.");
+  esp_task_wdt_reset();  // Reset watchdog timer before inserting messages
 
+  bool success = true;
+  // Add messages one by one with yields between operations to prevent watchdog timeout
+  for (int i = 0; i < BOOTSTRAP_MESSAGE_COUNT; i++) {
+    success &= this->add_bootstrap_message(i);
     esp_task_wdt_reset();  // Reset watchdog timer
   }
 
@@ -806,13 +1612,42 @@ bool B48DatabaseManager::bootstrap_default_messages() {
 
 // --- New Implementations ---
 
+int B48DatabaseManager::get_open_statement_count() {
+  if (!this->db_) {
+    return -1;
+  }
+  // FTS5 keeps a bounded set of statements for the life of the connection, prepared lazily as the index is used.
+  // These are the forms it generates for messages_fts: shadow table access, reads of the external content table
+  // and its schema check. None of our own SQL quotes the schema name.
+  static const char *const FTS5_STATEMENT_MARKERS[] = {
+      "'main'.'messages_fts_",        // _data, _idx, _docsize, _config
+      "FROM 'main'.'messages' ",      // Content lookups (content = 'messages')
+      "PRAGMA 'main'.data_version",  // Cache invalidation check
+  };
+  int count = 0;
+  for (sqlite3_stmt *stmt = sqlite3_next_stmt(this->db_, nullptr); stmt; stmt = sqlite3_next_stmt(this->db_, stmt)) {
+    const char *sql = sqlite3_sql(stmt);
+    bool fts5_statement = false;
+    for (const char *marker : FTS5_STATEMENT_MARKERS) {
+      if (sql != nullptr && strstr(sql, marker) != nullptr) {
+        fts5_statement = true;
+        break;
+      }
+    }
+    if (!fts5_statement) {
+      count++;
+    }
+  }
+  return count;
+}
+
 int B48DatabaseManager::get_message_count() {
   if (!this->db_) {
     ESP_LOGE(TAG, "Database connection is not open. Cannot get message count.");
     return -1;
   }
   // Get current timestamp for expiry comparison
-  time_t now_ts = time(nullptr);
+  time_t now_ts = this->current_time();
   ESP_LOGD(TAG, "get_message_count now_ts: %lld", (long long) now_ts);
 
   // Count only enabled and not-yet-expired messages
@@ -824,6 +1659,7 @@ int B48DatabaseManager::get_message_count() {
         OR duration_seconds = 0
         OR (datetime_added + duration_seconds) > ?
       )
+      AND (max_displays IS NULL OR display_count < max_displays)
   )SQL";
   sqlite3_stmt *stmt = nullptr;
   int rc = sqlite3_prepare_v2(this->db_, query, -1, &stmt, nullptr);
@@ -834,7 +1670,7 @@ int B48DatabaseManager::get_message_count() {
   sqlite3_bind_int64(stmt, 1, now_ts);
 
   int count = -1;
-  if (sqlite3_step(stmt) == SQLITE_ROW) {
+  if (this->step_statement(stmt) == SQLITE_ROW) {
     count = sqlite3_column_int(stmt, 0);
   } else {
     ESP_LOGE(TAG, "Failed to execute count statement: %s", sqlite3_errmsg(this->db_));
@@ -858,7 +1694,7 @@ bool B48DatabaseManager::clear_all_messages() {
   const char *delete_query = "DELETE FROM messages;";
   char *err_msg = nullptr;
 
-  int rc = sqlite3_exec(this->db_, delete_query, nullptr, nullptr, &err_msg);
+  int rc = this->exec_statement(delete_query, nullptr, nullptr, &err_msg);
 
   yield();               // Yield again after the operation
   esp_task_wdt_reset();  // Reset watchdog timer
@@ -896,7 +1732,7 @@ void B48DatabaseManager::dump_all_messages() {
   const char *query = R"SQL(
     SELECT message_id, priority, is_enabled, line_number, tarif_zone, 
            static_intro, scrolling_message, next_message_hint, 
-           datetime_added, duration_seconds, source_info
+           datetime_added, duration_seconds, source_info, variant_group
     FROM messages
     ORDER BY message_id ASC;
   )SQL";
@@ -914,7 +1750,7 @@ void B48DatabaseManager::dump_all_messages() {
   int count = 0;
   esp_task_wdt_reset();  // Reset watchdog timer before fetching rows
 
-  while (sqlite3_step(stmt) == SQLITE_ROW) {
+  while (this->step_statement(stmt) == SQLITE_ROW) {
     int message_id = sqlite3_column_int(stmt, 0);
     int priority = sqlite3_column_int(stmt, 1);
     bool is_enabled = sqlite3_column_int(stmt, 2) != 0;
@@ -928,6 +1764,7 @@ void B48DatabaseManager::dump_all_messages() {
     time_t added_time = static_cast<time_t>(sqlite3_column_int64(stmt, 8));
     int duration_seconds = sqlite3_column_type(stmt, 9) == SQLITE_NULL ? 0 : sqlite3_column_int(stmt, 9);
     const char *source_info = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 10));
+    const char *variant_group = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 11));
 
     // Format time for display
     char time_str[64] = "(unknown)";
@@ -950,9 +1787,10 @@ void B48DatabaseManager::dump_all_messages() {
              is_enabled ? "ENABLED" : "disabled", priority, line_number, tarif_zone, time_str, expiry_str);
 
     std::string scroll_msg = scrolling_message ? scrolling_message : "";
-    ESP_LOGI(TAG, "  Intro: '%s', Message: '%s%s' (len=%zu), Next: '%s', Source: '%s'",
+    ESP_LOGI(TAG, "  Intro: '%s', Message: '%s%s' (len=%zu), Next: '%s', Source: '%s', Group: '%s'",
              static_intro ? static_intro : "", scroll_msg.substr(0, 30).c_str(), scroll_msg.length() > 30 ? "..." : "",
-             scroll_msg.length(), next_hint ? next_hint : "", source_info ? source_info : "");
+             scroll_msg.length(), next_hint ? next_hint : "", source_info ? source_info : "",
+             variant_group ? variant_group : "");
 
     count++;
 
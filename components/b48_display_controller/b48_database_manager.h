@@ -2,10 +2,14 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <memory>
+#include <cstdint>
 #include <ctime>  // For time_t in MessageEntry
+#include <functional>
 #include <sqlite3.h>
 #include "character_mappings.h"
+#include "b48_fault_injection.h"
 // Remove the circular dependency
 // #include "b48_display_controller.h" // For MessageEntry struct
 
@@ -24,8 +28,16 @@ struct MessageEntry {
   std::string static_intro;   // Static intro text (zI command)
   std::string scrolling_message; // Main scrolling message (zM command)
   std::string next_message_hint; // Next stop hint (v command)
+  uint32_t variant_group = 0;     // variant_group_id() of the group key; variants share one scheduling slot
+  int max_displays = 0;           // Retire after this many displays; 0 = no limit
+  int display_count = 0;          // Displays so far, including those not yet flushed to the database
+
+  // Content pack messages carry no text copies; their encoded frames are read in place from flash
+  const uint8_t *prebuilt_frames = nullptr;  // l/e/zI/zM/v frames incl. CR and checksum
+  size_t prebuilt_frames_length = 0;
+  size_t prebuilt_scroll_length = 0;         // Unencoded scroll text length, for display duration
   
-  // Default constructor needed for std::make_shared<MessageEntry>()
+  // Default constructor needed for MessageTable slots
   MessageEntry() = default;
   
   // Constructor for creating simple messages (used for loading/fallback messages)
@@ -35,6 +47,14 @@ struct MessageEntry {
       : is_ephemeral(is_ephemeral), message_id(message_id), priority(priority),
         line_number(line_number), tarif_zone(tarif_zone), static_intro(static_intro),
         scrolling_message(scrolling_message), next_message_hint(next_message_hint) {}
+
+  bool displays_exhausted() const { return this->max_displays > 0 && this->display_count >= this->max_displays; }
+};
+
+// One search_messages() match
+struct SearchHit {
+  int message_id;
+  std::string snippet;  // Context around the match, with the matched words in [brackets]
 };
 
 class B48DatabaseManager {
@@ -50,7 +70,8 @@ class B48DatabaseManager {
   bool add_persistent_message(int priority, int line_number, int tarif_zone,
                               const std::string &static_intro, const std::string &scrolling_message,
                               const std::string &next_message_hint, int duration_seconds,
-                              const std::string &source_info, bool check_duplicates = true);
+                              const std::string &source_info, bool check_duplicates = true,
+                              const std::string &variant_group = "", int max_displays = 0);
 
   bool update_persistent_message(int message_id, int priority, bool is_enabled,
                                int line_number, int tarif_zone, const std::string &static_intro,
@@ -59,13 +80,38 @@ class B48DatabaseManager {
 
   bool delete_persistent_message(int message_id);
 
-  std::vector<std::shared_ptr<MessageEntry>> get_active_persistent_messages();
+  // ok (optional) is set to false if the query failed part-way; the result is then incomplete
+  std::vector<MessageEntry> get_active_persistent_messages(bool *ok = nullptr);
+  // Up to `limit` active messages with message_id > after_id, in message_id order (for stepwise cache loads).
+  // Appends to out; returns false on a database error.
+  bool get_active_persistent_messages_page(int after_id, int limit, std::vector<MessageEntry> &out);
+
+  // Full-text search over static_intro and scrolling_message of enabled messages, newest (highest message_id)
+  // first in both modes, not by relevance. Each word is matched as a prefix, diacritics ignored ("grilovacka"
+  // finds "Grilovačka"). Uses the messages_fts index once its backfill is done, otherwise a LIKE scan for the
+  // whole phrase (ASCII case-folding only).
+  bool search_messages(const std::string &query, int limit, std::vector<SearchHit> &hits, bool *used_index = nullptr);
+  bool search_index_ready() const;
+  int search_index_bytes();  // Approximate payload of the index tables, -1 without an index
+  int database_bytes();      // page_count * page_size, -1 on error
+  static constexpr int SEARCH_INDEX_SCHEMA_VERSION = 4;
 
   // Maintenance
-  int expire_old_messages(); // Returns number of messages expired
+  int expire_old_messages(); // Returns number of messages expired (past their duration or their max_displays)
+
+  // Add displays counted in RAM (message_id -> displays since the last flush) in one transaction, which also
+  // disables the messages that reached max_displays; `retired` is how many of those there were
+  bool add_display_counts(const std::map<int, uint32_t> &counts, int &retired);
 
   int purge_disabled_messages(); // Returns number of disabled messages physically deleted from the database
 
+  // Stepwise purge for background jobs; each returns -1 on error
+  int count_disabled_messages();
+  int purge_disabled_messages_step(int max_rows);  // Rows deleted, 0 when none are left
+  int vacuum_step(int max_pages);  // Free pages still left in the file after this step (0 if not incremental)
+  static constexpr int PURGE_CHUNK_ROWS = 16;
+  static constexpr int VACUUM_CHUNK_PAGES = 32;
+
   int get_message_count(); // <-- ADDED: Get count of active persistent messages
 
   bool clear_all_messages(); // <-- ADDED: Method to clear all persistent messages
@@ -75,6 +121,31 @@ class B48DatabaseManager {
 
   // Bootstrapping
   bool bootstrap_default_messages();
+  // With deferral on, initialize() leaves bootstrapping to the caller (the controller runs it as a job)
+  void set_defer_bootstrap(bool defer) { this->defer_bootstrap_ = defer; }
+  bool needs_bootstrap(bool *ok = nullptr);  // True if the table has no active messages
+  static int bootstrap_message_count();
+  bool add_bootstrap_message(int index);
+
+  // Online schema migrations
+  // Schema changes (DDL) are applied synchronously during initialize(); row backfills run later in
+  // small chunked transactions so the display keeps running. Progress survives reboots.
+  bool has_pending_backfill() const { return this->pending_backfill_version_ > 0; }
+  int advance_migrations(int max_rows);  // Returns rows backfilled in this step, -1 on error
+  bool is_migration_complete(int version) const;
+
+  // Clock used for expiry decisions and timestamps. Defaults to time(nullptr); the soak test
+  // installs a virtual clock so weeks of operation can be simulated in minutes.
+  void set_time_source(std::function<time_t()> source) { this->time_source_ = std::move(source); }
+
+  // Diagnostics for leak hunting
+  int get_open_statement_count();  // Our prepared statements not yet finalized (FTS5's own cache excluded)
+
+  // 32-bit FNV-1a hash of message text, also registered as the b48_hash() SQL function
+  static uint32_t content_hash(const std::string &text);
+
+  // Scheduling ID of a variant group key (e.g. "support" for the Czech and English versions); 0 for no group
+  static uint32_t variant_group_id(const std::string &key);
 
   // Convert non-ASCII characters to their ASCII equivalents (use only when ASCII is required)
   static std::string convert_to_ascii(const std::string &str);
@@ -88,9 +159,37 @@ class B48DatabaseManager {
  private:
   // Helper for schema creation/migration
   bool check_and_create_schema(); 
+  bool apply_pending_migrations(int user_version, bool fresh_schema);  // Empty tables need no backfill
+  bool ensure_incremental_vacuum();  // One-time full VACUUM at boot for databases created without it
+  bool load_migration_state();
+  bool exec_simple(const char *sql, const char *context);
+  bool query_int(const char *sql, int &value);  // First column of the first row
+  static MessageEntry read_message_row(sqlite3_stmt *stmt);
+  static std::string build_match_query(const std::string &query);  // User words -> FTS5 prefix terms
+  static std::string make_snippet(const std::string &text, size_t match_pos, size_t match_len);
+
+  // Every sqlite3_step()/sqlite3_exec() goes through these, so fault injection can fail them
+  int step_statement(sqlite3_stmt *stmt);
+  int exec_statement(const char *sql, int (*callback)(void *, int, char **, char **), void *arg, char **err_msg);
+
+  time_t current_time() const {
+    time_t now = this->time_source_ ? this->time_source_() : time(nullptr);
+#ifdef B48_FAULT_INJECTION
+    if (global_fault_injector != nullptr) {
+      now = global_fault_injector->adjust_clock(now);
+    }
+#endif
+    return now;
+  }
 
   std::string database_path_;
   sqlite3 *db_{nullptr};
+  std::function<time_t()> time_source_;
+
+  // Lowest schema version whose backfill is still running (0 = none)
+  int pending_backfill_version_{0};
+  bool defer_bootstrap_{false};
+  bool search_index_available_{false};  // messages_fts exists (SQLite has FTS5 and migration v4 created it)
 
   // Disable copy and assign
   B48DatabaseManager(const B48DatabaseManager&) = delete;
@@ -4,6 +4,7 @@
 #include "esphome/core/log.h"
 #include "esphome/core/hal.h"
 #include "esphome/core/application.h"
+#include "esphome/core/helpers.h"  // For base64_decode
 #include <sstream>
 #include <iomanip>
 #include <cstring>
@@ -24,7 +25,11 @@ static const char *const TAG = "b48c.main";
 static const char CR = 0x0D;  // Carriage Return for BUSE120 protocol
 
 // Destructor
-B48DisplayController::~B48DisplayController() {}
+B48DisplayController::~B48DisplayController() {
+  if (global_log_ring == this->log_ring_.get()) {
+    global_log_ring = nullptr;
+  }
+}
 
 // --- HA Entity Setters ---
 void B48DisplayController::set_message_queue_size_sensor(sensor::Sensor *sensor) {
@@ -41,6 +46,13 @@ void B48DisplayController::setup() {
   ESP_LOGCONFIG(TAG, "Setting up B48 Display Controller");
   ESP_LOGI(TAG, "Database path: '%s'", this->database_path_.empty() ? "(EMPTY)" : this->database_path_.c_str());
 
+  // Allocate the hot-path log ring first so setup's own cache loads are captured
+  if (this->log_ring_size_ > 0 && !this->log_ring_) {
+    this->log_ring_.reset(new B48LogRing(this->log_ring_size_));
+    global_log_ring = this->log_ring_.get();
+    ESP_LOGD(TAG, "Log ring: %d bytes", this->log_ring_size_);
+  }
+
   // Initialize HA integration if it hasn't been already
   if (!this->ha_integration_) {
     ESP_LOGD(TAG, "Creating HA integration instance");
@@ -91,8 +103,14 @@ void B48DisplayController::setup() {
         db_initialized = handle_database_wipe();
       }
 
+      // Default messages are written in the background so setup() returns quickly
+      if (db_initialized) {
+        this->submit_bootstrap_job();
+      }
+
       // Run self-tests if configured to do so and database is available
       if (db_initialized && this->run_tests_on_startup_) {
+        this->job_runner_.drain();  // Tests expect a bootstrapped database
         this->runSelfTests();
       }
 
@@ -103,6 +121,11 @@ void B48DisplayController::setup() {
     }
   }
 
+  // Map the prebuilt content pack, if one is configured. It does not depend on the database.
+  if (!this->content_pack_partition_.empty()) {
+    load_content_pack();
+  }
+
   // Prepare appropriate loading message based on database status
   display_startup_message(db_initialized);
 
@@ -121,7 +144,8 @@ void B48DisplayController::setup() {
 }
 void B48DisplayController::loop() {
   // Update current time using standard C time
-  this->current_time_ = time(nullptr);
+  this->current_time_ = this->wall_time();
+  this->account_airtime();
 
   // If state machine is paused, only handle HA queue updates and essential checks.
   if (this->state_machine_paused_.load()) {
@@ -135,12 +159,21 @@ void B48DisplayController::loop() {
     return; // Skip main state machine logic
   }
 
-  // Check for pending refresh from callbacks
-  if (this->pending_message_cache_refresh_.exchange(false)) {
-    this->refresh_message_cache();
-    update_ha_queue_size();
+  // Retry a failed cache refresh after a pause; the previous cache stays in rotation meanwhile
+  if (this->cache_refresh_failed_ && millis() - this->cache_refresh_failed_ms_ >= CACHE_REFRESH_RETRY_MS) {
+    this->pending_message_cache_refresh_.store(true);
+  }
+
+  // Check for pending refresh from callbacks. The load runs as a job; a request that arrives while one is
+  // in flight waits for it, so the next load sees the change.
+  if (this->pending_message_cache_refresh_.load() && !this->job_runner_.is_queued(CACHE_LOAD_JOB)) {
+    this->pending_message_cache_refresh_.store(false);
+    this->job_runner_.submit(this->make_cache_load_job());
   }
 
+  // Background storage work (cache loads, purge, vacuum, backfills) within this loop's time budget
+  this->job_runner_.run(this->job_budget_us_);
+
   // Check for time test mode
   if (this->time_test_mode_active_) {
     // Run the time test mode state machine
@@ -184,6 +217,16 @@ void B48DisplayController::loop() {
   // Check if we should purge disabled messages (every 24 hours)
   check_purge_interval();
 
+  // Write display counts of count-limited messages in one batch per interval
+  check_display_count_flush();
+
+  // Continue background schema backfills (also restarts one after a failed chunk)
+  static unsigned long last_migration_check = 0;
+  if (millis() - last_migration_check > MIGRATION_CHECK_INTERVAL_MS) {
+    advance_schema_migrations();
+    last_migration_check = millis();
+  }
+
   // Handle time synchronization with the display
   if (this->time_sync_interval_ > 0 && this->current_time_ > 0) {
     unsigned long current_millis = millis();
@@ -205,6 +248,10 @@ void B48DisplayController::dump_config() {
   ESP_LOGCONFIG(TAG, "B48 Display Controller:");
   ESP_LOGCONFIG(TAG, "  Database Path: %s", this->database_path_.c_str());
   ESP_LOGCONFIG(TAG, "  Transition Duration: %d seconds", this->transition_duration_);
+  if (this->transition_tuner_.adaptive()) {
+    ESP_LOGCONFIG(TAG, "  Transition Bounds: %u-%u ms (follows the wire time of each transition)",
+                  (unsigned) this->transition_tuner_.min_ms(), (unsigned) this->transition_tuner_.max_ms());
+  }
   ESP_LOGCONFIG(TAG, "  Time Sync Interval: %d seconds", this->time_sync_interval_);
   ESP_LOGCONFIG(TAG, "  Emergency Priority Threshold: %d", this->emergency_priority_threshold_);
   ESP_LOGCONFIG(TAG, "  Run Tests on Startup: %s", YESNO(this->run_tests_on_startup_));
@@ -217,17 +264,58 @@ void B48DisplayController::dump_config() {
   ESP_LOGCONFIG(TAG, "  Character Reverse Test Status: %s", this->character_reverse_test_mode_active_ ? "Active" : "Inactive");
   ESP_LOGCONFIG(TAG, "  State Machine Status: %s", this->state_machine_paused_.load() ? "Paused" : "Running");
 
+  if (!this->content_pack_partition_.empty()) {
+    ESP_LOGCONFIG(TAG, "  Content Pack Partition: %s (%s)", this->content_pack_partition_.c_str(),
+                  this->content_pack_.is_loaded() ? "loaded" : "not loaded");
+    ESP_LOGCONFIG(TAG, "  Content Pack Load: %u us, %d bytes heap", (unsigned) this->pack_load_us_,
+                  (int) this->pack_load_heap_bytes_);
+  }
+  ESP_LOGCONFIG(TAG, "  SQLite Cache Load: %u us, %d bytes heap", (unsigned) this->cache_load_us_,
+                (int) this->cache_load_heap_bytes_);
+  if (this->db_manager_) {
+    ESP_LOGCONFIG(TAG, "  Message Search: %s, index ~%d bytes",
+                  this->db_manager_->search_index_ready() ? "fts5 index" : "LIKE scan",
+                  this->db_manager_->search_index_bytes());
+  }
+  ESP_LOGCONFIG(TAG, "  Display Count Flush: every %d seconds", this->display_count_flush_interval_);
+  ESP_LOGCONFIG(TAG, "  Shadow Scheduling Policies: %zu", this->shadow_scheduler_.policy_count());
+  ESP_LOGCONFIG(TAG, "  Job Budget: %u us per loop, %zu jobs queued, %u loops over budget",
+                (unsigned) this->job_budget_us_, this->job_runner_.queued_count(),
+                (unsigned) this->job_runner_.budget_overruns());
+  if (this->log_ring_) {
+    ESP_LOGCONFIG(TAG, "  Log Ring: %zu/%zu bytes, %zu records held, %u recorded, %u overwritten",
+                  this->log_ring_->used_bytes(), this->log_ring_->capacity_bytes(), this->log_ring_->record_count(),
+                  (unsigned) this->log_ring_->recorded_count(), (unsigned) this->log_ring_->overwritten_count());
+  } else {
+    ESP_LOGCONFIG(TAG, "  Log Ring: disabled (hot paths log directly)");
+  }
+#ifdef B48_FAULT_INJECTION
+  ESP_LOGCONFIG(TAG, "  Fault Injection: compiled in (run_fault_injection service)");
+#endif
+
   // Log cache info
   std::lock_guard<std::mutex> lock(this->message_mutex_);
   ESP_LOGCONFIG(TAG, "  Persistent Messages (in cache): %d", this->persistent_messages_.size());
+  ESP_LOGCONFIG(TAG, "  Content Pack Messages (in flash): %u", (unsigned) this->pack_messages_.size());
   ESP_LOGCONFIG(TAG, "  Ephemeral Messages (in RAM): %d", this->ephemeral_messages_.size());
+  ESP_LOGCONFIG(TAG, "  Message Table: %zu live / %zu slots, ~%zu bytes, last selection %u us",
+                this->message_table_.size(), this->message_table_.slot_count(), this->message_table_.memory_usage(),
+                (unsigned) this->last_selection_us_);
+}
+
+void B48DisplayController::on_shutdown() {
+  // Synchronous: the job runner does not get another loop() before a reboot
+  if (this->db_manager_) {
+    this->flush_display_counts();
+  }
 }
 
 // --- Public Methods Called by HA Integration ---
 
 bool B48DisplayController::add_message(int priority, int line_number, int tarif_zone, const std::string &static_intro,
                                        const std::string &scrolling_message, const std::string &next_message_hint,
-                                       int duration_seconds, const std::string &source_info, bool check_duplicates) {
+                                       int duration_seconds, const std::string &source_info, bool check_duplicates,
+                                       const std::string &variant_group, int max_displays) {
   bool success = false;
   // Determine if the message is ephemeral or persistent based on duration
   if (duration_seconds > 0 && duration_seconds < EPHEMERAL_DURATION_THRESHOLD_SECONDS) {
@@ -237,42 +325,46 @@ bool B48DisplayController::add_message(int priority, int line_number, int tarif_
     std::string safe_scrolling_message = B48DatabaseManager::sanitize_for_database_storage(scrolling_message);
     std::string safe_next_message_hint = B48DatabaseManager::sanitize_for_database_storage(next_message_hint);
 
-    ESP_LOGD(TAG, "Adding ephemeral message (duration %ds < %ds): %s%s (len=%zu)", duration_seconds,
-             EPHEMERAL_DURATION_THRESHOLD_SECONDS, safe_scrolling_message.substr(0, 30).c_str(),
-             safe_scrolling_message.length() > 30 ? "..." : "", safe_scrolling_message.length());
+    B48_RLOGD(TAG, "Adding ephemeral message (duration %ds < %ds): %.30s%s (len=%zu)", duration_seconds,
+              EPHEMERAL_DURATION_THRESHOLD_SECONDS, safe_scrolling_message.c_str(),
+              safe_scrolling_message.length() > 30 ? "..." : "", safe_scrolling_message.length());
 
     // Log if there were Unicode punctuation characters that were converted to ASCII
     if (safe_scrolling_message != scrolling_message) {
-        ESP_LOGD(TAG, "Ephemeral message contained Unicode punctuation, converted to ASCII: '%s%s' -> '%s%s'",
-                 scrolling_message.substr(0, 30).c_str(), scrolling_message.length() > 30 ? "..." : "",
-                 safe_scrolling_message.substr(0, 30).c_str(), safe_scrolling_message.length() > 30 ? "..." : "");
-    }
-
-    auto msg = std::make_shared<MessageEntry>();
-    msg->message_id = -1;  // Ephemeral messages don't have a DB ID
-    msg->priority = priority;
-    msg->line_number = line_number;
-    msg->tarif_zone = tarif_zone;
-    msg->static_intro = safe_static_intro;
-    msg->scrolling_message = safe_scrolling_message;
-    msg->next_message_hint = safe_next_message_hint;
-    msg->expiry_time = time(nullptr) + duration_seconds;  // Set TTL based on current time
-    msg->last_display_time = 0;                           // Use correct member name
-    msg->is_ephemeral = true;                             // Mark as ephemeral
+        B48_RLOGD(TAG, "Ephemeral message contained Unicode punctuation, converted to ASCII: '%.30s' -> '%.30s'",
+                  scrolling_message.c_str(), safe_scrolling_message.c_str());
+    }
+
+    MessageEntry msg;
+    msg.message_id = -1;  // Ephemeral messages don't have a DB ID
+    msg.priority = priority;
+    msg.line_number = line_number;
+    msg.tarif_zone = tarif_zone;
+    msg.static_intro = safe_static_intro;
+    msg.scrolling_message = safe_scrolling_message;
+    msg.next_message_hint = safe_next_message_hint;
+    msg.expiry_time = this->wall_time() + duration_seconds;  // Set TTL based on current time
+    msg.last_display_time = 0;
+    msg.is_ephemeral = true;  // Mark as ephemeral
+    msg.variant_group = B48DatabaseManager::variant_group_id(variant_group);
+    msg.max_displays = max_displays > 0 ? max_displays : 0;  // Counted in RAM only, like the whole message
 
     {
       std::lock_guard<std::mutex> lock(this->message_mutex_);
-      this->ephemeral_messages_.push_back(msg);
-      ESP_LOGD(TAG, "Ephemeral message added to RAM queue. Current ephemeral count: %d",
-               this->ephemeral_messages_.size());
+      MessageHandle handle = this->message_table_.insert(msg);
+      if (!handle.is_valid()) {
+        return false;
+      }
+      this->ephemeral_messages_.push_back(handle);
+      B48_RLOGD(TAG, "Ephemeral message added to RAM queue. Current ephemeral count: %zu",
+                this->ephemeral_messages_.size());
+
+      // Keep the queue sorted by descending priority
+      const MessageTable &table = this->message_table_;
+      std::sort(this->ephemeral_messages_.begin(), this->ephemeral_messages_.end(),
+                [&table](MessageHandle a, MessageHandle b) { return table.get(a)->priority > table.get(b)->priority; });
     }
 
-    // After adding a new ephemeral message
-    std::sort(this->ephemeral_messages_.begin(), this->ephemeral_messages_.end(),
-              [](const std::shared_ptr<MessageEntry> &a, const std::shared_ptr<MessageEntry> &b) {
-                return a->priority > b->priority;  // Sort by descending priority
-              });
-
     // If the message is above emergency threshold, force transition to display message
     if (priority >= this->emergency_priority_threshold_) {
       this->should_interrupt_ = true;
@@ -282,20 +374,18 @@ bool B48DisplayController::add_message(int priority, int line_number, int tarif_
   } else {
     // --- Handle Persistent Message (Saved to DB) ---
     if (duration_seconds == 0) {
-        ESP_LOGD(TAG, "Adding permanent persistent message (duration 0s): %s%s (len=%zu)",
-                 scrolling_message.substr(0, 30).c_str(),
-                 scrolling_message.length() > 30 ? "..." : "", scrolling_message.length());
+        B48_RLOGD(TAG, "Adding permanent persistent message (duration 0s): %.30s%s (len=%zu)",
+                  scrolling_message.c_str(), scrolling_message.length() > 30 ? "..." : "", scrolling_message.length());
     } else if (duration_seconds < 0) {
         // This case should ideally be sanitized earlier or indicate an issue.
         // For now, log it clearly; database layer might treat negative as permanent or apply default.
-        ESP_LOGD(TAG, "Adding persistent message (invalid negative duration %ds, will be treated as persistent): %s%s (len=%zu)",
-                 duration_seconds, scrolling_message.substr(0, 30).c_str(),
-                 scrolling_message.length() > 30 ? "..." : "", scrolling_message.length());
+        B48_RLOGD(TAG, "Adding persistent message (invalid negative duration %ds, will be treated as persistent): %.30s%s (len=%zu)",
+                  duration_seconds, scrolling_message.c_str(),
+                  scrolling_message.length() > 30 ? "..." : "", scrolling_message.length());
     } else { // duration_seconds >= EPHEMERAL_DURATION_THRESHOLD_SECONDS
-        ESP_LOGD(TAG, "Adding long-duration persistent message (duration %ds >= %ds threshold): %s%s (len=%zu)",
-                 duration_seconds, EPHEMERAL_DURATION_THRESHOLD_SECONDS,
-                 scrolling_message.substr(0, 30).c_str(),
-                 scrolling_message.length() > 30 ? "..." : "", scrolling_message.length());
+        B48_RLOGD(TAG, "Adding long-duration persistent message (duration %ds >= %ds threshold): %.30s%s (len=%zu)",
+                  duration_seconds, EPHEMERAL_DURATION_THRESHOLD_SECONDS, scrolling_message.c_str(),
+                  scrolling_message.length() > 30 ? "..." : "", scrolling_message.length());
     }
 
     if (!this->db_manager_) {
@@ -308,7 +398,7 @@ bool B48DisplayController::add_message(int priority, int line_number, int tarif_
                                    : EPHEMERAL_DURATION_THRESHOLD_SECONDS;  // Default 10 min for persistent
 
       return add_message(priority, line_number, tarif_zone, static_intro, scrolling_message, next_message_hint,
-                         ephemeral_duration, source_info, false);
+                         ephemeral_duration, source_info, false, variant_group, max_displays);
     }
 
     // Ensure duration is valid (set to 0 for permanent if > 1 year)
@@ -320,10 +410,10 @@ bool B48DisplayController::add_message(int priority, int line_number, int tarif_
     }
 
     // Call the database manager to add the message
-    bool success = this->db_manager_->add_persistent_message(
+    success = this->db_manager_->add_persistent_message(
         priority, line_number, tarif_zone, static_intro, scrolling_message, next_message_hint,
         actual_duration,  // Use potentially capped duration
-        source_info.empty() ? "Persistent" : source_info, check_duplicates);
+        source_info.empty() ? "Persistent" : source_info, check_duplicates, variant_group, max_displays);
 
     if (success) {
       ESP_LOGI(TAG, "Successfully added message to database. Triggering cache refresh.");
@@ -401,9 +491,10 @@ bool B48DisplayController::wipe_and_reinitialize_database() {
   // 3. Clear ephemeral message cache in RAM under lock
   {
     std::lock_guard<std::mutex> lock(this->message_mutex_);
-    this->ephemeral_messages_.clear();
+    release_handles(this->ephemeral_messages_);
     ESP_LOGD(TAG, "Cleared ephemeral message cache.");
   }
+  this->submit_bootstrap_job();
   // Trigger refresh of message cache
   this->pending_message_cache_refresh_.store(true);
 
@@ -417,7 +508,8 @@ void B48DisplayController::update_ha_queue_size() {
   int total_messages = 0;
   {
     std::lock_guard<std::mutex> lock(this->message_mutex_);
-    total_messages = this->persistent_messages_.size() + this->ephemeral_messages_.size();
+    total_messages =
+        this->persistent_messages_.size() + this->pack_messages_.size() + this->ephemeral_messages_.size();
   }
 
   if (this->ha_integration_) {
@@ -432,37 +524,238 @@ bool B48DisplayController::refresh_message_cache() {
     return false;
   }
 
-  // Perform database query outside of mutex lock to avoid blocking other tasks
-  ESP_LOGD(TAG, "Querying persistent messages from database outside lock...");
-  auto new_persistent = this->db_manager_->get_active_persistent_messages();
-  ESP_LOGD(TAG, "Database returned %d persistent messages", new_persistent.size());
+  std::unique_ptr<B48Job> job = this->make_cache_load_job();
+  return B48JobRunner::run_to_completion(*job);
+}
 
-  // Now update the cache under lock
-  {
-    std::lock_guard<std::mutex> lock(this->message_mutex_);
-    this->persistent_messages_ = std::move(new_persistent);
+std::unique_ptr<B48Job> B48DisplayController::make_cache_load_job() {
+  // Pages are read outside the mutex; the cache is only swapped once the whole result is in
+  struct CacheLoad {
+    std::vector<MessageEntry> loaded;
+    int last_id{0};
+    int32_t heap_before{0};
+  };
+  std::shared_ptr<CacheLoad> load = std::make_shared<CacheLoad>();
+
+  auto step = [this, load](B48Job &job) {
+    if (!this->db_manager_) {
+      job.fail();
+      return false;
+    }
+    if (job.steps() == 0) {
+      load->heap_before = ESP.getFreeHeap();
+    }
+    size_t before = load->loaded.size();
+    if (!this->db_manager_->get_active_persistent_messages_page(load->last_id, CACHE_LOAD_PAGE_ROWS, load->loaded)) {
+      job.fail();
+      return false;
+    }
+    job.set_progress(load->loaded.size(), 0);
+    if (load->loaded.size() == before) {
+      return false;
+    }
+    load->last_id = load->loaded.back().message_id;
+    return load->loaded.size() - before == CACHE_LOAD_PAGE_ROWS;
+  };
+
+  auto finish = [this, load](B48Job &job) {
+    if (job.failed()) {
+      // A partial result would silently drop messages from rotation; keep the current cache and retry later
+      ESP_LOGW(TAG, "Persistent message query failed, keeping %zu cached messages",
+               this->persistent_messages_.size());
+      this->cache_refresh_failed_ = true;
+      this->cache_refresh_failed_ms_ = millis();
+      return;
+    }
+    this->cache_refresh_failed_ = false;
+    ESP_LOGD(TAG, "Database returned %zu persistent messages", load->loaded.size());
+
+    uint32_t apply_start_us = micros();
+    this->apply_persistent_messages(load->loaded);
+    this->cache_load_us_ = job.busy_us() + (micros() - apply_start_us);
+    this->cache_load_heap_bytes_ = load->heap_before - (int32_t) ESP.getFreeHeap();
+    ESP_LOGI(TAG, "SQLite cache load took %u us in %u steps, heap delta %d bytes", (unsigned) this->cache_load_us_,
+             (unsigned) job.steps(), (int) this->cache_load_heap_bytes_);
+
+    // Update HA sensor with new queue size
+    update_ha_queue_size();
+  };
+
+  return std::unique_ptr<B48Job>(new B48Job(CACHE_LOAD_JOB, step, finish));
+}
+
+void B48DisplayController::apply_persistent_messages(std::vector<MessageEntry> &loaded_messages) {
+  // Selection walks the cache in this order
+  std::sort(loaded_messages.begin(), loaded_messages.end(), [](const MessageEntry &a, const MessageEntry &b) {
+    return a.priority != b.priority ? a.priority > b.priority : a.message_id < b.message_id;
+  });
+
+  // Update the cache under lock. Slots are reused by message_id, so handles held by the
+  // state machine stay valid (and see updated text) unless their message left the cache.
+  std::lock_guard<std::mutex> lock(this->message_mutex_);
+  std::map<int, MessageHandle> existing;
+  for (MessageHandle handle : this->persistent_messages_) {
+    const MessageEntry *entry = this->message_table_.get(handle);
+    if (entry) {
+      existing[entry->message_id] = handle;
+    }
   }
 
-  // Update HA sensor with new queue size
-  update_ha_queue_size();
-  return true;
+  std::vector<MessageHandle> refreshed;
+  refreshed.reserve(loaded_messages.size());
+  for (auto &loaded : loaded_messages) {
+    // The database only holds flushed displays; add the ones still pending in RAM
+    auto pending = this->pending_display_counts_.find(loaded.message_id);
+    if (pending != this->pending_display_counts_.end()) {
+      loaded.display_count += pending->second;
+    }
+    auto it = existing.find(loaded.message_id);
+    if (it != existing.end()) {
+      MessageEntry *entry = this->message_table_.get(it->second);
+      loaded.last_display_time = entry->last_display_time;  // Keep fairness history across refreshes
+      // A flush may land between the pages of one load; the cached count never goes down
+      loaded.display_count = std::max(loaded.display_count, entry->display_count);
+      *entry = std::move(loaded);
+      refreshed.push_back(it->second);
+      existing.erase(it);
+    } else {
+      MessageHandle handle = this->message_table_.insert(loaded);
+      if (handle.is_valid()) {
+        refreshed.push_back(handle);
+      }
+    }
+  }
+  // Whatever is left disappeared from the database; its handles become stale
+  for (const auto &gone : existing) {
+    this->message_table_.remove(gone.second);
+  }
+  this->persistent_messages_ = std::move(refreshed);
+}
+
+void B48DisplayController::submit_bootstrap_job() {
+  if (!this->db_manager_) {
+    return;
+  }
+  int next = -1;  // -1 until the emptiness check has run
+  bool all_added = true;
+  auto step = [this, next, all_added](B48Job &job) mutable {
+    if (!this->db_manager_) {
+      job.fail();
+      return false;
+    }
+    int total = B48DatabaseManager::bootstrap_message_count();
+    if (next < 0) {
+      bool ok = false;
+      if (!this->db_manager_->needs_bootstrap(&ok)) {
+        if (!ok) {
+          job.fail();
+        }
+        return false;
+      }
+      ESP_LOGI(TAG, "Bootstrapping default persistent messages as the table is empty.");
+      next = 0;
+      job.set_progress(0, total);
+      return true;
+    }
+    all_added &= this->db_manager_->add_bootstrap_message(next);
+    next++;
+    job.set_progress(next, total);
+    if (next < total) {
+      return true;
+    }
+    if (!all_added) {
+      job.fail();
+    }
+    return false;
+  };
+  auto finish = [this](B48Job &job) {
+    if (job.failed()) {
+      ESP_LOGW(TAG, "Failed to bootstrap default messages. Some functionality may be limited.");
+    }
+    if (job.progress_done() > 0) {
+      this->pending_message_cache_refresh_.store(true);
+    }
+  };
+  this->job_runner_.submit(std::unique_ptr<B48Job>(new B48Job("bootstrap", step, finish)));
+}
+
+void B48DisplayController::release_handles(std::vector<MessageHandle> &handles) {
+  for (MessageHandle handle : handles) {
+    this->message_table_.remove(handle);
+  }
+  handles.clear();
+}
+
+void B48DisplayController::release_pack_messages() {
+  std::lock_guard<std::mutex> lock(this->message_mutex_);
+  // The current message's frames may point into the mapping, so it must not outlive it
+  if (std::find(this->pack_messages_.begin(), this->pack_messages_.end(), this->current_message_) !=
+      this->pack_messages_.end()) {
+    this->current_message_ = MessageHandle();
+  }
+  release_handles(this->pack_messages_);
+  this->pack_source_ids_.clear();
+}
+
+bool B48DisplayController::shadowed_by_pack(const MessageEntry &msg) const {
+  return !msg.is_ephemeral && std::binary_search(this->pack_source_ids_.begin(), this->pack_source_ids_.end(),
+                                                 msg.message_id);
+}
+
+void B48DisplayController::rebase_display_history(time_t now) {
+  // Display times ahead of the clock mean it was stepped backwards (e.g. an SNTP correction). Without this,
+  // every recently shown message would count as "just shown" until the clock caught up, and the highest
+  // priority one would win every slot. Shift the history so the newest display is "now", keeping its order.
+  const std::vector<MessageHandle> *pools[] = {&this->ephemeral_messages_, &this->persistent_messages_,
+                                               &this->pack_messages_};
+  time_t newest = 0;
+  for (const auto *pool : pools) {
+    for (MessageHandle handle : *pool) {
+      const MessageEntry *msg = this->message_table_.get(handle);
+      if (msg) {
+        newest = std::max(newest, msg->last_display_time);
+      }
+    }
+  }
+  if (newest <= now) {
+    return;
+  }
+
+  time_t shift = newest - now;
+  B48_RLOGW(TAG, "Clock is %ld s behind the display history, rebasing it", (long) shift);
+  for (const auto *pool : pools) {
+    for (MessageHandle handle : *pool) {
+      MessageEntry *msg = this->message_table_.get(handle);
+      if (msg && msg->last_display_time > 0) {
+        msg->last_display_time = std::max<time_t>(msg->last_display_time - shift, 1);
+      }
+    }
+  }
+}
+
+void B48DisplayController::set_time_source(std::function<time_t()> source) {
+  this->time_source_ = source;
+  if (this->db_manager_) {
+    this->db_manager_->set_time_source(source);
+  }
 }
 
 void B48DisplayController::check_expired_ephemeral_messages() {
   // Only check ephemeral messages in RAM (no database interaction)
-  time_t now = time(nullptr);
+  time_t now = this->wall_time();
   int ephemeral_expired = 0;
   std::lock_guard<std::mutex> lock(this->message_mutex_);
 
   // Remove expired ephemeral messages based on TTL only
+  MessageTable &table = this->message_table_;
   this->ephemeral_messages_.erase(std::remove_if(this->ephemeral_messages_.begin(), this->ephemeral_messages_.end(),
-                                                 [&](const std::shared_ptr<MessageEntry> &msg) {
-                                                   bool expired = false;
-                                                   // Check TTL
-                                                   if (msg->expiry_time > 0 && msg->expiry_time <= now) {
-                                                     expired = true;
-                                                   }
+                                                 [&](MessageHandle handle) {
+                                                   const MessageEntry *msg = table.get(handle);
+                                                   // Check TTL and display limit
+                                                   bool expired = !msg || msg->displays_exhausted() ||
+                                                                  (msg->expiry_time > 0 && msg->expiry_time <= now);
                                                    if (expired) {
+                                                     table.remove(handle);
                                                      ephemeral_expired++;
                                                    }
                                                    return expired;
@@ -494,107 +787,211 @@ void B48DisplayController::check_expired_messages() {
   // No need to check ephemeral messages here since we have a separate method for that
 }
 
-std::shared_ptr<MessageEntry> B48DisplayController::select_next_message() {
+void B48DisplayController::check_display_count_flush() {
+  if (millis() - this->last_display_count_flush_ms_ < (unsigned long) this->display_count_flush_interval_ * 1000) {
+    return;
+  }
+  this->last_display_count_flush_ms_ = millis();
+  bool pending = false;
+  {
+    std::lock_guard<std::mutex> lock(this->message_mutex_);
+    pending = !this->pending_display_counts_.empty();
+  }
+  if (pending) {
+    this->submit_display_count_flush();
+  }
+}
+
+void B48DisplayController::submit_display_count_flush() {
+  if (!this->db_manager_) {
+    return;
+  }
+  auto step = [this](B48Job &job) {
+    if (!this->flush_display_counts()) {
+      job.fail();
+    }
+    return false;
+  };
+  this->job_runner_.submit(std::unique_ptr<B48Job>(new B48Job(DISPLAY_COUNT_FLUSH_JOB, step)));
+}
+
+bool B48DisplayController::flush_display_counts() {
+  std::map<int, uint32_t> counts;
+  {
+    std::lock_guard<std::mutex> lock(this->message_mutex_);
+    counts.swap(this->pending_display_counts_);
+  }
+  if (counts.empty()) {
+    return true;
+  }
+
+  // Messages at their limit are disabled in the same transaction; the cache refresh then drops them
+  int retired = 0;
+  if (!this->db_manager_ || !this->db_manager_->add_display_counts(counts, retired)) {
+    // Keep the counts for the next flush; displays counted meanwhile add up with them
+    ESP_LOGW(TAG, "Failed to store display counts of %zu messages, retrying later", counts.size());
+    std::lock_guard<std::mutex> lock(this->message_mutex_);
+    for (const auto &count : counts) {
+      this->pending_display_counts_[count.first] += count.second;
+    }
+    return false;
+  }
+  B48_RLOGD(TAG, "Flushed display counts of %zu messages, %d retired", counts.size(), retired);
+  if (retired > 0) {
+    this->pending_message_cache_refresh_.store(true);
+  }
+  return true;
+}
+
+// Pool label for the selection logs; a string literal, so the log ring can keep the pointer
+static const char *message_kind(const MessageEntry &msg) {
+  if (msg.is_ephemeral) {
+    return "ephemeral";
+  }
+  return msg.prebuilt_frames != nullptr ? "pack" : "persistent";
+}
+
+MessageHandle B48DisplayController::select_next_message() {
   yield();               // Yield to the OS before potentially long operation
   esp_task_wdt_reset();  // Reset watchdog timer
 
-  time_t now = time(nullptr);
-  std::shared_ptr<MessageEntry> selected_message = nullptr;
+  time_t now = this->wall_time();
+  MessageHandle selected_message;
   bool has_database = (this->db_manager_ != nullptr);
 
   // Priority threshold for emergency messages
   const int emergency_threshold = this->emergency_priority_threshold_;
 
-  // Copy necessary data under lock to minimize lock duration
-  std::vector<std::shared_ptr<MessageEntry>> ephemeral_copy;
-  std::vector<std::shared_ptr<MessageEntry>> persistent_copy;
-
-  // Take a brief lock to copy the message vectors
-  {
-    std::lock_guard<std::mutex> lock(this->message_mutex_);
-    ephemeral_copy = this->ephemeral_messages_;
-    if (has_database) {
-      persistent_copy = this->persistent_messages_;
-    }
-  }
+  // Entries are read in place from the message table, so hold the lock for the whole (CPU-only) selection.
+  // Handles are 4 bytes and trivially copyable; nothing is copied or refcounted here.
+  std::lock_guard<std::mutex> lock(this->message_mutex_);
+  rebase_display_history(now);
+  const MessageTable &table = this->message_table_;
+  const std::vector<MessageHandle> &ephemeral_handles = this->ephemeral_messages_;
+  const std::vector<MessageHandle> &persistent_handles = this->persistent_messages_;
+  const std::vector<MessageHandle> &pack_handles = this->pack_messages_;
 
   // 1. First pass: Check for emergency messages (above threshold) in ephemeral messages
-  // Now we can work with our copies without holding the lock
-  for (const auto &msg : ephemeral_copy) {
-    if (msg->expiry_time > 0 && msg->expiry_time <= now)
+  for (MessageHandle handle : ephemeral_handles) {
+    const MessageEntry *msg = table.get(handle);
+    if (!msg || (msg->expiry_time > 0 && msg->expiry_time <= now) || msg->displays_exhausted())
       continue;
 
     if (msg->priority >= emergency_threshold) {
-      selected_message = msg;
-      ESP_LOGI(TAG, "Selected emergency ephemeral message (Prio: %d)", selected_message->priority);
+      selected_message = handle;
+      B48_RLOGI(TAG, "Selected emergency ephemeral message (Prio: %d)", msg->priority);
       break;
     }
   }
 
   // 2. If no emergency message found, consider all messages based on a weighted approach
-  if (!selected_message) {
+  if (!selected_message.is_valid()) {
     // For non-emergency selection, we'll mix ephemeral and persistent messages
 
     // Temporary vector to hold candidate messages with their selection weights
-    std::vector<std::pair<std::shared_ptr<MessageEntry>, float>> candidates;
+    std::vector<std::pair<MessageHandle, float>> candidates;
+    candidates.reserve(ephemeral_handles.size() + persistent_handles.size() + pack_handles.size());
 
     // Add valid ephemeral messages to candidates
-    for (const auto &msg : ephemeral_copy) {
-      if (msg->expiry_time > 0 && msg->expiry_time <= now)
+    for (MessageHandle handle : ephemeral_handles) {
+      const MessageEntry *msg = table.get(handle);
+      if (!msg || (msg->expiry_time > 0 && msg->expiry_time <= now) || msg->displays_exhausted())
         continue;
 
       // Calculate a weight based on priority - higher priority = higher weight
       float weight = 0.6f + (msg->priority / 100.0f);
-      candidates.push_back({msg, weight});
+      candidates.push_back({handle, weight});
     }
 
     // Add persistent messages if database is available
-    if (has_database && !persistent_copy.empty()) {
-      static size_t last_persistent_index = 0;
-
+    if (has_database && !persistent_handles.empty()) {
       // Add ALL persistent messages to candidates, not just a limited number
       // This ensures we consider the entire message pool
-      for (size_t i = 0; i < persistent_copy.size(); i++) {
-        auto msg = persistent_copy[i];
+      for (MessageHandle handle : persistent_handles) {
+        const MessageEntry *msg = table.get(handle);
+        if (!msg || msg->displays_exhausted())  // At its limit, retired by the next count flush
+          continue;
+        if (shadowed_by_pack(*msg))  // Competes through its pack copy, or it would get two slots
+          continue;
 
         // Slightly improved weight calculation that better scales with priority
         // Base weight is 0.3, max priority contribution would be ~0.5 for priority 60
         float weight = 0.4f + (msg->priority / 100.0f);
 
-        candidates.push_back({msg, weight});
+        candidates.push_back({handle, weight});
+      }
+    }
+
+    // Content pack messages compete like persistent ones
+    for (MessageHandle handle : pack_handles) {
+      const MessageEntry *msg = table.get(handle);
+      if (!msg)
+        continue;
+      float weight = 0.4f + (msg->priority / 100.0f);
+      candidates.push_back({handle, weight});
+    }
+
+    // Variants of one message (e.g. Czech and English) share a single slot. Keep one candidate per group:
+    // the variant shown least recently, so variants alternate, carrying the group's best weight. The penalty
+    // below uses the group's most recent display, so the whole group shares one fairness history.
+    std::map<uint32_t, time_t> group_last_display;
+    {
+      std::map<uint32_t, size_t> group_slots;  // Group ID -> index into collapsed
+      std::vector<std::pair<MessageHandle, float>> collapsed;
+      collapsed.reserve(candidates.size());
+      for (const auto &candidate : candidates) {
+        const MessageEntry *msg = table.get(candidate.first);
+        if (msg->variant_group == 0) {
+          collapsed.push_back(candidate);
+          continue;
+        }
+        auto slot = group_slots.find(msg->variant_group);
+        if (slot == group_slots.end()) {
+          group_slots[msg->variant_group] = collapsed.size();
+          group_last_display[msg->variant_group] = msg->last_display_time;
+          collapsed.push_back(candidate);
+          continue;
+        }
+        auto &representative = collapsed[slot->second];
+        time_t &group_last = group_last_display[msg->variant_group];
+        group_last = std::max(group_last, msg->last_display_time);
+        representative.second = std::max(representative.second, candidate.second);
+        if (msg->last_display_time < table.get(representative.first)->last_display_time) {
+          representative.first = candidate.first;
+        }
+      }
+      if (collapsed.size() != candidates.size()) {
+        B48_RLOGD(TAG, "Variant groups: %zu candidates collapsed into %zu slots (%zu groups)", candidates.size(),
+                  collapsed.size(), group_slots.size());
+        candidates.swap(collapsed);
       }
     }
 
     // If we have candidates and time available, build candidates list
     if (!candidates.empty()) {
-      ESP_LOGD(TAG, "Considering %d total candidates for new message.", candidates.size());
+      B48_RLOGD(TAG, "Considering %zu total candidates for new message.", candidates.size());
       // Sort candidates by weight in descending order
       std::sort(candidates.begin(), candidates.end(),
-                [](const std::pair<std::shared_ptr<MessageEntry>, float> &a,
-                   const std::pair<std::shared_ptr<MessageEntry>, float> &b) { return a.second > b.second; });
+                [](const std::pair<MessageHandle, float> &a, const std::pair<MessageHandle, float> &b) {
+                  return a.second > b.second;
+                });
 
       // Create a vector to store penalty information for the final table
-      std::vector<std::tuple<std::shared_ptr<MessageEntry>, float, float, time_t>> penalty_info;
-      
+      std::vector<std::tuple<MessageHandle, float, float, time_t>> penalty_info;
+      penalty_info.reserve(candidates.size());
+
       // Penalize or remove candidates that have been displayed recently
-      time_t now = time(nullptr);
       const int MIN_REPEAT_SECONDS = 300;  // Minimum seconds before showing same message again
 
       for (auto &candidate : candidates) {
-        auto &msg = candidate.first;
-        time_t last_display = 0;
-        float original_weight = candidate.second;
-
-        // Get appropriate last display time based on message type
-        if (msg->is_ephemeral) {
-          last_display = msg->last_display_time;
-        } else if (msg->message_id > 0) {
-          // Check if we have last display time for this persistent message
-          auto it = last_display_times_.find(msg->message_id);
-          if (it != last_display_times_.end()) {
-            last_display = it->second;
-          }
+        const MessageEntry *msg = table.get(candidate.first);
+        // Last display time lives in the entry for every message type; refreshes keep it.
+        // Grouped variants count as displayed whenever any variant of the group was.
+        time_t last_display = msg->last_display_time;
+        if (msg->variant_group != 0) {
+          last_display = group_last_display[msg->variant_group];
         }
+        float original_weight = candidate.second;
 
         // Calculate time since last display
         time_t time_since_display = (last_display > 0) ? now - last_display : -1;
@@ -618,21 +1015,22 @@ std::shared_ptr<MessageEntry> B48DisplayController::select_next_message() {
         }
         
         // Store all the info for the table
-        penalty_info.push_back(std::make_tuple(msg, original_weight, penalty_factor, time_since_display));
+        penalty_info.push_back(std::make_tuple(candidate.first, original_weight, penalty_factor, time_since_display));
       }
 
       // Resort after applying penalties
       std::sort(candidates.begin(), candidates.end(),
-                [](const std::pair<std::shared_ptr<MessageEntry>, float> &a,
-                   const std::pair<std::shared_ptr<MessageEntry>, float> &b) { return a.second > b.second; });
+                [](const std::pair<MessageHandle, float> &a, const std::pair<MessageHandle, float> &b) {
+                  return a.second > b.second;
+                });
 
       // Sort penalty_info to match the new candidate order
       std::sort(penalty_info.begin(), penalty_info.end(), 
-                [&candidates](const std::tuple<std::shared_ptr<MessageEntry>, float, float, time_t> &a,
-                             const std::tuple<std::shared_ptr<MessageEntry>, float, float, time_t> &b) {
+                [&candidates](const std::tuple<MessageHandle, float, float, time_t> &a,
+                             const std::tuple<MessageHandle, float, float, time_t> &b) {
                     // Find weights in the sorted candidates list
                     float weight_a = 0.0f, weight_b = 0.0f;
-                    for (const std::pair<std::shared_ptr<MessageEntry>, float> &c : candidates) {
+                    for (const std::pair<MessageHandle, float> &c : candidates) {
                         if (c.first == std::get<0>(a)) weight_a = c.second;
                         if (c.first == std::get<0>(b)) weight_b = c.second;
                     }
@@ -640,14 +1038,15 @@ std::shared_ptr<MessageEntry> B48DisplayController::select_next_message() {
                 });
 
       // Log the consolidated table
-      ESP_LOGD(TAG, "Message selection table (%d candidates):", candidates.size());
-      ESP_LOGD(TAG, "  # | ID  | Type       | Prio | Initial | Weight  | Final  | Last Seen");
-      ESP_LOGD(TAG, "----|-----|------------|------|---------|---------|--------|----------");
+      B48_RLOGD(TAG, "Message selection table (%zu candidates):", candidates.size());
+      B48_RLOGD(TAG, "  # | ID  | Type       | Prio | Initial | Weight  | Final  | Seen (s ago, -1 = never)");
+      B48_RLOGD(TAG, "----|-----|------------|------|---------|---------|--------|-------------------------");
       
       const int candidates_to_log = std::min(20, static_cast<int>(penalty_info.size()));
       for (int i = 0; i < candidates_to_log; i++) {
         const auto &info = penalty_info[i];
-        auto msg = std::get<0>(info);
+        MessageHandle handle = std::get<0>(info);
+        const MessageEntry *msg = table.get(handle);
         float original_weight = std::get<1>(info);
         float penalty_factor = std::get<2>(info);
         time_t time_since_display = std::get<3>(info);
@@ -655,92 +1054,156 @@ std::shared_ptr<MessageEntry> B48DisplayController::select_next_message() {
         // Find the final weight in candidates
         float final_weight = 0.0f;
         for (const auto &c : candidates) {
-            if (c.first == msg) {
+            if (c.first == handle) {
                 final_weight = c.second;
                 break;
             }
         }
         
         const char* selected_marker = (i == 0) ? "→ " : "  ";
-        
-        // Format the time since display
-        std::string time_display;
-        if (time_since_display < 0) {
-            time_display = "never";
-        } else {
-            char time_buffer[16];
-            snprintf(time_buffer, sizeof(time_buffer), "%ds ago", (int)time_since_display);
-            time_display = time_buffer;
-        }
-        
-        ESP_LOGD(TAG, "%s%2d | %-3d | %-10s | %4d | %7.3f | %7.3f | %6.3f | %s",
-                 selected_marker, i+1, msg->message_id, 
-                 msg->is_ephemeral ? "ephemeral" : "persistent",
-                 msg->priority, original_weight, penalty_factor, final_weight,
-                 time_display.c_str());
+
+        B48_RLOGD(TAG, "%s%2d | %-3d | %-10s | %4d | %7.3f | %7.3f | %6.3f | %ld", selected_marker, i + 1,
+                  msg->message_id, message_kind(*msg), msg->priority, original_weight, penalty_factor, final_weight,
+                  (long) time_since_display);
       }
 
       // Select the highest weighted candidate
       selected_message = candidates[0].first;
       float selected_weight = candidates[0].second;
+      const MessageEntry *selected = table.get(selected_message);
 
-      // Update the round-robin index for persistent messages
-      if (!selected_message->is_ephemeral && has_database) {
-        static size_t last_persistent_index = 0;
-        // Find the index of this message in persistent_copy
-        for (size_t i = 0; i < persistent_copy.size(); i++) {
-          if (persistent_copy[i]->message_id == selected_message->message_id) {
-            last_persistent_index = (i + 1) % persistent_copy.size();
-            break;
-          }
-        }
-      }
-
-      ESP_LOGI(TAG, "Selected %s message ID: %d (Prio: %d, Weight: %.2f) - Title: %s",
-               selected_message->is_ephemeral ? "ephemeral" : "persistent", selected_message->message_id,
-               selected_message->priority, selected_weight, selected_message->static_intro.c_str());
+      B48_RLOGI(TAG, "Selected %s message ID: %d (Prio: %d, Weight: %.2f) - Title: %s",
+                message_kind(*selected), selected->message_id, selected->priority, selected_weight,
+                selected->static_intro.c_str());
     }
 
     // Fall back to a simple selection if we have no candidates with positive weights
-    else if (has_database && !persistent_copy.empty()) {
+    else if (has_database && !persistent_handles.empty()) {
       static size_t last_persistent_index = 0;
 
       ESP_LOGW(TAG, "Weighted selection algorithm found no suitable candidates, falling back to round-robin");
 
       // Only use the fallback if there are actually persistent messages available
-      size_t current_index = last_persistent_index % persistent_copy.size();
-      selected_message = persistent_copy[current_index];
-      last_persistent_index = (last_persistent_index + 1) % persistent_copy.size();
+      size_t current_index = last_persistent_index % persistent_handles.size();
+      selected_message = persistent_handles[current_index];
+      last_persistent_index = (last_persistent_index + 1) % persistent_handles.size();
 
-      ESP_LOGD(TAG, "Selected fallback persistent message ID: %d (Prio: %d)", selected_message->message_id,
-               selected_message->priority);
+      B48_RLOGD(TAG, "Selected fallback persistent message at cache index %zu", current_index);
     }
   }
 
-  // 3. If still no message, return nullptr (will trigger fallback)
-  if (!selected_message) {
+  // 3. If still no message, return an invalid handle (will trigger fallback)
+  const MessageEntry *selected = table.get(selected_message);
+  if (!selected) {
     ESP_LOGW(TAG, "No suitable message found for display.");
-  } else {
-    this->current_display_duration_ms_ = calculate_display_duration(selected_message) * 1000;
+    return MessageHandle();
   }
+  if (this->shadow_scheduler_.enabled()) {
+    this->evaluate_shadow_policies(selected_message, now);
+  }
+  this->current_display_duration_ms_ = calculate_display_duration(*selected) * 1000;
   return selected_message;
 }
 
+// Variant groups share one key, like they share one slot in select_next_message
+static uint64_t shadow_key(MessageHandle handle, const MessageEntry &msg) {
+  if (msg.variant_group != 0) {
+    return (1ULL << 32) | msg.variant_group;
+  }
+  return (static_cast<uint64_t>(handle.index) << 16) | handle.generation;
+}
+
+void B48DisplayController::evaluate_shadow_policies(MessageHandle live_pick, time_t now) {
+  // Same eligibility as the live selection: not expired, not at the display limit
+  const MessageTable &table = this->message_table_;
+  std::vector<ShadowCandidate> &candidates = this->shadow_candidates_;
+  candidates.clear();
+  std::map<uint64_t, size_t> group_slots;
+  const std::vector<MessageHandle> *pools[] = {&this->ephemeral_messages_, &this->persistent_messages_,
+                                               &this->pack_messages_};
+  for (const auto *pool : pools) {
+    for (MessageHandle handle : *pool) {
+      const MessageEntry *msg = table.get(handle);
+      if (!msg || msg->displays_exhausted() || (msg->expiry_time > 0 && msg->expiry_time <= now) ||
+          shadowed_by_pack(*msg)) {
+        continue;
+      }
+      ShadowCandidate candidate{shadow_key(handle, *msg), msg->priority, -1, 0};
+      if (msg->variant_group != 0) {
+        auto slot = group_slots.find(candidate.key);
+        if (slot != group_slots.end()) {
+          candidates[slot->second].priority = std::max(candidates[slot->second].priority, msg->priority);
+          continue;
+        }
+        group_slots[candidate.key] = candidates.size();
+      }
+      candidates.push_back(candidate);
+    }
+  }
+
+  const MessageEntry *live = table.get(live_pick);
+  this->shadow_scheduler_.evaluate(candidates, shadow_key(live_pick, *live));
+  B48_RLOGV(TAG, "Shadow policies evaluated %zu candidates in %u us", candidates.size(),
+            (unsigned) this->shadow_scheduler_.evaluation_us());
+}
+
+std::vector<B48ShadowScheduler::PolicyReport> B48DisplayController::report_scheduling(bool reset) {
+  std::lock_guard<std::mutex> lock(this->message_mutex_);
+  if (!this->shadow_scheduler_.enabled()) {
+    ESP_LOGW(TAG, "No shadow scheduling policies configured (shadow_policies)");
+  }
+  this->shadow_scheduler_.log_report();
+  std::vector<B48ShadowScheduler::PolicyReport> reports = this->shadow_scheduler_.report();
+  if (reset) {
+    this->shadow_scheduler_.reset();
+  }
+  return reports;
+}
+
+void B48DisplayController::account_airtime() {
+  AirtimeState state;
+  if (this->state_machine_paused_.load()) {
+    state = AIRTIME_PAUSED;
+  } else if (this->time_test_mode_active_ || this->state_ == TIME_TEST_MODE ||
+             this->state_ == CHARACTER_REVERSE_TEST_MODE) {
+    state = AIRTIME_TEST;
+  } else if (this->state_ == TRANSITION_MODE) {
+    state = AIRTIME_TRANSITION;
+  } else {
+    state = this->showing_fallback_ ? AIRTIME_FALLBACK : AIRTIME_CONTENT;
+  }
+  this->airtime_ledger_.enter(state, millis());
+}
+
+AirtimeSummary B48DisplayController::report_airtime(bool reset) {
+  uint32_t now_ms = millis();
+  this->airtime_ledger_.log_report(now_ms);
+  this->transition_tuner_.log_report();
+  AirtimeSummary summary = summarize_airtime(this->airtime_ledger_, this->transition_tuner_, now_ms);
+  ESP_LOGI(TAG, "Content:transition %.2f measured, %.2f if every transition took the fixed %d s", summary.content_ratio,
+           summary.fixed_ratio, this->transition_duration_);
+  if (reset) {
+    this->airtime_ledger_.reset(now_ms);
+    this->transition_tuner_.reset_statistics();
+  }
+  return summary;
+}
+
 // --- Other methods (calculate_display_duration, update_message_display_stats, etc.) ---
 // Updated to handle ephemeral messages using TTL-based expiration only
 
-int B48DisplayController::calculate_display_duration(const std::shared_ptr<MessageEntry> &msg) {
+int B48DisplayController::calculate_display_duration(const MessageEntry &msg) {
   // Could be based on message length, priority, etc.
-  if (!msg)
-    return 4;  // Default duration if msg is null
 
   int base_duration = 5;     // Base seconds
   int chars_per_second = 3;  // Estimated scroll speed
   int length_duration = base_duration;
-  if (msg->is_ephemeral) {
-    length_duration = msg->expiry_time - time(nullptr);
+  if (msg.is_ephemeral) {
+    length_duration = msg.expiry_time - this->wall_time();
+  } else if (msg.prebuilt_frames) {
+    length_duration = (base_duration + msg.prebuilt_scroll_length) / chars_per_second;
   } else {
-    length_duration = (base_duration + msg->scrolling_message.length()) / chars_per_second;
+    length_duration = (base_duration + msg.scrolling_message.length()) / chars_per_second;
   }
 
   // Use a simple heuristic: longer messages display for longer, up to a max
@@ -748,23 +1211,43 @@ int B48DisplayController::calculate_display_duration(const std::shared_ptr<Messa
   ESP_LOGD(
       TAG,
       "Calculated display duration for message ID %d: base_duration=%d, length_duration=%d, calculated_duration=%d",
-      msg->message_id, base_duration, length_duration, calculated_duration);
+      msg.message_id, base_duration, length_duration, calculated_duration);
   return calculated_duration;
 }
 
-void B48DisplayController::update_message_display_stats(const std::shared_ptr<MessageEntry> &msg) {
-  if (!msg)
+void B48DisplayController::count_current_display() {
+  if (!this->current_message_shown_) {
     return;
+  }
+  this->current_message_shown_ = false;
+  update_message_display_stats(this->current_message_);
+}
 
-  time_t now = time(nullptr);
+void B48DisplayController::update_message_display_stats(MessageHandle handle) {
+  std::lock_guard<std::mutex> lock(this->message_mutex_);
+  MessageEntry *msg = this->message_table_.get(handle);
+  if (!msg) {
+    // Stale handle: the message left the cache while it was on screen
+    return;
+  }
 
-  if (msg->is_ephemeral) {
-    std::lock_guard<std::mutex> lock(this->message_mutex_);
-    msg->last_display_time = now;
-  } else {
-    // Update last display time for persistent messages (used for repeat delay)
-    last_display_times_[msg->message_id] = now;
-    ESP_LOGV(TAG, "Updated last display time for persistent message ID %d", msg->message_id);
+  // Used for the repeat-delay penalty of every message type
+  msg->last_display_time = this->wall_time();
+  ESP_LOGV(TAG, "Updated last display time for message ID %d", msg->message_id);
+
+  // Count-limited messages count in RAM; the database gets the counts in batches
+  if (msg->max_displays <= 0) {
+    return;
+  }
+  msg->display_count++;
+  if (!msg->is_ephemeral) {
+    this->pending_display_counts_[msg->message_id]++;
+  }
+  if (msg->displays_exhausted()) {
+    B48_RLOGI(TAG, "Message ID %d reached its limit of %d displays", msg->message_id, msg->max_displays);
+    if (!msg->is_ephemeral) {
+      this->submit_display_count_flush();  // Retire it now rather than at the end of the interval
+    }
   }
 }
 
@@ -811,20 +1294,23 @@ void B48DisplayController::send_invert_command() { this->serial_protocol_.send_i
 
 void B48DisplayController::switch_to_cycle(int cycle) { this->serial_protocol_.switch_to_cycle(cycle); }
 
-void B48DisplayController::send_commands_for_message(const std::shared_ptr<MessageEntry> &msg) {
-  if (!msg) {
-    ESP_LOGW(TAG, "send_commands_for_message called with null message");
+void B48DisplayController::send_commands_for_message(const MessageEntry &msg) {
+  if (msg.prebuilt_frames) {
+    // Content pack entry: frames are already encoded, send them straight from mapped flash
+    B48_RLOGD(TAG, "Sending prebuilt frames for content pack message (Prio: %d, ID: %d, %zu bytes)", msg.priority,
+              msg.message_id, msg.prebuilt_frames_length);
+    this->serial_protocol_.send_wire_frames(msg.prebuilt_frames, msg.prebuilt_frames_length);
     return;
   }
-  ESP_LOGD(TAG, "Sending commands for message (Prio: %d, ID: %d, Ephem: %d): %s%s (len=%zu)", msg->priority,
-           msg->message_id, msg->is_ephemeral, msg->scrolling_message.substr(0, 30).c_str(),
-           msg->scrolling_message.length() > 30 ? "..." : "", msg->scrolling_message.length());
+  B48_RLOGD(TAG, "Sending commands for message (Prio: %d, ID: %d, Ephem: %d): %.30s%s (len=%zu)", msg.priority,
+            msg.message_id, msg.is_ephemeral, msg.scrolling_message.c_str(),
+            msg.scrolling_message.length() > 30 ? "..." : "", msg.scrolling_message.length());
 
-  send_line_number(msg->line_number);
-  send_tarif_zone(msg->tarif_zone);
-  send_static_intro(msg->static_intro);
-  send_scrolling_message(msg->scrolling_message);
-  send_next_message_hint(msg->next_message_hint);
+  send_line_number(msg.line_number);
+  send_tarif_zone(msg.tarif_zone);
+  send_static_intro(msg.static_intro);
+  send_scrolling_message(msg.scrolling_message);
+  send_next_message_hint(msg.next_message_hint);
 }
 
 // --- State Machine Methods ---
@@ -833,7 +1319,7 @@ void B48DisplayController::run_transition_mode() {
   // The transition mode is used to prepare the next message.
   // First set cycle 6, showing "next message" hint of CURRENT message.
   unsigned long time_in_state = millis() - this->state_change_time_;
-  unsigned long transition_duration_ms = this->transition_duration_ * 1000;
+  unsigned long transition_duration_ms = this->transition_tuner_.planned_ms();
 
   // Determine if setup logic needs to run (first cycle in this state or an interrupt)
   bool needs_setup_logic = this->first_cycle_in_state_ || this->should_interrupt_;
@@ -847,20 +1333,35 @@ void B48DisplayController::run_transition_mode() {
       this->should_interrupt_ = false;    // Consume the interrupt flag
     }
 
-    ESP_LOGD(TAG, "Current message before select_next_message(): %s",
-             this->current_message_ ? std::to_string(this->current_message_->message_id).c_str() : "none");
+    uint32_t bytes_before = this->serial_protocol_.bytes_written();
     this->serial_protocol_.switch_to_cycle(6);
+    uint32_t select_start_us = micros();
     this->current_message_ = select_next_message();
+    this->current_message_shown_ = false;
+    this->last_selection_us_ = micros() - select_start_us;
+    ESP_LOGD(TAG, "Message selection took %u us (table: %zu live / %zu slots)", (unsigned) this->last_selection_us_,
+             this->message_table_.size(), this->message_table_.slot_count());
 
-    if (this->current_message_) {
-      send_commands_for_message(this->current_message_);
-      ESP_LOGD(TAG, "Message prepared (ID: %d), waiting in cycle 6 for %lu ms",
-               this->current_message_->message_id, transition_duration_ms);
-    } else {
+    bool sent = false;
+    {
+      std::lock_guard<std::mutex> lock(this->message_mutex_);
+      const MessageEntry *msg = this->message_table_.get(this->current_message_);
+      if (msg) {
+        send_commands_for_message(*msg);
+        ESP_LOGD(TAG, "Message prepared (ID: %d), waiting in cycle 6 for %lu ms", msg->message_id,
+                 transition_duration_ms);
+        sent = true;
+      }
+    }
+    if (!sent) {
       display_fallback_message();
       ESP_LOGD(TAG, "No message selected, displaying fallback, waiting in cycle 6 for %lu ms",
                transition_duration_ms);
     }
+    this->showing_fallback_ = !sent;
+    this->transition_wire_bytes_ = this->serial_protocol_.bytes_written() - bytes_before;
+    this->transition_drained_ms_ =
+        (millis() - this->state_change_time_) + (this->serial_protocol_.wire_pending_us() + 999) / 1000;
 
     // Clear the flag after the setup logic has run for this state entry
     if (this->first_cycle_in_state_) {
@@ -868,16 +1369,19 @@ void B48DisplayController::run_transition_mode() {
     }
   }
 
-  // Check if transition duration has elapsed
-  if (time_in_state < transition_duration_ms) {
-    // Not enough time has passed, stay in transition mode
-    return;
+  // Check if transition duration has elapsed (and, with bounds, the frames are out); interrupts go at once
+  if (transition_duration_ms > 0) {
+    if (!this->transition_tuner_.may_end(time_in_state, this->transition_drained_ms_)) {
+      return;
+    }
+    this->transition_tuner_.record(time_in_state, this->transition_drained_ms_, this->transition_wire_bytes_);
   }
 
   // Transition duration has elapsed, switch to cycle 0 and move to display mode
   ESP_LOGD(TAG, "Transition duration (%lu ms) elapsed (actual time in state: %lu ms). Switching to display.",
            transition_duration_ms, time_in_state);
   this->serial_protocol_.switch_to_cycle(0);
+  this->current_message_shown_ = !this->showing_fallback_;
 
   this->state_ = DISPLAY_MESSAGE;
   this->state_change_time_ = millis();
@@ -891,8 +1395,8 @@ void B48DisplayController::run_display_message() {
   // Check if we've reached the end of the display duration
   if (time_in_state >= this->current_display_duration_ms_ || this->should_interrupt_) {
     ESP_LOGV(TAG, "Display state ending, updating stats and moving to TRANSITION_MODE");
-    update_message_display_stats(this->current_message_);  // Update stats before transitioning
-    this->current_message_ = nullptr;                      // Clear current message
+    count_current_display();                   // Update stats before transitioning
+    this->current_message_ = MessageHandle();  // Clear current message
     this->state_ = TRANSITION_MODE;
     this->state_change_time_ = millis();
     this->first_cycle_in_state_ = true;
@@ -901,15 +1405,15 @@ void B48DisplayController::run_display_message() {
 
 void B48DisplayController::display_fallback_message() {
   // Define a simple fallback message
-  auto fallback_msg = std::make_shared<MessageEntry>();
-  fallback_msg->is_ephemeral = true;  // Treat fallback as ephemeral
-  fallback_msg->message_id = -1;
-  fallback_msg->line_number = 48;
-  fallback_msg->tarif_zone = 101;
-  fallback_msg->static_intro = "Base48";
-  fallback_msg->scrolling_message = "This is fallback message. Something is wrong.";  // Placeholder/Idle message
-  fallback_msg->next_message_hint = "0xDEADBEEF__";
-  fallback_msg->priority = 0;  // Low priority
+  MessageEntry fallback_msg;
+  fallback_msg.is_ephemeral = true;  // Treat fallback as ephemeral
+  fallback_msg.message_id = -1;
+  fallback_msg.line_number = 48;
+  fallback_msg.tarif_zone = 101;
+  fallback_msg.static_intro = "Base48";
+  fallback_msg.scrolling_message = "This is fallback message. Something is wrong.";  // Placeholder/Idle message
+  fallback_msg.next_message_hint = "0xDEADBEEF__";
+  fallback_msg.priority = 0;  // Low priority
 
   ESP_LOGD(TAG, "Displaying fallback message.");
   send_commands_for_message(fallback_msg);
@@ -917,36 +1421,35 @@ void B48DisplayController::display_fallback_message() {
 }
 
 void B48DisplayController::check_for_emergency_messages() {
-  // Check we have sensible time to check
-  if (time(nullptr) - this->last_ephemeral_check_time_ < 1000) {
+  // Check we have sensible time to check (a clock stepped backwards must not suppress checks until it catches up)
+  time_t now = this->wall_time();
+  time_t last_check = static_cast<time_t>(this->last_ephemeral_check_time_);
+  if (now >= last_check && now - last_check < 1000) {
     return;
   }
-  this->last_ephemeral_check_time_ = time(nullptr);
+  this->last_ephemeral_check_time_ = now;
   // Variables for decision making - populated under different locks
-  std::shared_ptr<MessageEntry> highest_priority_message = nullptr;
   bool has_messages = false;
   unsigned long time_in_state = 0;
 
-  // First, safely check if we have any messages and grab the highest priority one
+  // Safely check if we have any messages and look at the highest priority one
   {
     std::lock_guard<std::mutex> lock(this->message_mutex_);
 
     if (this->ephemeral_messages_.empty()) {
       return;  // No messages to process
     }
-    // Copy the highest priority message to use outside the lock
-    highest_priority_message = this->ephemeral_messages_[0];
-  }
-  // Check if the message is expired based on expiry_time
-  if (highest_priority_message->expiry_time > 0 && highest_priority_message->expiry_time <= time(nullptr)) {
-    ESP_LOGD(TAG, "Highest priority message is expired, removing it from the queue");
-    std::lock_guard<std::mutex> lock(this->message_mutex_);
-    {
+    MessageHandle highest_priority_message = this->ephemeral_messages_[0];
+    const MessageEntry *msg = this->message_table_.get(highest_priority_message);
+    // Check if the message is expired based on expiry_time
+    if (!msg || (msg->expiry_time > 0 && msg->expiry_time <= this->wall_time())) {
+      ESP_LOGD(TAG, "Highest priority message is expired, removing it from the queue");
+      this->message_table_.remove(highest_priority_message);
       this->ephemeral_messages_.erase(this->ephemeral_messages_.begin());
+    } else {
+      has_messages = true;
     }
-    highest_priority_message = nullptr;
   }
-  has_messages = highest_priority_message != nullptr;
   if (!has_messages) {
     return;
   }
@@ -956,8 +1459,8 @@ void B48DisplayController::check_for_emergency_messages() {
 
   // Process the interruption if needed
   if (this->should_interrupt_) {
-    update_message_display_stats(this->current_message_);  // Update stats before transitioning
-    this->state_ = TRANSITION_MODE;                        // Force transition to pick up new message
+    count_current_display();         // A message still waiting in cycle 6 was never shown
+    this->state_ = TRANSITION_MODE;  // Force transition to pick up new message
     this->state_change_time_ = millis();
     this->first_cycle_in_state_ = true;
   }
@@ -977,7 +1480,9 @@ void B48DisplayController::dump_database_for_diagnostics() {
     std::lock_guard<std::mutex> lock(this->message_mutex_);
     ESP_LOGI(TAG, "Current message cache state: %d persistent messages in cache", this->persistent_messages_.size());
     for (size_t i = 0; i < this->persistent_messages_.size(); i++) {
-      const auto &msg = this->persistent_messages_[i];
+      const MessageEntry *msg = this->message_table_.get(this->persistent_messages_[i]);
+      if (!msg)
+        continue;
       ESP_LOGI(TAG, "Cache[%d]: ID=%d, Priority=%d, Line=%d, Zone=%d, Text='%s%s' (len=%zu)", i, msg->message_id,
                msg->priority, msg->line_number, msg->tarif_zone, msg->scrolling_message.substr(0, 30).c_str(),
                msg->scrolling_message.length() > 30 ? "..." : "", msg->scrolling_message.length());
@@ -1123,6 +1628,8 @@ bool B48DisplayController::initialize_database() {
 
   // Create the database manager
   db_manager_.reset(new B48DatabaseManager(this->database_path_));
+  db_manager_->set_defer_bootstrap(true);  // setup() queues it as a job
+  db_manager_->set_time_source(this->time_source_);
 
   // Try to initialize the database with retries
   for (int retry = 0; retry < 3; retry++) {
@@ -1196,27 +1703,147 @@ bool B48DisplayController::handle_database_wipe() {
 }
 
 void B48DisplayController::display_startup_message(bool db_initialized) {
-  auto loading_msg = std::make_shared<MessageEntry>();
-  loading_msg->message_id = -1;
-  loading_msg->line_number = 48;
-  loading_msg->tarif_zone = 101;
-  loading_msg->static_intro = "Loading";
-  loading_msg->is_ephemeral = true;
+  MessageEntry loading_msg;
+  loading_msg.message_id = -1;
+  loading_msg.line_number = 48;
+  loading_msg.tarif_zone = 101;
+  loading_msg.static_intro = "Loading";
+  loading_msg.is_ephemeral = true;
 
   if (db_initialized) {
-    loading_msg->scrolling_message = "System ready with database.";
-    loading_msg->next_message_hint = "DB Ready";
+    loading_msg.scrolling_message = "System ready with database.";
+    loading_msg.next_message_hint = "DB Ready";
     ESP_LOGI(TAG, "Running with database support");
   } else {
-    loading_msg->scrolling_message = "System running in no-database mode.";
-    loading_msg->next_message_hint = "No DB";
+    loading_msg.scrolling_message = "System running in no-database mode.";
+    loading_msg.next_message_hint = "No DB";
     ESP_LOGW(TAG, "Running in no-database mode");
   }
 
-  loading_msg->priority = 75;
+  loading_msg.priority = 75;
   send_commands_for_message(loading_msg);
 }
 
+// --- Content Pack ---
+
+bool B48DisplayController::load_content_pack() {
+  if (this->content_pack_partition_.empty()) {
+    ESP_LOGW(TAG, "No content pack partition configured");
+    return false;
+  }
+
+  uint32_t start_us = micros();
+  int32_t heap_before = ESP.getFreeHeap();
+
+  // Nothing may reference the old mapping once open() has dropped it
+  release_pack_messages();
+  bool loaded = this->content_pack_.open(this->content_pack_partition_);
+  auto entries = this->content_pack_.entries();
+  {
+    std::lock_guard<std::mutex> lock(this->message_mutex_);
+    this->pack_source_ids_ = this->content_pack_.source_message_ids();
+    this->pack_messages_.reserve(entries.size());
+    for (const auto &entry : entries) {
+      MessageHandle handle = this->message_table_.insert(entry);
+      if (handle.is_valid()) {
+        this->pack_messages_.push_back(handle);
+      }
+    }
+  }
+
+  this->pack_load_us_ = micros() - start_us;
+  this->pack_load_heap_bytes_ = heap_before - (int32_t) ESP.getFreeHeap();
+  ESP_LOGI(TAG, "Content pack load took %u us, heap delta %d bytes for %d messages (SQLite cache: %u us, %d bytes)",
+           (unsigned) this->pack_load_us_, (int) this->pack_load_heap_bytes_, this->content_pack_.record_count(),
+           (unsigned) this->cache_load_us_, (int) this->cache_load_heap_bytes_);
+
+  update_ha_queue_size();
+  return loaded;
+}
+
+bool B48DisplayController::export_content_pack() {
+  if (this->content_pack_partition_.empty()) {
+    ESP_LOGE(TAG, "Cannot export content pack - no partition configured");
+    return false;
+  }
+
+  std::vector<MessageEntry> source;
+  {
+    std::lock_guard<std::mutex> lock(this->message_mutex_);
+    source.reserve(this->persistent_messages_.size());
+    for (MessageHandle handle : this->persistent_messages_) {
+      const MessageEntry *entry = this->message_table_.get(handle);
+      // A pack copy could never be retired, so count-limited messages stay in SQLite only
+      if (entry && entry->max_displays == 0) {
+        source.push_back(*entry);
+      }
+    }
+  }
+  if (source.empty()) {
+    ESP_LOGW(TAG, "Persistent cache is empty, exporting an empty content pack");
+  }
+
+  std::vector<uint8_t> image = B48ContentPack::build(source, this->content_pack_.generation() + 1);
+  ESP_LOGI(TAG, "Exporting %zu messages into a %zu byte content pack", source.size(), image.size());
+
+  bool ok = this->content_pack_.write_image(this->content_pack_partition_, image);
+  if (!ok) {
+    ESP_LOGE(TAG, "Failed to write content pack");
+  }
+  load_content_pack();
+  return ok;
+}
+
+// --- Deferred-format log ring ---
+
+size_t B48DisplayController::dump_log_ring(bool clear) {
+  if (!this->log_ring_) {
+    ESP_LOGW(TAG, "Log ring is disabled (log_ring_size: 0), hot paths log directly");
+    return 0;
+  }
+
+  uint32_t start_us = micros();
+  size_t dumped = this->log_ring_->dump([](const LogRecordHeader &rec, const std::string &text) {
+    // Logged at INFO regardless of the record level, so the dump is shipped with the default logger level
+    ESP_LOGI(TAG, "[%c][%s] %u.%03u: %s", rec.level, rec.tag, (unsigned) (rec.timestamp_ms / 1000),
+             (unsigned) (rec.timestamp_ms % 1000), text.c_str());
+    yield();
+  });
+  ESP_LOGI(TAG, "Log ring: dumped %zu records in %u us (%u recorded, %u overwritten, %zu/%zu bytes used)", dumped,
+           (unsigned) (micros() - start_us), (unsigned) this->log_ring_->recorded_count(),
+           (unsigned) this->log_ring_->overwritten_count(), this->log_ring_->used_bytes(),
+           this->log_ring_->capacity_bytes());
+
+  if (clear) {
+    this->log_ring_->clear();
+  }
+  return dumped;
+}
+
+bool B48DisplayController::begin_content_pack_upload(int total_size) {
+  if (this->content_pack_partition_.empty() || total_size <= 0) {
+    ESP_LOGE(TAG, "Cannot start content pack upload (partition configured: %s, size %d)",
+             YESNO(!this->content_pack_partition_.empty()), total_size);
+    return false;
+  }
+  // The upload goes into the inactive slot; the live pack stays in rotation until it is committed
+  return this->content_pack_.begin_update(this->content_pack_partition_, total_size);
+}
+
+bool B48DisplayController::write_content_pack_chunk(int offset, const std::string &data_base64) {
+  if (offset < 0) {
+    return false;
+  }
+  std::vector<uint8_t> data = base64_decode(data_base64);
+  return this->content_pack_.write_chunk(offset, data.data(), data.size());
+}
+
+bool B48DisplayController::finish_content_pack_upload() {
+  bool ok = this->content_pack_.finish_update();
+  load_content_pack();
+  return ok;
+}
+
 // --- Database maintenance methods ---
 
 bool B48DisplayController::purge_disabled_messages() {
@@ -1227,25 +1854,137 @@ bool B48DisplayController::purge_disabled_messages() {
     return false;
   }
 
-  int purged_count = this->db_manager_->purge_disabled_messages();
+  // Count, delete in chunks, then reclaim the freed pages a few at a time
+  enum Phase { COUNT, DELETE, VACUUM };
+  struct Purge {
+    Phase phase{COUNT};
+    int total{0};
+    int purged{0};
+  };
+  std::shared_ptr<Purge> purge = std::make_shared<Purge>();
 
-  if (purged_count < 0) {
-    ESP_LOGE(TAG, "Error occurred during disabled message purge");
+  auto step = [this, purge](B48Job &job) {
+    if (!this->db_manager_) {
+      job.fail();
+      return false;
+    }
+    switch (purge->phase) {
+      case COUNT:
+        purge->total = this->db_manager_->count_disabled_messages();
+        if (purge->total < 0) {
+          job.fail();
+          return false;
+        }
+        ESP_LOGI(TAG, "Found %d disabled messages to purge", purge->total);
+        job.set_progress(0, purge->total);
+        purge->phase = DELETE;
+        return purge->total > 0;
+      case DELETE: {
+        int rows = this->db_manager_->purge_disabled_messages_step(B48DatabaseManager::PURGE_CHUNK_ROWS);
+        if (rows < 0) {
+          job.fail();
+          return false;
+        }
+        purge->purged += rows;
+        job.set_progress(purge->purged, purge->total);
+        if (rows == 0) {
+          purge->phase = VACUUM;
+        }
+        return true;
+      }
+      case VACUUM: {
+        int free_pages = this->db_manager_->vacuum_step(B48DatabaseManager::VACUUM_CHUNK_PAGES);
+        if (free_pages < 0) {
+          ESP_LOGW(TAG, "Vacuum failed, freed pages stay in the database file");  // Not critical
+        }
+        return free_pages > 0;
+      }
+    }
+    return false;
+  };
+
+  auto finish = [this, purge](B48Job &job) {
+    if (job.failed()) {
+      ESP_LOGE(TAG, "Error occurred during disabled message purge");
+      return;
+    }
+    ESP_LOGI(TAG, "Successfully purged %d disabled messages", purge->purged);
+    // Log filesystem stats after purge
+    if (purge->purged > 0) {
+      ESP_LOGI(TAG, "Filesystem stats after purge:");
+      log_filesystem_stats();
+    }
+  };
+
+  if (!this->job_runner_.submit(std::unique_ptr<B48Job>(new B48Job(PURGE_JOB, step, finish)))) {
+    ESP_LOGW(TAG, "A purge is already queued, not starting another");
     return false;
   }
 
-  ESP_LOGI(TAG, "Successfully purged %d disabled messages", purged_count);
+  // Update the last purge time when the purge starts, so the interval check does not queue it again
+  this->last_purge_time_ = this->wall_time();
+  return true;
+}
+
+void B48DisplayController::advance_schema_migrations() {
+  if (!this->db_manager_ || !this->db_manager_->has_pending_backfill() ||
+      this->job_runner_.is_queued("schema_backfill")) {
+    return;
+  }
+
+  auto step = [this](B48Job &job) {
+    if (!this->db_manager_) {
+      job.fail();
+      return false;
+    }
+    int rows = this->db_manager_->advance_migrations(MIGRATION_CHUNK_ROWS);
+    if (rows < 0) {
+      job.fail();
+      return false;
+    }
+    job.set_progress(job.progress_done() + rows, 0);
+    return this->db_manager_->has_pending_backfill();
+  };
+  auto finish = [this](B48Job &job) {
+    if (job.failed()) {
+      ESP_LOGW(TAG, "Schema backfill step failed, will retry later");
+    } else if (this->db_manager_ && !this->db_manager_->has_pending_backfill()) {
+      ESP_LOGI(TAG, "All schema backfills complete");
+    }
+  };
+  this->job_runner_.submit(std::unique_ptr<B48Job>(new B48Job("schema_backfill", step, finish)));
+}
 
-  // Log filesystem stats after purge
-  if (purged_count > 0) {
-    ESP_LOGI(TAG, "Filesystem stats after purge:");
-    log_filesystem_stats();
+bool B48DisplayController::search_messages(const std::string &query, int limit, std::vector<SearchHit> &hits,
+                                           uint32_t &elapsed_us, bool &used_index) {
+  hits.clear();
+  elapsed_us = 0;
+  used_index = false;
+  if (!this->db_manager_) {
+    ESP_LOGE(TAG, "Database manager not available, cannot search messages");
+    return false;
   }
 
-  // Update the last purge time regardless of whether messages were found
-  this->last_purge_time_ = time(nullptr);
+  if (limit < 1 || limit > SEARCH_MAX_RESULTS) {
+    limit = SEARCH_MAX_RESULTS;  // Also the default when HA leaves the field at 0
+  }
+  uint32_t start_us = micros();
+  bool ok = this->db_manager_->search_messages(query, limit, hits, &used_index);
+  elapsed_us = micros() - start_us;
 
-  return true;
+  int index_bytes = this->db_manager_->search_index_bytes();
+  int database_bytes = this->db_manager_->database_bytes();
+  size_t partition_bytes = LittleFS.totalBytes();
+  ESP_LOGI(TAG, "Search '%s': %zu hits in %u us (%s)", query.c_str(), hits.size(), (unsigned) elapsed_us,
+           used_index ? "fts5 index" : "LIKE scan");
+  if (index_bytes >= 0 && database_bytes > 0 && partition_bytes > 0) {
+    ESP_LOGI(TAG, "Search index: ~%d bytes, %.1f%% of the %d byte database, %.1f%% of the partition", index_bytes,
+             100.0f * index_bytes / database_bytes, database_bytes, 100.0f * index_bytes / partition_bytes);
+  }
+  for (const auto &hit : hits) {
+    ESP_LOGI(TAG, "  #%d: %s", hit.message_id, hit.snippet.c_str());
+  }
+  return ok;
 }
 
 void B48DisplayController::check_purge_interval() {
@@ -1255,10 +1994,10 @@ void B48DisplayController::check_purge_interval() {
   }
 
   // Get current time
-  time_t now = time(nullptr);
+  time_t now = this->wall_time();
 
-  // Check if this is the first run (last_purge_time_ is 0)
-  if (this->last_purge_time_ == 0) {
+  // Check if this is the first run (last_purge_time_ is 0), or the clock was stepped back past the last purge
+  if (this->last_purge_time_ == 0 || now < this->last_purge_time_) {
     this->last_purge_time_ = now;
     ESP_LOGD(TAG, "Initialized last purge time to current time");
     return;
@@ -1267,8 +2006,8 @@ void B48DisplayController::check_purge_interval() {
   // Calculate elapsed time in hours
   double hours_elapsed = difftime(now, this->last_purge_time_) / 3600.0;
 
-  // Check if purge interval has elapsed
-  if (hours_elapsed >= this->purge_interval_hours_) {
+  // Check if purge interval has elapsed (a purge still queued from the HA service counts as started)
+  if (hours_elapsed >= this->purge_interval_hours_ && !this->job_runner_.is_queued(PURGE_JOB)) {
     ESP_LOGI(TAG, "Purge interval of %d hours elapsed (%.2f hours since last purge), starting automatic purge",
              this->purge_interval_hours_, hours_elapsed);
 
@@ -1292,14 +2031,14 @@ void B48DisplayController::start_time_test_mode() {
   this->state_change_time_ = millis();
 
   // Send intro message
-  auto test_msg = std::make_shared<MessageEntry>();
-  test_msg->message_id = -1;
-  test_msg->line_number = 99;
-  test_msg->tarif_zone = 999;
-  test_msg->static_intro = "Time Test";
-  test_msg->scrolling_message = "Testing time values from u0000 to u2459";
-  test_msg->next_message_hint = "Testing";
-  test_msg->priority = 100;
+  MessageEntry test_msg;
+  test_msg.message_id = -1;
+  test_msg.line_number = 99;
+  test_msg.tarif_zone = 999;
+  test_msg.static_intro = "Time Test";
+  test_msg.scrolling_message = "Testing time values from u0000 to u2459";
+  test_msg.next_message_hint = "Testing";
+  test_msg.priority = 100;
   send_commands_for_message(test_msg);
 
   // Prepare for first time value
@@ -1320,14 +2059,14 @@ void B48DisplayController::stop_time_test_mode() {
   this->state_change_time_ = millis();
 
   // Send completion message
-  auto completion_msg = std::make_shared<MessageEntry>();
-  completion_msg->message_id = -1;
-  completion_msg->line_number = 48;
-  completion_msg->tarif_zone = 0;
-  completion_msg->static_intro = "Test Done";
-  completion_msg->scrolling_message = "Time test complete. Returning to normal operation.";
-  completion_msg->next_message_hint = "Normal";
-  completion_msg->priority = 100;
+  MessageEntry completion_msg;
+  completion_msg.message_id = -1;
+  completion_msg.line_number = 48;
+  completion_msg.tarif_zone = 0;
+  completion_msg.static_intro = "Test Done";
+  completion_msg.scrolling_message = "Time test complete. Returning to normal operation.";
+  completion_msg.next_message_hint = "Normal";
+  completion_msg.priority = 100;
   send_commands_for_message(completion_msg);
 }
 
@@ -1450,13 +2189,13 @@ void B48DisplayController::run_character_reverse_test_mode() {
         return; // Skip sending an empty message, wait for next interval
     }
     
-    auto test_msg = std::make_shared<MessageEntry>();
-    test_msg->line_number = 48; 
-    test_msg->tarif_zone = 101; 
-    test_msg->static_intro = "Char test 255"; 
-    test_msg->scrolling_message = scrolling_message_segment;
-    test_msg->next_message_hint = "Test complete.";
-    test_msg->is_ephemeral = true;
+    MessageEntry test_msg;
+    test_msg.line_number = 48; 
+    test_msg.tarif_zone = 101; 
+    test_msg.static_intro = "Char test 255"; 
+    test_msg.scrolling_message = scrolling_message_segment;
+    test_msg.next_message_hint = "Test complete.";
+    test_msg.is_ephemeral = true;
 
     ESP_LOGD(TAG, "Character Test: Sending segment (starting %d, %d chars, len %zu): %s", 
              this->current_character_test_value_, chars_in_segment, scrolling_message_segment.length(), 
@@ -1480,13 +2219,13 @@ void B48DisplayController::stop_character_reverse_test_mode() {
     // No inversion on stop
     this->serial_protocol_.switch_to_cycle(0); 
     
-    auto stop_msg = std::make_shared<MessageEntry>();
-    stop_msg->line_number = 48;
-    stop_msg->tarif_zone = 101;
-    stop_msg->static_intro = "CHAR TEST";
-    stop_msg->scrolling_message = "ENDED";
-    stop_msg->next_message_hint = "";
-    stop_msg->is_ephemeral = true;
+    MessageEntry stop_msg;
+    stop_msg.line_number = 48;
+    stop_msg.tarif_zone = 101;
+    stop_msg.static_intro = "CHAR TEST";
+    stop_msg.scrolling_message = "ENDED";
+    stop_msg.next_message_hint = "";
+    stop_msg.is_ephemeral = true;
     send_commands_for_message(stop_msg);
     
     // Resume state machine if it was NOT MANUALLY paused and this test mode was the one controlling it.
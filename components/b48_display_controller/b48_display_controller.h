@@ -11,12 +11,20 @@
 #include <memory>
 #include <mutex>
 #include <atomic>
+#include <functional>
 
 #include <sqlite3.h>
 #include <Arduino.h>
 #include <LittleFS.h>
 
 #include "b48_database_manager.h"
+#include "b48_content_pack.h"
+#include "b48_message_table.h"
+#include "b48_log_ring.h"
+#include "b48_fault_injection.h"
+#include "b48_job.h"
+#include "b48_shadow_scheduler.h"
+#include "b48_airtime.h"
 #include "buse120_serial_protocol.h"
 #include "b48_ha_integration.h"
 
@@ -50,6 +58,7 @@ class B48DisplayController : public Component {
   void setup() override;
   void loop() override;
   void dump_config() override;
+  void on_shutdown() override;  // Flushes display counts so a planned reboot loses none
   float get_setup_priority() const override { return esphome::setup_priority::LATE; }
 
   // Configuration setters
@@ -58,7 +67,12 @@ class B48DisplayController : public Component {
     this->serial_protocol_.set_uart(uart);
   }
   void set_database_path(const std::string &path) { this->database_path_ = path; }
-  void set_transition_duration(int duration) { this->transition_duration_ = duration; }
+  void set_transition_duration(int duration) {
+    this->transition_duration_ = duration;
+    this->transition_tuner_.set_fixed_duration(duration * 1000);
+  }
+  // Lets cycle 6 follow the wire time of its frames within these bounds instead of transition_duration
+  void set_transition_bounds(int min_ms, int max_ms) { this->transition_tuner_.set_bounds(min_ms, max_ms); }
   void set_time_sync_interval(int interval) { this->time_sync_interval_ = interval; }
   void set_emergency_priority_threshold(int threshold) { this->emergency_priority_threshold_ = threshold; }
   void set_run_tests_on_startup(bool run_tests) { this->run_tests_on_startup_ = run_tests; }
@@ -81,6 +95,22 @@ class B48DisplayController : public Component {
   // Configuration for database maintenance
   void set_purge_interval_hours(int hours) { this->purge_interval_hours_ = hours; }
 
+  // Label of the flash partition holding the prebuilt content pack (empty = disabled)
+  void set_content_pack_partition(const std::string &label) { this->content_pack_partition_ = label; }
+
+  // RAM for the deferred-format hot-path log ring (0 = log hot paths directly)
+  void set_log_ring_size(int bytes) { this->log_ring_size_ = bytes; }
+
+  // Time each loop() may spend on background storage jobs (purge, vacuum, cache loads, backfills)
+  void set_job_budget_us(uint32_t budget_us) { this->job_budget_us_ = budget_us; }
+
+  // How often display counts of count-limited messages are written to the database; an unplanned reset loses
+  // at most this much counting, so a message may be shown a few times more than its max_displays
+  void set_display_count_flush_interval(int seconds) { this->display_count_flush_interval_ = seconds; }
+
+  // Scheduling policy evaluated in shadow mode next to select_next_message (see B48SchedulingPolicy::create)
+  void add_shadow_policy(const std::string &name) { this->shadow_scheduler_.add_policy(name); }
+
   // Message management
   /**
    * @brief Adds a message to be displayed. Handles both persistent and ephemeral messages based on duration.
@@ -98,11 +128,16 @@ class B48DisplayController : public Component {
    * @param duration_seconds Duration in seconds. Controls persistence and expiration.
    * @param source_info Information about the message source (e.g., "HA Service").
    * @param check_duplicates If true, prevents adding identical messages already in the DB.
+   * @param variant_group Key linking variants of one message (e.g. translations); variants share a single
+   *                      scheduling slot and alternate. Empty for a standalone message.
+   * @param max_displays Retire the message after it was shown this many times (0 = no limit). Counted in RAM
+   *                     and flushed to the database in batches.
    * @return true if the message was added successfully, false otherwise.
    */
   bool add_message(int priority, int line_number, int tarif_zone, const std::string &static_intro,
                    const std::string &scrolling_message, const std::string &next_message_hint, int duration_seconds,
-                   const std::string &source_info = "", bool check_duplicates = true);
+                   const std::string &source_info = "", bool check_duplicates = true,
+                   const std::string &variant_group = "", int max_displays = 0);
 
   bool update_message(int message_id, int priority, bool is_enabled, int line_number, int tarif_zone,
                       const std::string &static_intro, const std::string &scrolling_message,
@@ -132,12 +167,97 @@ class B48DisplayController : public Component {
   bool is_character_reverse_test_mode_active() const { return character_reverse_test_mode_active_; }
 
   // Database maintenance methods
-  bool purge_disabled_messages();
+  bool purge_disabled_messages();  // Queues the purge (and vacuum) as a background job; false if one is queued
+  void log_job_report() const { this->job_runner_.log_report(); }
   int get_purge_interval_hours() const { return this->purge_interval_hours_; }
 
   // Filesystem stats method for HA
   void display_filesystem_stats() { log_filesystem_stats(); }
 
+  /**
+   * @brief Full-text search of enabled persistent messages (see B48DatabaseManager::search_messages).
+   * @param limit Maximum hits, clamped to 1..SEARCH_MAX_RESULTS
+   * @param elapsed_us Time the lookup took
+   * @param used_index false if the LIKE fallback ran
+   * @return false without a database or on a query error
+   */
+  bool search_messages(const std::string &query, int limit, std::vector<SearchHit> &hits, uint32_t &elapsed_us,
+                       bool &used_index);
+  static constexpr int SEARCH_MAX_RESULTS = 25;  // Keeps the HA event small
+
+  /**
+   * @brief Log how the live scheduler and each shadow policy have treated the rotation so far.
+   * @param reset Start a new measurement afterwards
+   * @return One row per policy, the live scheduler ("active") first
+   */
+  std::vector<B48ShadowScheduler::PolicyReport> report_scheduling(bool reset);
+
+  /**
+   * @brief Log where display time went per state and how cycle 6 is tuned
+   * @param reset Start a new measurement afterwards
+   * @return Shares, content-to-transition ratio (measured and at the fixed transition_duration) and tuner state
+   */
+  AirtimeSummary report_airtime(bool reset);
+
+  // --- Content Pack (memory-mapped, pre-encoded messages) ---
+  /**
+   * @brief Map the content pack partition and add its records to the rotation.
+   * @return true if a valid pack was loaded.
+   */
+  bool load_content_pack();
+
+  /**
+   * @brief Encode the current persistent cache into a pack and write it to the pack partition.
+   * @return true if the new pack was written and mapped.
+   */
+  bool export_content_pack();
+
+  // Chunked over-the-air replacement of the pack (data is base64 encoded)
+  bool begin_content_pack_upload(int total_size);
+  bool write_content_pack_chunk(int offset, const std::string &data_base64);
+  bool finish_content_pack_upload();
+
+  // --- Deferred-format log ring ---
+  /**
+   * @brief Format and log every record in the hot-path log ring, oldest first.
+   * @param clear Drop the dumped records afterwards.
+   * @return Number of records dumped.
+   */
+  size_t dump_log_ring(bool clear);
+
+  // --- Long-run soak test ---
+  /**
+   * @brief Replace the wall clock used for expiry, scheduling and purge decisions.
+   * Pass an empty function to return to time(nullptr). Also applied to the database manager.
+   */
+  void set_time_source(std::function<time_t()> source);
+
+  /**
+   * @brief Run the scheduler, ingest, expiry and purge paths for many virtual days on a scratch database.
+   * Samples heap, allocation count, SQLite memory, open statements, container sizes and database file size
+   * once per virtual day and fails if any of them grows monotonically.
+   * @param virtual_days Number of simulated days (at least SOAK_WARMUP_DAYS + 2).
+   * @return true if no resource grew without bound.
+   */
+  bool run_soak_test(int virtual_days);
+
+  // --- Fault injection (builds with B48_FAULT_INJECTION only) ---
+  /**
+   * @brief Drive the display cycle on a scratch database and virtual clock while scripted faults are injected
+   * into SQLite, the UART and the wall clock. Logs frames lost and the time back to normal rotation per fault.
+   * UART frames are counted but kept off the wire for the whole run.
+   * @param schedule Fault script (see B48FaultInjector::parse_schedule); empty for DEFAULT_FAULT_SCHEDULE.
+   * @return true if the rotation recovered from every fault.
+   */
+  bool run_fault_injection(const std::string &schedule);
+
+  /**
+   * @brief Check that an interrupted and a corrupted upload both leave the live content pack in place.
+   * Overwrites the inactive slot (the previous pack, kept for rollback), so it is not part of the startup tests.
+   * @return true if the live pack survived both uploads (or no pack is loaded).
+   */
+  bool run_content_pack_staging_test();
+
   // --- Raw BUSE Command and State Machine Control ---
   /**
    * @brief Sends a raw command string directly to the BUSE120 display.
@@ -171,6 +291,13 @@ class B48DisplayController : public Component {
   void check_expired_messages();
   void check_expired_ephemeral_messages();
   void check_purge_interval();  // Periodic check for message purging
+  void advance_schema_migrations();  // Queues the backfill job if a schema backfill is pending
+  std::unique_ptr<B48Job> make_cache_load_job();
+  void apply_persistent_messages(std::vector<MessageEntry> &loaded_messages);  // Swaps in a complete load
+  void submit_bootstrap_job();
+  void check_display_count_flush();  // Queues the batched count flush once per interval
+  void submit_display_count_flush();
+  bool flush_display_counts();  // Writes the pending counts and retires messages at their limit, in one transaction
 
   // Setup helper methods
   bool initialize_filesystem();
@@ -179,10 +306,28 @@ class B48DisplayController : public Component {
   bool handle_database_wipe();
   void display_startup_message(bool db_initialized);
 
+  time_t wall_time() const {
+    time_t now = this->time_source_ ? this->time_source_() : time(nullptr);
+#ifdef B48_FAULT_INJECTION
+    if (global_fault_injector != nullptr) {
+      now = global_fault_injector->adjust_clock(now);
+    }
+#endif
+    return now;
+  }
+  void release_handles(std::vector<MessageHandle> &handles);  // Frees the slots; caller holds message_mutex_
+  void release_pack_messages();  // Drops the pack handles (and a pack current message) before unmapping
+  // A persistent message exported into the loaded pack is scheduled through its pack copy only; caller holds
+  // message_mutex_
+  bool shadowed_by_pack(const MessageEntry &msg) const;
+  void rebase_display_history(time_t now);  // Undoes a backwards clock step; caller holds message_mutex_
+
   // Display algorithm methods
-  std::shared_ptr<MessageEntry> select_next_message();
-  int calculate_display_duration(const std::shared_ptr<MessageEntry> &msg);
-  void update_message_display_stats(const std::shared_ptr<MessageEntry> &msg);
+  MessageHandle select_next_message();
+  void evaluate_shadow_policies(MessageHandle live_pick, time_t now);  // Caller holds message_mutex_
+  int calculate_display_duration(const MessageEntry &msg);
+  void update_message_display_stats(MessageHandle handle);
+  void count_current_display();  // Counts current_message_ once, and only if it reached cycle 0
 
   // BUSE120 protocol methods - now delegated to the serial_protocol_ object
   void send_line_number(int line);
@@ -193,7 +338,7 @@ class B48DisplayController : public Component {
   void send_time_update();
   void send_invert_command();
   void switch_to_cycle(int cycle);
-  void send_commands_for_message(const std::shared_ptr<MessageEntry> &msg);
+  void send_commands_for_message(const MessageEntry &msg);
 
   // Display state machine methods
   void run_transition_mode();
@@ -201,6 +346,7 @@ class B48DisplayController : public Component {
   void run_display_message();
   void display_fallback_message();
   void check_for_emergency_messages();
+  void account_airtime();  // Charge the time since the last loop() to the state it was spent in
 
   // Self-test methods
   void runSelfTests();
@@ -209,6 +355,18 @@ class B48DisplayController : public Component {
   bool testSerialProtocol();
   bool test_czech_character_preservation();
   bool test_czech_character_encoding();
+  bool test_schema_migration_backfill();
+  bool test_content_pack_build();
+  bool test_content_pack_reload();
+  bool test_message_table_handles();
+  bool test_log_ring_format();
+  bool test_variant_groups();
+  bool test_job_runner();
+  bool test_message_search();
+  bool test_display_count_limit();
+  bool test_shadow_scheduling();
+  bool test_airtime_tuning();
+  bool test_fault_injection();
   bool executeTest(bool (B48DisplayController::*testMethod)(), const char* testName);
 
   // Add new test declarations above here
@@ -232,10 +390,47 @@ class B48DisplayController : public Component {
   // Database manager
   std::unique_ptr<B48DatabaseManager> db_manager_{nullptr};
 
-  // Message cache
-  std::vector<std::shared_ptr<MessageEntry>> persistent_messages_;
-  std::vector<std::shared_ptr<MessageEntry>> ephemeral_messages_;
-  std::shared_ptr<MessageEntry> current_message_{nullptr};
+  // Content pack (read in place from flash)
+  std::string content_pack_partition_;
+  B48ContentPack content_pack_;
+
+  // Load cost of each message source, for comparing the pack against the SQLite cache
+  uint32_t cache_load_us_{0};
+  int32_t cache_load_heap_bytes_{0};
+  uint32_t pack_load_us_{0};
+  int32_t pack_load_heap_bytes_{0};
+
+  // Hot-path log ring (also published as global_log_ring)
+  int log_ring_size_{8192};
+  std::unique_ptr<B48LogRing> log_ring_{nullptr};
+
+  // Cooperative background jobs, stepped from loop()
+  B48JobRunner job_runner_;
+  uint32_t job_budget_us_{4000};
+  static constexpr const char *CACHE_LOAD_JOB = "cache_load";
+  static constexpr int CACHE_LOAD_PAGE_ROWS = 8;  // Rows read per cache load step
+  static constexpr const char *PURGE_JOB = "purge";
+
+  // Displays of count-limited persistent messages not yet in the database (message_id -> displays), guarded by
+  // message_mutex_. Flushed every display_count_flush_interval_ seconds, or at once when a message hits its limit.
+  std::map<int, uint32_t> pending_display_counts_;
+  int display_count_flush_interval_{300};
+  unsigned long last_display_count_flush_ms_{0};
+  static constexpr const char *DISPLAY_COUNT_FLUSH_JOB = "display_counts";
+
+  // Message cache: every entry lives in message_table_, the vectors only hold handles into it
+  MessageTable message_table_;
+  std::vector<MessageHandle> pack_messages_;
+  std::vector<int> pack_source_ids_;  // SQLite IDs the loaded pack was exported from, sorted
+  std::vector<MessageHandle> persistent_messages_;
+  std::vector<MessageHandle> ephemeral_messages_;
+  MessageHandle current_message_;
+  bool current_message_shown_{false};  // current_message_ went to cycle 0 and has not been counted yet
+  uint32_t last_selection_us_{0};  // CPU time of the last select_next_message()
+
+  // Alternative policies picking from the live rotation without sending anything; guarded by message_mutex_
+  B48ShadowScheduler shadow_scheduler_;
+  std::vector<ShadowCandidate> shadow_candidates_;  // Reused between selections
 
   // State tracking
   DisplayState state_{TRANSITION_MODE};
@@ -246,6 +441,13 @@ class B48DisplayController : public Component {
   time_t current_time_{0};
   unsigned long current_display_duration_ms_{5000};  // Store calculated display duration
 
+  // Airtime per state and the cycle 6 tuner fed by the wire time of each transition's frames
+  B48AirtimeLedger airtime_ledger_;
+  B48TransitionTuner transition_tuner_;
+  bool showing_fallback_{false};
+  uint32_t transition_drained_ms_{0};  // When the current transition's frames leave the UART, from its start
+  uint32_t transition_wire_bytes_{0};
+
   // Threading protection
   std::mutex message_mutex_;
 
@@ -255,8 +457,62 @@ class B48DisplayController : public Component {
   // Stored sensor for HA integration
   sensor::Sensor *message_queue_size_sensor_{nullptr};
 
-  // Tracking last display times for persistent messages
-  std::map<int, time_t> last_display_times_;
+  // Clock override (empty = time(nullptr)), installed by the soak test
+  std::function<time_t()> time_source_;
+
+  // Soak test parameters
+  static constexpr int SOAK_STEP_SECONDS = 1800;  // Virtual time per simulation step
+  static constexpr int SOAK_WARMUP_DAYS = 3;      // Longest ingest TTL; pool size is steady afterwards
+  static constexpr int SOAK_MAX_DISPLAYS = 2;     // Limit of the count-limited share of the ingest
+
+  // Fault injection parameters: one of each fault, with a steady stretch before and after each
+  static constexpr const char *DEFAULT_FAULT_SCHEDULE =
+      "sqlite_step:600:300;filesystem_full:1800:600;uart_stall:3600:120;"
+      "clock_jump:4800:900:-86400;clock_jump:6600:900:86400";
+  static constexpr int FAULT_SEED_MESSAGES = 8;             // Permanent messages in the scratch rotation
+  static constexpr int FAULT_INGEST_CYCLES = 4;             // New message every N cycles
+  static constexpr int FAULT_RECOVERY_STREAK = 3;           // Normal cycles in a row that count as recovered
+  static constexpr int FAULT_RECOVERY_LIMIT_SECONDS = 1800;  // Observation after the last fault ends
+
+  // Job runner test: rows in the scratch database (every other one disabled) and per-run() budget
+  static constexpr int JOB_TEST_ROWS = 40;
+  static constexpr uint32_t JOB_TEST_BUDGET_US = 1;  // Below any step, so each run() takes exactly one
+  static constexpr int JOB_TEST_CALL_LIMIT = 200;
+
+  // Search test: filler rows in the scratch database and the lookup time that counts as slow
+  static constexpr int SEARCH_TEST_ROWS = 300;
+  static constexpr uint32_t SEARCH_TEST_SLOW_US = 50000;
+
+  // Display count test: limit of the count-limited message
+  static constexpr int COUNT_TEST_LIMIT = 3;
+
+  // Airtime test: transition tuner bounds, virtual loop interval and messages per phase
+  static constexpr uint32_t AIRTIME_TEST_MIN_MS = 1000;
+  static constexpr uint32_t AIRTIME_TEST_MAX_MS = 8000;
+  static constexpr uint32_t AIRTIME_TEST_LOOP_MS = 16;
+  static constexpr int AIRTIME_TEST_MESSAGES = 48;
+
+  // Shadow scheduling test: rounds of the rotation and the evaluation time that counts as too slow to leave on
+  static constexpr int SHADOW_TEST_ROUNDS = 4;
+  static constexpr uint32_t SHADOW_TEST_SLOW_US = 5000;
+
+  // Live state set aside while a simulation runs against a scratch database
+  struct ParkedState {
+    std::unique_ptr<B48DatabaseManager> db_manager;
+    MessageTable message_table;
+    std::vector<MessageHandle> persistent_messages;
+    std::vector<MessageHandle> ephemeral_messages;
+    std::vector<MessageHandle> pack_messages;
+    MessageHandle current_message;
+    bool current_message_shown{false};
+    std::map<int, uint32_t> pending_display_counts;
+    B48ShadowScheduler shadow_scheduler;
+    time_t last_purge_time{0};
+    unsigned long last_ephemeral_check_time{0};
+  };
+  // Park the live state, switch to scratch_db (relative to /littlefs) and a clock reading virtual_now
+  bool park_live_state(ParkedState &parked, const char *scratch_db, time_t &virtual_now);
+  void restore_live_state(ParkedState &parked, const char *scratch_db);
 
   // Time test mode variables
   bool time_test_mode_active_{false};
@@ -271,11 +527,16 @@ class B48DisplayController : public Component {
   static constexpr unsigned long CHARACTER_TEST_INTERVAL_MS = 30000; // 1 minute between updates
 
   // Database maintenance variables
+  static constexpr unsigned long MIGRATION_CHECK_INTERVAL_MS = 5000;  // How often a stopped backfill is resumed
+  static constexpr int MIGRATION_CHUNK_ROWS = 16;                     // Rows per backfill step
   time_t last_purge_time_{0};
   int purge_interval_hours_{24};  // Default to daily purge
 
   // Helper to schedule refresh of message cache on loopTask
   std::atomic<bool> pending_message_cache_refresh_{false};
+  bool cache_refresh_failed_{false};  // Last refresh hit a database error; the old cache is still in use
+  unsigned long cache_refresh_failed_ms_{0};
+  static constexpr unsigned long CACHE_REFRESH_RETRY_MS = 5000;
 
   bool first_cycle_in_state_{true};
 
@@ -6,9 +6,12 @@
 #include <LittleFS.h>      // Include LittleFS header
 #include <sqlite3.h>       // Include SQLite3 header
 #include <vector>          // Include for std::vector
+#include <algorithm>       // For std::max_element/min_element
 #include <string>          // Include for std::string
+#include <memory>          // For std::shared_ptr in the handle comparison
 #include <Arduino.h>       // For delay() and yield()
 #include <esp_task_wdt.h>  // For esp_task_wdt_reset()
+#include <esp_heap_caps.h> // For heap_caps_get_info() in the soak test
 
 namespace esphome {
 namespace b48_display_controller {
@@ -22,6 +25,40 @@ struct TestSqliteCallbackData {
   std::string expected_content;
 };
 
+// One resource snapshot per virtual day of the soak test
+struct SoakSample {
+  int64_t heap_allocated_bytes;
+  int64_t heap_allocated_blocks;
+  int64_t sqlite_memory_used;
+  int64_t open_statements;
+  int64_t persistent_cache_size;
+  int64_t ephemeral_queue_size;
+  int64_t message_table_slots;
+  int64_t database_file_size;
+};
+
+// True if the series keeps growing after the warm-up: either it never decreases, or (to catch leaks hidden
+// in noise) every later sample sits above every earlier one. Growth within the tolerance is ignored.
+static bool grows_monotonically(const std::vector<int64_t> &series, size_t start, int64_t tolerance) {
+  if (series.size() < start + 3) {
+    return false;
+  }
+  if (series.back() - series[start] <= tolerance) {
+    return false;
+  }
+  bool never_decreases = true;
+  for (size_t i = start + 1; i < series.size(); i++) {
+    if (series[i] < series[i - 1]) {
+      never_decreases = false;
+      break;
+    }
+  }
+  size_t middle = start + (series.size() - start) / 2;
+  int64_t early_max = *std::max_element(series.begin() + start, series.begin() + middle);
+  int64_t late_min = *std::min_element(series.begin() + middle, series.end());
+  return never_decreases || late_min - early_max > tolerance;
+}
+
 // Simple callback function for the SQLite test
 static int testSqliteCallback(void *data, int argc, char **argv, char **azColName) {
   TestSqliteCallbackData *test_data = static_cast<TestSqliteCallbackData *>(data);
@@ -106,6 +143,92 @@ void B48DisplayController::runSelfTests() {
     fail_count++;
   }
 
+  // Schema migration with chunked backfill on a legacy (v1) database
+  if (executeTest(&B48DisplayController::test_schema_migration_backfill, "test_schema_migration_backfill")) {
+    pass_count++;
+  } else {
+    fail_count++;
+  }
+
+  // Content pack image encoding (does not touch the pack partition)
+  if (executeTest(&B48DisplayController::test_content_pack_build, "test_content_pack_build")) {
+    pass_count++;
+  } else {
+    fail_count++;
+  }
+
+  // Reloading the configured content pack (skipped without a pack partition)
+  if (executeTest(&B48DisplayController::test_content_pack_reload, "test_content_pack_reload")) {
+    pass_count++;
+  } else {
+    fail_count++;
+  }
+
+  // Generational handles of the message table
+  if (executeTest(&B48DisplayController::test_message_table_handles, "test_message_table_handles")) {
+    pass_count++;
+  } else {
+    fail_count++;
+  }
+
+  // Deferred-format log ring encoding, wrap-around and cost
+  if (executeTest(&B48DisplayController::test_log_ring_format, "test_log_ring_format")) {
+    pass_count++;
+  } else {
+    fail_count++;
+  }
+
+  // Variant groups share one scheduling slot
+  if (executeTest(&B48DisplayController::test_variant_groups, "test_variant_groups")) {
+    pass_count++;
+  } else {
+    fail_count++;
+  }
+
+  // Full-text search kept in sync by triggers
+  if (executeTest(&B48DisplayController::test_message_search, "test_message_search")) {
+    pass_count++;
+  } else {
+    fail_count++;
+  }
+
+  // Display limits counted in RAM, flushed in batches and retired through expiry
+  if (executeTest(&B48DisplayController::test_display_count_limit, "test_display_count_limit")) {
+    pass_count++;
+  } else {
+    fail_count++;
+  }
+
+  // Alternative scheduling policies measured next to the live one without sending anything
+  if (executeTest(&B48DisplayController::test_shadow_scheduling, "test_shadow_scheduling")) {
+    pass_count++;
+  } else {
+    fail_count++;
+  }
+
+  // Per-state airtime and cycle 6 following the wire time of its frames
+  if (executeTest(&B48DisplayController::test_airtime_tuning, "test_airtime_tuning")) {
+    pass_count++;
+  } else {
+    fail_count++;
+  }
+
+  // Purge, vacuum and cache load stepped within a time budget
+  if (executeTest(&B48DisplayController::test_job_runner, "test_job_runner")) {
+    pass_count++;
+  } else {
+    fail_count++;
+  }
+
+#ifdef B48_FAULT_INJECTION
+  // Recovery from scripted SQLite, filesystem, UART and clock faults
+  if (executeTest(&B48DisplayController::test_fault_injection, "test_fault_injection")) {
+    pass_count++;
+  } else {
+    fail_count++;
+  }
+#endif
+
   // --- Test Summary ---
   ESP_LOGI(TAG, "--- Self-Test Summary --- Passed: %d, Failed: %d ---", pass_count, fail_count);
 
@@ -430,5 +553,1474 @@ bool B48DisplayController::test_czech_character_encoding() {
   return test_passed;
 }
 
+bool B48DisplayController::test_schema_migration_backfill() {
+  ESP_LOGI(TAG, "Testing online schema migration and chunked backfill...");
+
+  const char *dbFilenameRelative = "/test_migration.db";
+  std::string fullDbPath = std::string("/littlefs") + dbFilenameRelative;
+  const int legacy_rows = 40;
+
+  if (LittleFS.exists(dbFilenameRelative)) {
+    LittleFS.remove(dbFilenameRelative);
+  }
+
+  // 1. Build a database with the legacy v1 layout (no content_hash column)
+  sqlite3 *legacy_db = nullptr;
+  if (sqlite3_open(fullDbPath.c_str(), &legacy_db) != SQLITE_OK) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Migration: Can't open legacy database: %s", sqlite3_errmsg(legacy_db));
+    sqlite3_close(legacy_db);
+    return false;
+  }
+  const char *legacy_schema = R"SQL(
+    CREATE TABLE messages (
+      message_id INTEGER PRIMARY KEY AUTOINCREMENT,
+      priority INTEGER NOT NULL DEFAULT 50,
+      is_enabled INTEGER NOT NULL DEFAULT 1,
+      tarif_zone INTEGER NOT NULL DEFAULT 0,
+      line_number INTEGER NOT NULL DEFAULT 0,
+      static_intro TEXT NOT NULL DEFAULT '',
+      scrolling_message TEXT NOT NULL,
+      next_message_hint TEXT NOT NULL DEFAULT '',
+      datetime_added INTEGER NOT NULL,
+      duration_seconds INTEGER DEFAULT NULL,
+      source_info TEXT DEFAULT NULL
+    );
+    PRAGMA user_version = 1;
+  )SQL";
+  bool success = sqlite3_exec(legacy_db, legacy_schema, nullptr, nullptr, nullptr) == SQLITE_OK;
+  sqlite3_exec(legacy_db, "BEGIN;", nullptr, nullptr, nullptr);
+  for (int i = 0; success && i < legacy_rows; i++) {
+    char insert[160];
+    snprintf(insert, sizeof(insert),
+             "INSERT INTO messages (scrolling_message, datetime_added) VALUES ('Legacy message %d', 0);", i);
+    success = sqlite3_exec(legacy_db, insert, nullptr, nullptr, nullptr) == SQLITE_OK;
+  }
+  // A bootstrap translation pair from before variant groups existed
+  const char *legacy_bootstrap = R"SQL(
+    INSERT INTO messages (priority, static_intro, scrolling_message, next_message_hint, datetime_added, source_info)
+    VALUES (40, 'Base48', 'Podporuj svuj mistni hackerspace! Podporuj Base48.', 'Loading', 0, 'SQLiteBootstrap'),
+           (40, 'Base48', 'Support your local hackerspace! Support Base48.', 'Loading', 0, 'SQLiteBootstrap');
+  )SQL";
+  success = success && sqlite3_exec(legacy_db, legacy_bootstrap, nullptr, nullptr, nullptr) == SQLITE_OK;
+  sqlite3_exec(legacy_db, "COMMIT;", nullptr, nullptr, nullptr);
+  sqlite3_close(legacy_db);
+  if (!success) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Migration: Failed to populate legacy database");
+    LittleFS.remove(dbFilenameRelative);
+    return false;
+  }
+
+  {
+    // 2. Opening with the current code applies the DDL but leaves the backfill pending
+    B48DatabaseManager manager(fullDbPath);
+    if (!manager.initialize()) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Migration: initialize() failed on legacy database");
+      success = false;
+    } else if (!manager.has_pending_backfill()) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Migration: Expected a pending backfill after upgrade");
+      success = false;
+    }
+
+    // 3. Duplicate detection must still see rows that have not been backfilled yet
+    if (success && manager.add_persistent_message(50, 1, 1, "", "Legacy message 39", "", 0, "SelfTest", true)) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Migration: Duplicate of a not-yet-backfilled row was accepted");
+      success = false;
+    }
+
+    // Search must not miss rows the index backfill has not reached: it scans until then
+    std::vector<SearchHit> hits;
+    bool used_index = true;
+    if (success && (!manager.search_messages("message 39", 5, hits, &used_index) || used_index || hits.size() != 1)) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Migration: Search during backfill returned %zu hits (index %s)", hits.size(),
+               YESNO(used_index));
+      success = false;
+    }
+    // An edit to a row the index backfill has not reached yet must not touch the index
+    if (success && !manager.update_persistent_message(legacy_rows - 1, 50, true, 0, 0, "", "Renamed legacy row", "",
+                                                      0, "SelfTest")) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Migration: Could not edit a legacy row");
+      success = false;
+    }
+
+    // 4. Drive the backfill in small chunks as loop() would
+    int steps = 0;
+    while (success && manager.has_pending_backfill() && steps < 100) {
+      if (manager.advance_migrations(16) < 0) {
+        ESP_LOGE(TAG, "[TEST][FAIL] Migration: Backfill step failed");
+        success = false;
+      }
+      steps++;
+      esp_task_wdt_reset();
+    }
+    if (success && manager.has_pending_backfill()) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Migration: Backfill did not finish after %d steps", steps);
+      success = false;
+    }
+    ESP_LOGD(TAG, "Migration: Backfill finished in %d steps", steps);
+
+    // Backfilled rows are in the index (if this SQLite has FTS5), edited ones with their new text
+    if (success && (!manager.search_messages("message 39", 5, hits, &used_index) || hits.size() != 1 ||
+                    hits[0].message_id != legacy_rows || !manager.search_messages("renamed", 5, hits) ||
+                    hits.size() != 1 || hits[0].message_id != legacy_rows - 1)) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Migration: Search after backfill returned %zu hits (index %s)", hits.size(),
+               YESNO(used_index));
+      success = false;
+    }
+  }
+
+  // 5. Every row now carries the new column
+  if (success && sqlite3_open(fullDbPath.c_str(), &legacy_db) == SQLITE_OK) {
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(legacy_db, "SELECT COUNT(*) FROM messages WHERE content_hash IS NULL;", -1, &stmt,
+                           nullptr) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW) {
+      int missing = sqlite3_column_int(stmt, 0);
+      if (missing != 0) {
+        ESP_LOGE(TAG, "[TEST][FAIL] Migration: %d rows still lack content_hash", missing);
+        success = false;
+      }
+    } else {
+      ESP_LOGE(TAG, "[TEST][FAIL] Migration: Verification query failed: %s", sqlite3_errmsg(legacy_db));
+      success = false;
+    }
+    sqlite3_finalize(stmt);
+    stmt = nullptr;
+
+    // The bootstrap pair is linked into one variant group, user rows are left alone
+    if (success && sqlite3_prepare_v2(legacy_db,
+                                      "SELECT COUNT(*), COUNT(variant_group), SUM(variant_group = 'support') "
+                                      "FROM messages;",
+                                      -1, &stmt, nullptr) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW) {
+      int grouped = sqlite3_column_int(stmt, 1);
+      int support = sqlite3_column_int(stmt, 2);
+      if (grouped != 2 || support != 2) {
+        ESP_LOGE(TAG, "[TEST][FAIL] Migration: Expected 2 rows in variant group 'support', got %d grouped, %d support",
+                 grouped, support);
+        success = false;
+      }
+    } else if (success) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Migration: Variant group query failed: %s", sqlite3_errmsg(legacy_db));
+      success = false;
+    }
+    sqlite3_finalize(stmt);
+    stmt = nullptr;
+
+    // The legacy file was created without auto_vacuum; initialize() converts it before any job runs
+    if (success && sqlite3_prepare_v2(legacy_db, "PRAGMA auto_vacuum;", -1, &stmt, nullptr) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int(stmt, 0) != 2) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Migration: auto_vacuum is %d, expected 2 (incremental)", sqlite3_column_int(stmt, 0));
+      success = false;
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(legacy_db);
+  }
+
+  LittleFS.remove(dbFilenameRelative);
+
+  ESP_LOGI(TAG, "Schema migration backfill test: %s", success ? "PASSED" : "FAILED");
+  return success;
+}
+
+bool B48DisplayController::test_content_pack_build() {
+  ESP_LOGI(TAG, "Testing content pack build...");
+
+  std::vector<MessageEntry> messages;
+  for (int i = 0; i < 2; i++) {
+    MessageEntry msg;
+    msg.message_id = 100 + i;
+    msg.priority = 60 + i;
+    msg.line_number = 48;
+    msg.tarif_zone = 101;
+    msg.static_intro = "Pack";
+    msg.scrolling_message = i == 0 ? "Předkódovaná zpráva" : "Second pack message";
+    msg.next_message_hint = "Next";
+    msg.variant_group = i == 0 ? B48DatabaseManager::variant_group_id("pack-test") : 0;
+    messages.push_back(std::move(msg));
+  }
+
+  std::vector<uint8_t> image = B48ContentPack::build(messages, 1);
+  if (image.size() < sizeof(ContentPackHeader) + 2 * sizeof(ContentPackRecord)) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Content pack: Image too small (%zu bytes)", image.size());
+    return false;
+  }
+
+  ContentPackHeader header;
+  memcpy(&header, image.data(), sizeof(header));
+  if (header.magic != CONTENT_PACK_MAGIC || header.record_count != 2 || header.total_size != image.size()) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Content pack: Bad header (magic 0x%08X, records %u, size %u)",
+             (unsigned) header.magic, header.record_count, (unsigned) header.total_size);
+    return false;
+  }
+  uint32_t crc = B48ContentPack::crc32(image.data() + sizeof(header), image.size() - sizeof(header));
+  if (crc != header.body_crc32) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Content pack: CRC mismatch");
+    return false;
+  }
+
+  // The stored frames must be byte-identical to what the live send path puts on the wire
+  for (int i = 0; i < 2; i++) {
+    ContentPackRecord record;
+    memcpy(&record, image.data() + sizeof(header) + i * sizeof(ContentPackRecord), sizeof(record));
+    const auto &msg = messages[i];
+    std::string expected =
+        BUSE120SerialProtocol::build_wire_frame(BUSE120SerialProtocol::line_number_payload(msg.line_number)) +
+        BUSE120SerialProtocol::build_wire_frame(BUSE120SerialProtocol::tarif_zone_payload(msg.tarif_zone)) +
+        BUSE120SerialProtocol::build_wire_frame(BUSE120SerialProtocol::static_intro_payload(msg.static_intro)) +
+        BUSE120SerialProtocol::build_wire_frame(
+            BUSE120SerialProtocol::scrolling_message_payload(msg.scrolling_message)) +
+        BUSE120SerialProtocol::build_wire_frame(
+            BUSE120SerialProtocol::next_message_hint_payload(msg.next_message_hint));
+    if (record.frames_length != expected.size() ||
+        memcmp(image.data() + record.frames_offset, expected.data(), expected.size()) != 0) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Content pack: Frames of record %d differ from live encoding", i);
+      return false;
+    }
+    // The group ID is kept as is, so a pack copy shares its slot with the SQLite variants of its group
+    if (record.priority != msg.priority || record.source_message_id != (uint32_t) msg.message_id ||
+        record.variant_group != msg.variant_group) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Content pack: Metadata of record %d is wrong", i);
+      return false;
+    }
+  }
+
+  ESP_LOGI(TAG, "Content pack build test: PASSED (%zu bytes for 2 messages)", image.size());
+  return true;
+}
+
+bool B48DisplayController::test_content_pack_reload() {
+  ESP_LOGI(TAG, "Testing content pack reload...");
+
+  if (this->content_pack_partition_.empty() || !this->content_pack_.is_loaded() || this->pack_messages_.empty()) {
+    ESP_LOGI(TAG, "Content pack reload test: SKIPPED (no content pack loaded)");
+    return true;
+  }
+
+  // A pack message on screen must be dropped together with the mapping its frames point into
+  MessageHandle shown = this->pack_messages_.front();
+  MessageHandle saved_current = this->current_message_;
+  this->current_message_ = shown;
+  uint16_t records = this->content_pack_.record_count();
+  bool loaded = load_content_pack();
+  bool cleared = !this->current_message_.is_valid();
+  this->current_message_ = saved_current;  // Stale if it was a pack message, which the display cycle tolerates
+
+  if (!loaded || this->content_pack_.record_count() != records) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Content pack reload: Pack did not load again (%u records before)", records);
+    return false;
+  }
+  if (!cleared || this->message_table_.contains(shown)) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Content pack reload: Handle into the old mapping survived the reload");
+    return false;
+  }
+
+  ESP_LOGI(TAG, "Content pack reload test: PASSED (%u records)", records);
+  return true;
+}
+
+bool B48DisplayController::run_content_pack_staging_test() {
+  ESP_LOGI(TAG, "Testing content pack staging...");
+
+  if (this->content_pack_partition_.empty() || !this->content_pack_.is_loaded()) {
+    ESP_LOGI(TAG, "Content pack staging test: SKIPPED (no content pack loaded)");
+    return true;
+  }
+
+  // Never committed here, since that would replace the user's pack; only the inactive slot is overwritten
+  uint32_t generation = this->content_pack_.generation();
+  uint16_t records = this->content_pack_.record_count();
+  std::vector<MessageEntry> messages(1);
+  messages[0].message_id = 1;
+  messages[0].scrolling_message = "Staging test";
+  std::vector<uint8_t> image = B48ContentPack::build(messages, generation + 1);
+  const size_t chunk = 64;
+
+  // Interrupted upload: half the image, then a reload as after a reboot
+  if (!begin_content_pack_upload(image.size())) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Content pack staging: Upload of %zu bytes not accepted", image.size());
+    return false;
+  }
+  for (size_t offset = 0; offset < image.size() / 2; offset += chunk) {
+    this->content_pack_.write_chunk(offset, image.data() + offset, std::min(chunk, image.size() / 2 - offset));
+  }
+  if (!load_content_pack() || this->content_pack_.generation() != generation ||
+      this->content_pack_.record_count() != records) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Content pack staging: Interrupted upload replaced the live pack");
+    return false;
+  }
+  if (this->content_pack_.finish_update()) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Content pack staging: Incomplete upload was committed");
+    return false;
+  }
+
+  // Complete upload with a corrupted body: the CRC check must keep it from becoming live
+  image[image.size() - 1] ^= 0xFF;
+  bool staged = begin_content_pack_upload(image.size());
+  for (size_t offset = 0; staged && offset < image.size(); offset += chunk) {
+    staged = this->content_pack_.write_chunk(offset, image.data() + offset, std::min(chunk, image.size() - offset));
+  }
+  if (!staged || finish_content_pack_upload()) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Content pack staging: Corrupted upload %s", staged ? "was committed" : "failed early");
+    return false;
+  }
+  if (!this->content_pack_.is_loaded() || this->content_pack_.generation() != generation ||
+      this->content_pack_.record_count() != records) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Content pack staging: Live pack changed after a rejected upload");
+    return false;
+  }
+
+  ESP_LOGI(TAG, "Content pack staging test: PASSED (generation %u kept in slot %d)", (unsigned) generation,
+           this->content_pack_.active_slot());
+  return true;
+}
+
+bool B48DisplayController::test_message_table_handles() {
+  ESP_LOGI(TAG, "Testing message table handles...");
+
+  MessageTable table;
+  MessageEntry entry;
+  entry.message_id = 1;
+  entry.scrolling_message = "Handle test";
+  MessageHandle first = table.insert(entry);
+  if (!first.is_valid() || table.get(first) == nullptr || table.get(first)->message_id != 1) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Message table: Inserted entry not reachable");
+    return false;
+  }
+
+  // A removed slot must not be reachable through the old handle, even after it is reused
+  table.remove(first);
+  if (table.contains(first) || table.remove(first)) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Message table: Stale handle still resolves after remove");
+    return false;
+  }
+  entry.message_id = 2;
+  MessageHandle second = table.insert(entry);
+  if (second.index != first.index || second.generation == first.generation || table.get(first) != nullptr ||
+      table.get(second) == nullptr || table.get(second)->message_id != 2) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Message table: Slot reuse did not bump the generation");
+    return false;
+  }
+  if (table.size() != 1 || table.slot_count() != 1) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Message table: Expected 1 live entry in 1 slot, got %zu in %zu", table.size(),
+             table.slot_count());
+    return false;
+  }
+
+  // Per-transition cost: selection copies every candidate once. Compare the old shared_ptr
+  // candidate list against handles for a typical cache size.
+  const size_t message_count = 64;
+  const int iterations = 1000;
+  std::vector<std::shared_ptr<MessageEntry>> shared_entries;
+  std::vector<MessageHandle> handles;
+  for (size_t i = 0; i < message_count; i++) {
+    shared_entries.push_back(std::make_shared<MessageEntry>(entry));
+    handles.push_back(table.insert(entry));
+  }
+
+  size_t checksum = 0;
+  uint32_t start_us = micros();
+  for (int i = 0; i < iterations; i++) {
+    std::vector<std::shared_ptr<MessageEntry>> candidates(shared_entries);  // Atomic refcount per element
+    checksum += candidates.size();
+  }
+  uint32_t shared_us = micros() - start_us;
+
+  start_us = micros();
+  for (int i = 0; i < iterations; i++) {
+    std::vector<MessageHandle> candidates(handles);  // Plain memcpy
+    checksum += candidates.size();
+  }
+  uint32_t handle_us = micros() - start_us;
+
+  // make_shared puts the control block (two counters and a vtable pointer) next to the entry
+  size_t shared_bytes = message_count * (sizeof(std::shared_ptr<MessageEntry>) + 3 * sizeof(void *));
+  size_t handle_bytes = message_count * sizeof(MessageHandle);
+  ESP_LOGI(TAG, "Per transition with %zu messages: shared_ptr %.2f us / %zu B, handles %.2f us / %zu B", message_count,
+           (float) shared_us / iterations, shared_bytes, (float) handle_us / iterations, handle_bytes);
+
+  if (checksum != 2 * iterations * message_count) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Message table: Benchmark loop miscounted");
+    return false;
+  }
+
+  ESP_LOGI(TAG, "Message table handle test: PASSED");
+  return true;
+}
+
+bool B48DisplayController::test_log_ring_format() {
+  ESP_LOGI(TAG, "Testing log ring formatting...");
+
+  // 1. A record must render exactly like printf with the same format and arguments
+  B48LogRing ring(512);
+  const char *format = "Selected %s message ID: %d (Prio: %u, Weight: %.2f) %5.1f%% %-4s|%x %zu %c";
+  std::string title = "Předkódovaná";
+  ring.record('I', TAG, format, title.c_str(), -42, 7u, 0.8125f, 99.5, "ab", 255, (size_t) 12, 'Z');
+  char expected[160];
+  snprintf(expected, sizeof(expected), format, title.c_str(), -42, 7u, 0.8125f, 99.5, "ab", 255, (size_t) 12, 'Z');
+
+  std::vector<std::string> dumped;
+  ring.dump([&dumped](const LogRecordHeader &, const std::string &text) { dumped.push_back(text); });
+  if (dumped.size() != 1 || dumped[0] != expected) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Log ring: Expected '%s', got '%s'", expected,
+             dumped.empty() ? "(nothing)" : dumped[0].c_str());
+    return false;
+  }
+
+  // 2. Long strings are bounded and never cut inside a UTF-8 sequence
+  std::string long_text;
+  for (int i = 0; i < 20; i++) {
+    long_text += "žluť ";
+  }
+  ring.clear();
+  ring.record('D', TAG, "Text: %s", long_text.c_str());
+  dumped.clear();
+  ring.dump([&dumped](const LogRecordHeader &, const std::string &text) { dumped.push_back(text); });
+  std::string rendered = dumped.empty() ? "" : dumped[0];
+  size_t text_length = rendered.size() - strlen("Text: ") - 3;
+  if (dumped.size() != 1 || rendered.compare(rendered.size() - 3, 3, "...") != 0 ||
+      text_length > B48LogRing::MAX_STRING_LENGTH || long_text.compare(0, text_length, rendered, 6, text_length) != 0 ||
+      (static_cast<uint8_t>(long_text[text_length]) & 0xC0) == 0x80) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Log ring: Bad truncation '%s'", rendered.c_str());
+    return false;
+  }
+
+  // 3. When full, the oldest records are overwritten and the rest stay in order
+  ring.clear();
+  const int total_records = 200;
+  for (int i = 0; i < total_records; i++) {
+    ring.record('D', TAG, "Record %d of %s", i, i % 2 ? "odd" : "even");
+  }
+  int previous = -1;
+  bool ordered = true;
+  ring.dump([&previous, &ordered](const LogRecordHeader &, const std::string &text) {
+    int index = atoi(text.c_str() + strlen("Record "));
+    if (previous >= 0 && index != previous + 1) {
+      ordered = false;
+    }
+    previous = index;
+  });
+  if (!ordered || previous != total_records - 1 || ring.record_count() == 0 ||
+      ring.record_count() + ring.overwritten_count() < (size_t) total_records || ring.used_bytes() > 512) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Log ring: Wrap-around lost order (last %d, held %zu, overwritten %u)", previous,
+             ring.record_count(), (unsigned) ring.overwritten_count());
+    return false;
+  }
+
+  // 4. Hot-path cost: capture vs. formatting the same line (what ESP_LOGx does before the level check)
+  const int iterations = 1000;
+  B48LogRing bench_ring(4096);
+  uint32_t start_us = micros();
+  for (int i = 0; i < iterations; i++) {
+    bench_ring.record('I', TAG, format, title.c_str(), i, 7u, 0.8125f, 99.5, "ab", 255, (size_t) 12, 'Z');
+  }
+  uint32_t ring_us = micros() - start_us;
+  start_us = micros();
+  for (int i = 0; i < iterations; i++) {
+    snprintf(expected, sizeof(expected), format, title.c_str(), i, 7u, 0.8125f, 99.5, "ab", 255, (size_t) 12, 'Z');
+  }
+  uint32_t format_us = micros() - start_us;
+  ESP_LOGI(TAG, "Per log line: ring capture %.2f us, snprintf %.2f us", (float) ring_us / iterations,
+           (float) format_us / iterations);
+
+  ESP_LOGI(TAG, "Log ring format test: PASSED");
+  return true;
+}
+
+bool B48DisplayController::test_variant_groups() {
+  ESP_LOGI(TAG, "Testing variant group scheduling...");
+
+  // Park the live rotation; the test schedules its own messages on a virtual clock
+  MessageTable live_table;
+  std::vector<MessageHandle> live_persistent;
+  std::vector<MessageHandle> live_ephemeral;
+  std::vector<MessageHandle> live_pack;
+  {
+    std::lock_guard<std::mutex> lock(this->message_mutex_);
+    std::swap(live_table, this->message_table_);
+    live_persistent.swap(this->persistent_messages_);
+    live_ephemeral.swap(this->ephemeral_messages_);
+    live_pack.swap(this->pack_messages_);
+  }
+  time_t virtual_now = 1700000000;
+  this->set_time_source([&virtual_now]() { return virtual_now; });
+
+  // Two translations in one group plus two standalone messages, all with equal priority
+  const uint32_t group = B48DatabaseManager::variant_group_id("support");
+  const char *texts[] = {"Podporuj svuj mistni hackerspace!", "Support your local hackerspace!", "Standalone B",
+                         "Standalone C"};
+  MessageHandle handles[4];
+  {
+    std::lock_guard<std::mutex> lock(this->message_mutex_);
+    for (int i = 0; i < 4; i++) {
+      MessageEntry entry(1000 + i, 48, 101, "Base48", texts[i], "", 40);
+      entry.variant_group = i < 2 ? group : 0;
+      handles[i] = this->message_table_.insert(entry);
+      this->pack_messages_.push_back(handles[i]);
+    }
+  }
+
+  // Each message stays on air long enough that every slot comes back around
+  const int selections = 12;
+  int group_picks = 0;
+  int variant_picks[2] = {0, 0};
+  int last_variant = -1;
+  bool alternated = true;
+  bool back_to_back = false;
+  bool previous_was_group = false;
+  for (int i = 0; i < selections; i++) {
+    MessageHandle selected = this->select_next_message();
+    if (!selected.is_valid()) {
+      alternated = false;
+      break;
+    }
+    this->update_message_display_stats(selected);
+    bool is_group = selected == handles[0] || selected == handles[1];
+    back_to_back = back_to_back || (is_group && previous_was_group);
+    previous_was_group = is_group;
+    for (int v = 0; v < 2; v++) {
+      if (selected == handles[v]) {
+        group_picks++;
+        variant_picks[v]++;
+        if (v == last_variant) {
+          alternated = false;
+        }
+        last_variant = v;
+      }
+    }
+    virtual_now += 600;
+  }
+
+  // Restore the live rotation before judging
+  this->set_time_source(std::function<time_t()>());
+  {
+    std::lock_guard<std::mutex> lock(this->message_mutex_);
+    std::swap(this->message_table_, live_table);
+    this->persistent_messages_.swap(live_persistent);
+    this->ephemeral_messages_.swap(live_ephemeral);
+    this->pack_messages_.swap(live_pack);
+    this->current_message_ = MessageHandle();
+  }
+
+  // Three slots: the group competes like one message, so it never follows itself and never takes
+  // the majority of the airtime the two variants would get as independent candidates
+  ESP_LOGI(TAG, "Variant groups: group shown %d/%d times (variants %d/%d)", group_picks, selections,
+           variant_picks[0], variant_picks[1]);
+  if (!alternated || variant_picks[0] == 0 || variant_picks[1] == 0) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Variant groups: Variants did not alternate");
+    return false;
+  }
+  if (back_to_back || group_picks > selections / 2) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Variant groups: Group took %d of %d slots%s", group_picks, selections,
+             back_to_back ? ", back-to-back" : "");
+    return false;
+  }
+
+  ESP_LOGI(TAG, "Variant group test: PASSED");
+  return true;
+}
+
+bool B48DisplayController::test_message_search() {
+  ESP_LOGI(TAG, "Testing full-text message search...");
+  const char *dbFilenameRelative = "/search_test.db";
+
+  ParkedState parked;
+  time_t virtual_now = std::max<time_t>(time(nullptr), 1700000000);
+  bool success = this->park_live_state(parked, dbFilenameRelative, virtual_now);
+  if (!success) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Search: Could not initialize scratch database");
+  }
+  for (int i = 0; success && i < SEARCH_TEST_ROWS; i++) {
+    char text[64];
+    snprintf(text, sizeof(text), "Odjezd linky %d z nastupiste %d", i, i % 7);
+    success = this->db_manager_->add_persistent_message(30, 1 + i % 99, 101, "Info", text, "", 0, "search", false);
+  }
+  success = success && this->db_manager_->add_persistent_message(45, 48, 101, "Akce", "Grilovačka na střeše v sobotu",
+                                                                 "", 0, "search", false);
+  int target_id = 0;
+  if (success) {
+    for (const auto &entry : this->db_manager_->get_active_persistent_messages()) {
+      target_id = std::max(target_id, entry.message_id);
+    }
+  }
+
+  // Diacritics-insensitive prefixes need the index, plain phrases work either way
+  bool indexed = this->db_manager_->search_index_ready();
+  std::vector<SearchHit> hits;
+  uint32_t elapsed_us = 0;
+  uint32_t slowest_us = 0;
+  bool used_index = false;
+  struct Lookup {
+    const char *query;
+    bool needs_index;  // Relies on prefix or diacritics folding
+    bool expect_target;
+    bool expect_hits;
+  };
+  const Lookup lookups[] = {{"sobotu", false, true, true},
+                            {"strese grilo", true, true, true},
+                            {"Support your", false, false, true},  // Bootstrap message
+                            {"\"--\"", false, false, false}};     // Quotes and punctuation only
+  for (const auto &lookup : lookups) {
+    if (!success || (lookup.needs_index && !indexed)) {
+      continue;
+    }
+    success = this->search_messages(lookup.query, 10, hits, elapsed_us, used_index);
+    slowest_us = std::max(slowest_us, elapsed_us);
+    bool found =
+        std::any_of(hits.begin(), hits.end(), [&](const SearchHit &hit) { return hit.message_id == target_id; });
+    if (success && (found != lookup.expect_target || hits.empty() == lookup.expect_hits)) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Search: '%s' returned %zu hits, message %d %s", lookup.query, hits.size(),
+               target_id, found ? "included" : "missing");
+      success = false;
+    }
+  }
+
+  // Edits are searchable at once, disabled messages drop out
+  if (success) {
+    success = this->db_manager_->update_persistent_message(target_id, 45, true, 48, 101, "Akce",
+                                                           "Grilovačka v neděli", "", 0, "search") &&
+              this->search_messages("sobotu", 10, hits, elapsed_us, used_index) && hits.empty() &&
+              this->search_messages("nedeli", 10, hits, elapsed_us, used_index) && (hits.size() == 1 || !indexed) &&
+              this->db_manager_->delete_persistent_message(target_id) &&
+              this->search_messages("nedeli", 10, hits, elapsed_us, used_index) && hits.empty();
+    if (!success) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Search: Index not updated after edit or delete (%zu hits)", hits.size());
+    }
+  }
+  // FTS5 has cached its own statements by now; none of them may be counted as ours
+  int open_statements = this->db_manager_->get_open_statement_count();
+  if (success && open_statements != 0) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Search: %d statements counted as unfinalized after searching", open_statements);
+    success = false;
+  }
+  int index_bytes = success ? this->db_manager_->search_index_bytes() : -1;
+  int database_bytes = success ? this->db_manager_->database_bytes() : -1;
+
+  this->restore_live_state(parked, dbFilenameRelative);
+
+  ESP_LOGI(TAG, "Search: %d rows, slowest lookup %u us (%s), index ~%d of %d bytes", SEARCH_TEST_ROWS + 9,
+           (unsigned) slowest_us, indexed ? "fts5 index" : "LIKE scan", index_bytes, database_bytes);
+  if (success && indexed && slowest_us > SEARCH_TEST_SLOW_US) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Search: Lookup took %u us", (unsigned) slowest_us);
+    success = false;
+  }
+
+  ESP_LOGI(TAG, "Message search test: %s", success ? "PASSED" : "FAILED");
+  return success;
+}
+
+bool B48DisplayController::test_display_count_limit() {
+  ESP_LOGI(TAG, "Testing count-limited messages...");
+  const char *dbFilenameRelative = "/count_test.db";
+
+  ParkedState parked;
+  time_t virtual_now = std::max<time_t>(time(nullptr), 1700000000);
+  bool success = this->park_live_state(parked, dbFilenameRelative, virtual_now);
+  if (!success) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Display count: Could not initialize scratch database");
+  }
+  // Priority 90 makes it the pick whenever the repeat penalty allows
+  success = success && this->db_manager_->add_persistent_message(90, 48, 101, "Limit", "Shown a few times only", "",
+                                                                 0, "counttest", false, "", COUNT_TEST_LIMIT);
+  int limited_id = 0;
+  if (success) {
+    for (const auto &entry : this->db_manager_->get_active_persistent_messages()) {
+      if (entry.max_displays == COUNT_TEST_LIMIT) {
+        limited_id = entry.message_id;
+      }
+    }
+    success = limited_id > 0 && this->refresh_message_cache();
+  }
+  auto stored_count = [this, &limited_id]() {
+    for (const auto &entry : this->db_manager_->get_active_persistent_messages()) {
+      if (entry.message_id == limited_id) {
+        return entry.display_count;
+      }
+    }
+    return -1;  // Retired
+  };
+  auto cached_count = [this, &limited_id]() {
+    for (MessageHandle handle : this->persistent_messages_) {
+      const MessageEntry *entry = this->message_table_.get(handle);
+      if (entry && entry->message_id == limited_id) {
+        return entry->display_count;
+      }
+    }
+    return -1;
+  };
+  // Past the longest repeat penalty, so only the limit can keep the message off air. Each display is counted
+  // exactly once: not while it waits in cycle 6, and not again by a second interrupt
+  auto show_next = [this, &virtual_now, &limited_id]() {
+    virtual_now += 6000;
+    this->current_message_ = this->select_next_message();
+    const MessageEntry *entry = this->message_table_.get(this->current_message_);
+    if (!entry || entry->message_id != limited_id) {
+      return false;
+    }
+    this->count_current_display();
+    this->current_message_shown_ = true;
+    this->count_current_display();
+    this->count_current_display();
+    return true;
+  };
+
+  // Until the limit, displays are counted in RAM only, kept across a cache refresh and written by one flush
+  int shown = 0;
+  for (int i = 0; success && i < COUNT_TEST_LIMIT - 1; i++) {
+    shown += show_next() ? 1 : 0;
+  }
+  int count_before_flush = success ? stored_count() : -1;
+  success = success && this->refresh_message_cache();
+  int count_after_refresh = success ? cached_count() : -1;
+  success = success && this->flush_display_counts();
+  int count_after_flush = success ? stored_count() : -1;
+
+  // The display that reaches the limit takes the message out of rotation at once, and the queued flush
+  // disables it in the same transaction as the counts
+  int disabled_before = success ? this->db_manager_->count_disabled_messages() : 0;
+  shown += (success && show_next()) ? 1 : 0;
+  bool reselected = success && show_next();
+  this->job_runner_.drain();
+  int retired_count = success ? stored_count() : 0;
+  int disabled_by_flush = success ? this->db_manager_->count_disabled_messages() - disabled_before : 0;
+  success = success && this->refresh_message_cache();
+  bool still_cached = cached_count() >= 0;
+
+  // Ephemeral messages count in RAM only and leave with the next ephemeral check
+  success = success && this->add_message(50, 48, 101, "Limit", "Ephemeral, shown once", "", 600, "counttest", false,
+                                         "", 1);
+  if (success && !this->ephemeral_messages_.empty()) {
+    this->update_message_display_stats(this->ephemeral_messages_.back());
+  }
+  this->check_expired_ephemeral_messages();
+  bool ephemeral_retired = this->ephemeral_messages_.empty();
+
+  this->restore_live_state(parked, dbFilenameRelative);
+
+  ESP_LOGI(TAG, "Display count: shown %d/%d, stored %d before and %d after the flush, %d cached", shown,
+           COUNT_TEST_LIMIT, count_before_flush, count_after_flush, count_after_refresh);
+  if (!success) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Display count: Setup, refresh or flush failed");
+    return false;
+  }
+  if (shown != COUNT_TEST_LIMIT || reselected) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Display count: Shown %d times (limit %d)%s", shown, COUNT_TEST_LIMIT,
+             reselected ? ", selected again after the limit" : "");
+    return false;
+  }
+  if (count_before_flush != 0 || count_after_refresh != COUNT_TEST_LIMIT - 1 ||
+      count_after_flush != COUNT_TEST_LIMIT - 1) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Display count: Counts not kept in RAM until the flush");
+    return false;
+  }
+  if (retired_count != -1 || disabled_by_flush != 1 || still_cached || !ephemeral_retired) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Display count: Not retired (stored %d, %d disabled, cached %s, ephemeral retired %s)",
+             retired_count, disabled_by_flush, YESNO(still_cached), YESNO(ephemeral_retired));
+    return false;
+  }
+
+  ESP_LOGI(TAG, "Display count test: PASSED");
+  return true;
+}
+
+bool B48DisplayController::test_shadow_scheduling() {
+  ESP_LOGI(TAG, "Testing shadow scheduling policies...");
+  const char *dbFilenameRelative = "/shadow_test.db";
+
+  ParkedState parked;
+  time_t virtual_now = std::max<time_t>(time(nullptr), 1700000000);
+  bool success = this->park_live_state(parked, dbFilenameRelative, virtual_now);
+  if (!success) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Shadow scheduling: Could not initialize scratch database");
+  }
+  const char *policies[] = {"round_robin", "oldest_first", "strict_priority", "lottery"};
+  for (const char *policy : policies) {
+    success = success && this->shadow_scheduler_.add_policy(policy);
+  }
+  success = success && this->db_manager_->add_persistent_message(100, 48, 101, "Shadow", "Top priority", "", 0,
+                                                                 "shadowtest", false);
+  success = success && this->refresh_message_cache();
+  auto run_slots = [this, &virtual_now](int slots) {
+    uint32_t slowest_us = 0;
+    for (int i = 0; i < slots; i++) {
+      virtual_now += 60;
+      MessageHandle selected = this->select_next_message();
+      if (!this->message_table_.get(selected)) {
+        return UINT32_MAX;
+      }
+      this->update_message_display_stats(selected);
+      slowest_us = std::max(slowest_us, this->shadow_scheduler_.evaluation_us());
+    }
+    return slowest_us;
+  };
+
+  // Whole rounds of the rotation, so an even policy gives every candidate the same number of picks
+  uint32_t slowest_us = success ? run_slots(1) : UINT32_MAX;
+  size_t rotation = this->shadow_candidates_.size();
+  if (slowest_us != UINT32_MAX) {
+    slowest_us = std::max(slowest_us, run_slots(SHADOW_TEST_ROUNDS * rotation - 1));
+  }
+  std::vector<B48ShadowScheduler::PolicyReport> reports = this->report_scheduling(false);
+
+  // A message leaving the rotation is dropped from every policy's state at the next prune
+  int top_id = 0;
+  for (const auto &entry : this->db_manager_->get_active_persistent_messages()) {
+    if (entry.priority == 100 && entry.static_intro == "Shadow") {
+      top_id = entry.message_id;
+    }
+  }
+  success = success && top_id > 0 && this->db_manager_->delete_persistent_message(top_id);
+  success = success && this->refresh_message_cache();
+  if (success && slowest_us != UINT32_MAX) {
+    slowest_us = std::max(slowest_us, run_slots(B48ShadowScheduler::PRUNE_INTERVAL_SLOTS));
+  }
+  size_t tracked = this->shadow_scheduler_.tracked_candidates();
+  size_t rotation_after_delete = this->shadow_candidates_.size();
+
+  this->restore_live_state(parked, dbFilenameRelative);
+
+  if (!success || slowest_us == UINT32_MAX || reports.size() != 5) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Shadow scheduling: Setup or selection failed");
+    return false;
+  }
+  ESP_LOGI(TAG, "Shadow scheduling: %zu candidates, %u slots, slowest evaluation %u us", rotation,
+           (unsigned) reports[0].slots, (unsigned) slowest_us);
+  const B48ShadowScheduler::PolicyReport &active = reports[0];
+  const B48ShadowScheduler::PolicyReport &round_robin = reports[1];
+  const B48ShadowScheduler::PolicyReport &oldest_first = reports[2];
+  const B48ShadowScheduler::PolicyReport &strict_priority = reports[3];
+  if (active.agreement < 1.0f || active.slots != SHADOW_TEST_ROUNDS * rotation) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Shadow scheduling: Live row agrees %.0f%% over %u slots", active.agreement * 100.0f,
+             (unsigned) active.slots);
+    return false;
+  }
+  if (round_robin.fairness < 0.95f || round_robin.starved != 0 || round_robin.never_picked != 0) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Shadow scheduling: round_robin fairness %.3f, %u starved, %u never picked",
+             round_robin.fairness, (unsigned) round_robin.starved, (unsigned) round_robin.never_picked);
+    return false;
+  }
+  if (oldest_first.never_picked != 0) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Shadow scheduling: oldest_first never picked %u candidates",
+             (unsigned) oldest_first.never_picked);
+    return false;
+  }
+  if (strict_priority.never_picked + 1 != rotation || strict_priority.fairness >= round_robin.fairness) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Shadow scheduling: strict_priority left %u of %zu unpicked (fairness %.3f)",
+             (unsigned) strict_priority.never_picked, rotation, strict_priority.fairness);
+    return false;
+  }
+  if (tracked != rotation_after_delete || rotation_after_delete + 1 != rotation) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Shadow scheduling: %zu candidates tracked after a delete, %zu in the rotation", tracked,
+             rotation_after_delete);
+    return false;
+  }
+  if (slowest_us > SHADOW_TEST_SLOW_US) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Shadow scheduling: Evaluation took %u us (limit %u us)", (unsigned) slowest_us,
+             (unsigned) SHADOW_TEST_SLOW_US);
+    return false;
+  }
+
+  ESP_LOGI(TAG, "Shadow scheduling test: PASSED");
+  return true;
+}
+
+bool B48DisplayController::test_airtime_tuning() {
+  ESP_LOGI(TAG, "Testing airtime ledger and transition tuning...");
+
+  // 1. Ledger: spans go to the state they were spent in, repeated entries of the same state change nothing
+  B48AirtimeLedger ledger;
+  ledger.enter(AIRTIME_TRANSITION, 0);
+  ledger.enter(AIRTIME_CONTENT, 4000);
+  ledger.enter(AIRTIME_CONTENT, 9000);
+  ledger.enter(AIRTIME_FALLBACK, 20000);
+  ledger.enter(AIRTIME_TRANSITION, 30000);
+  if (ledger.total_ms(AIRTIME_CONTENT, 31000) != 16000 || ledger.total_ms(AIRTIME_FALLBACK, 31000) != 10000 ||
+      ledger.total_ms(AIRTIME_TRANSITION, 31000) != 5000 || ledger.entries(AIRTIME_CONTENT) != 1 ||
+      ledger.tracked_ms(31000) != 31000) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Airtime: Ledger totals content %u, fallback %u, transition %u ms",
+             (unsigned) ledger.total_ms(AIRTIME_CONTENT, 31000), (unsigned) ledger.total_ms(AIRTIME_FALLBACK, 31000),
+             (unsigned) ledger.total_ms(AIRTIME_TRANSITION, 31000));
+    return false;
+  }
+
+  // 2. The same traffic with a fixed cycle 6 and with the tuner, on a virtual clock stepping like loop():
+  //    mostly short messages with a long one in between, frames sized exactly as send_commands_for_message()
+  //    sends them and drained at the UART's wire rate
+  std::string long_text;
+  while (long_text.length() < 480) {
+    long_text += "Dlouhé oznámení o provozu hackerspace, čte se celé. ";
+  }
+  MessageEntry messages[2];
+  messages[0].scrolling_message = "Krátká zpráva";
+  messages[1].scrolling_message = long_text;
+  uint32_t frame_bytes[2];
+  uint32_t drained_ms[2];
+  int content_ms[2];
+  for (int i = 0; i < 2; i++) {
+    messages[i].line_number = 48;
+    messages[i].tarif_zone = 101;
+    messages[i].static_intro = "Airtime";
+    messages[i].next_message_hint = "Dalsi";
+    frame_bytes[i] = BUSE120SerialProtocol::build_wire_frame("xC6").length() +
+                     BUSE120SerialProtocol::build_wire_frame(
+                         BUSE120SerialProtocol::line_number_payload(messages[i].line_number)).length() +
+                     BUSE120SerialProtocol::build_wire_frame(
+                         BUSE120SerialProtocol::tarif_zone_payload(messages[i].tarif_zone)).length() +
+                     BUSE120SerialProtocol::build_wire_frame(
+                         BUSE120SerialProtocol::static_intro_payload(messages[i].static_intro)).length() +
+                     BUSE120SerialProtocol::build_wire_frame(
+                         BUSE120SerialProtocol::scrolling_message_payload(messages[i].scrolling_message)).length() +
+                     BUSE120SerialProtocol::build_wire_frame(
+                         BUSE120SerialProtocol::next_message_hint_payload(messages[i].next_message_hint)).length();
+    drained_ms[i] = (this->serial_protocol_.estimate_wire_us(frame_bytes[i]) + 999) / 1000;
+    content_ms[i] = this->calculate_display_duration(messages[i]) * 1000;
+  }
+
+  struct Phase {
+    float ratio;
+    uint32_t cut_short;    // Switched to cycle 0 before the frames were out
+    uint32_t out_of_bounds;
+    uint32_t late;
+  };
+  auto run_phase = [&](B48TransitionTuner &tuner) {
+    Phase phase{};
+    B48AirtimeLedger phase_ledger;
+    uint32_t now_ms = 0;
+    for (int i = 0; i < AIRTIME_TEST_MESSAGES; i++) {
+      int kind = (i % 6 == 5) ? 1 : 0;
+      uint32_t planned = tuner.planned_ms();
+      if (tuner.adaptive() && (planned < tuner.min_ms() || planned > tuner.max_ms())) {
+        phase.out_of_bounds++;
+      }
+      phase_ledger.enter(AIRTIME_TRANSITION, now_ms);
+      uint32_t elapsed = 0;
+      while (!tuner.may_end(elapsed, drained_ms[kind])) {
+        elapsed += AIRTIME_TEST_LOOP_MS;
+      }
+      tuner.record(elapsed, drained_ms[kind], frame_bytes[kind]);
+      bool at_max = tuner.adaptive() && elapsed >= tuner.max_ms();
+      if (elapsed < drained_ms[kind] + B48TransitionTuner::SETTLE_MS && !at_max) {
+        phase.cut_short++;
+      }
+      now_ms += elapsed;
+      phase_ledger.enter(AIRTIME_CONTENT, now_ms);
+      now_ms += content_ms[kind];
+    }
+    phase.ratio = phase_ledger.content_ratio(now_ms);
+    phase.late = tuner.late();
+    return phase;
+  };
+  B48TransitionTuner fixed;
+  fixed.set_fixed_duration(this->transition_duration_ * 1000);
+  B48TransitionTuner tuned;
+  tuned.set_fixed_duration(this->transition_duration_ * 1000);
+  tuned.set_bounds(AIRTIME_TEST_MIN_MS, AIRTIME_TEST_MAX_MS);
+  Phase before = run_phase(fixed);
+  Phase after = run_phase(tuned);
+
+  ESP_LOGI(TAG, "Airtime: frames %u/%u B out after %u/%u ms; content:transition %.2f fixed (%u cut short), "
+           "%.2f tuned (%u cut short, %u held), cycle 6 now %u ms", (unsigned) frame_bytes[0],
+           (unsigned) frame_bytes[1], (unsigned) drained_ms[0], (unsigned) drained_ms[1], before.ratio,
+           (unsigned) before.cut_short, after.ratio, (unsigned) after.cut_short, (unsigned) after.late,
+           (unsigned) tuned.planned_ms());
+  if (after.cut_short != 0 || after.out_of_bounds != 0) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Airtime: Tuned cycle 6 cut %u transitions short, %u planned out of bounds",
+             (unsigned) after.cut_short, (unsigned) after.out_of_bounds);
+    return false;
+  }
+  if (drained_ms[0] + B48TransitionTuner::SETTLE_MS < this->transition_duration_ * 1000u &&
+      after.ratio <= before.ratio) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Airtime: Short frames did not shorten cycle 6 (ratio %.2f -> %.2f)", before.ratio,
+             after.ratio);
+    return false;
+  }
+  if (drained_ms[1] + B48TransitionTuner::SETTLE_MS > this->transition_duration_ * 1000u &&
+      before.cut_short == 0) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Airtime: Fixed cycle 6 never cut long frames short, check the wire estimate");
+    return false;
+  }
+
+  ESP_LOGI(TAG, "Airtime tuning test: PASSED");
+  return true;
+}
+
+bool B48DisplayController::test_job_runner() {
+  ESP_LOGI(TAG, "Testing budgeted background jobs...");
+  const char *dbFilenameRelative = "/job_test.db";
+
+  ParkedState parked;
+  time_t virtual_now = std::max<time_t>(time(nullptr), 1700000000);
+  bool success = this->park_live_state(parked, dbFilenameRelative, virtual_now);
+  if (!success) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Job runner: Could not initialize scratch database");
+  }
+  for (int i = 0; success && i < JOB_TEST_ROWS; i++) {
+    char text[48];
+    snprintf(text, sizeof(text), "Job test message %d", i);
+    success = this->db_manager_->add_persistent_message(30, 1 + i, 101, "Job", text, "", 0, "jobtest", false);
+  }
+  int disabled = 0;
+  if (success) {
+    for (const auto &entry : this->db_manager_->get_active_persistent_messages()) {
+      if (entry.static_intro == "Job" && entry.line_number % 2 == 0) {
+        success = success && this->db_manager_->delete_persistent_message(entry.message_id);
+        disabled++;
+      }
+    }
+  }
+  size_t expected_active = success ? this->db_manager_->get_active_persistent_messages().size() : 0;
+
+  // Purge and cache load run side by side, one step per run() call
+  int calls = 0;
+  bool partial_purge_seen = false;
+  bool load_done_during_purge = false;
+  bool duplicate_purge_queued = false;
+  time_t purge_started = 0;
+  if (success) {
+    success = this->purge_disabled_messages() && this->job_runner_.submit(this->make_cache_load_job());
+    // A second purge while the first is queued is refused and does not restart the interval
+    purge_started = this->last_purge_time_;
+    this->last_purge_time_ = 1;
+    duplicate_purge_queued = this->purge_disabled_messages() || this->last_purge_time_ != 1;
+    this->last_purge_time_ = purge_started;
+  }
+  while (success && !this->job_runner_.idle() && calls < JOB_TEST_CALL_LIMIT) {
+    this->job_runner_.run(JOB_TEST_BUDGET_US);
+    calls++;
+    const B48Job *purge = this->job_runner_.find(PURGE_JOB);
+    if (purge) {
+      partial_purge_seen = partial_purge_seen ||
+                           (purge->progress_done() > 0 && purge->progress_done() < purge->progress_total());
+      load_done_during_purge = load_done_during_purge || !this->job_runner_.is_queued(CACHE_LOAD_JOB);
+    }
+  }
+  bool drained = this->job_runner_.idle();
+  int disabled_left = success ? this->db_manager_->count_disabled_messages() : -1;
+  size_t cached = this->persistent_messages_.size();
+  this->job_runner_.log_report();
+
+  this->restore_live_state(parked, dbFilenameRelative);
+
+  ESP_LOGI(TAG, "Job runner: %d run() calls, %d rows purged, %zu/%zu messages cached", calls, disabled, cached,
+           expected_active);
+  if (!success) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Job runner: Setup or submission failed");
+    return false;
+  }
+  if (duplicate_purge_queued) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Job runner: Second purge reported as queued or moved the purge time");
+    return false;
+  }
+  if (!drained || calls < 2) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Job runner: Jobs did not step across run() calls (%d calls, idle %s)", calls,
+             YESNO(drained));
+    return false;
+  }
+  if (!partial_purge_seen || !load_done_during_purge) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Job runner: Purge progress %s, cache load interleaved %s",
+             partial_purge_seen ? "reported" : "missing", YESNO(load_done_during_purge));
+    return false;
+  }
+  if (disabled_left != 0 || cached != expected_active) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Job runner: %d disabled rows left, %zu of %zu messages cached", disabled_left,
+             cached, expected_active);
+    return false;
+  }
+
+  ESP_LOGI(TAG, "Job runner test: PASSED");
+  return true;
+}
+
+bool B48DisplayController::test_fault_injection() {
+  ESP_LOGI(TAG, "Running fault injection test (default schedule)...");
+  // Malformed schedules from the HA service are rejected, not parsed
+  const char *malformed[] = {" :60:120", ":0:10", "sqlite_step:abc:10", "uart_stall:0:0"};
+  for (const char *schedule : malformed) {
+    B48FaultInjector injector;
+    if (injector.parse_schedule(schedule)) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Fault injection: Accepted malformed schedule '%s'", schedule);
+      return false;
+    }
+  }
+  bool success = this->run_fault_injection("");
+  ESP_LOGI(TAG, "Fault injection test: %s", success ? "PASSED" : "FAILED");
+  return success;
+}
+
+bool B48DisplayController::park_live_state(ParkedState &parked, const char *scratch_db, time_t &virtual_now) {
+  if (LittleFS.exists(scratch_db)) {
+    LittleFS.remove(scratch_db);
+  }
+
+  this->job_runner_.drain();  // Queued jobs belong to the live database
+  parked.db_manager = std::move(this->db_manager_);
+  parked.current_message = this->current_message_;
+  parked.current_message_shown = this->current_message_shown_;
+  {
+    std::lock_guard<std::mutex> lock(this->message_mutex_);
+    std::swap(parked.message_table, this->message_table_);
+    parked.persistent_messages.swap(this->persistent_messages_);
+    parked.ephemeral_messages.swap(this->ephemeral_messages_);
+    parked.pack_messages.swap(this->pack_messages_);
+    parked.pending_display_counts.swap(this->pending_display_counts_);
+    std::swap(parked.shadow_scheduler, this->shadow_scheduler_);
+    this->current_message_ = MessageHandle();
+    this->current_message_shown_ = false;
+  }
+  parked.last_purge_time = this->last_purge_time_;
+  parked.last_ephemeral_check_time = this->last_ephemeral_check_time_;
+  this->last_purge_time_ = 0;
+  this->last_ephemeral_check_time_ = 0;
+  this->cache_refresh_failed_ = false;
+
+  this->db_manager_.reset(new B48DatabaseManager(std::string("/littlefs") + scratch_db));
+  this->set_time_source([&virtual_now]() { return virtual_now; });
+  return this->db_manager_->initialize();
+}
+
+void B48DisplayController::restore_live_state(ParkedState &parked, const char *scratch_db) {
+  this->job_runner_.drain();
+  this->set_time_source(std::function<time_t()>());
+  this->db_manager_ = std::move(parked.db_manager);
+  {
+    std::lock_guard<std::mutex> lock(this->message_mutex_);
+    this->persistent_messages_.swap(parked.persistent_messages);
+    this->ephemeral_messages_.swap(parked.ephemeral_messages);
+    this->pack_messages_.swap(parked.pack_messages);
+    this->pending_display_counts_.swap(parked.pending_display_counts);
+    std::swap(this->shadow_scheduler_, parked.shadow_scheduler);
+    std::swap(this->message_table_, parked.message_table);
+    this->current_message_ = parked.current_message;
+    this->current_message_shown_ = parked.current_message_shown;
+  }
+  this->last_purge_time_ = parked.last_purge_time;
+  this->last_ephemeral_check_time_ = parked.last_ephemeral_check_time;
+  this->cache_refresh_failed_ = false;
+  this->pending_message_cache_refresh_.store(true);
+  LittleFS.remove(scratch_db);
+}
+
+bool B48DisplayController::run_soak_test(int virtual_days) {
+  if (virtual_days < SOAK_WARMUP_DAYS + 2) {
+    ESP_LOGW(TAG, "Soak test needs at least %d virtual days, using that", SOAK_WARMUP_DAYS + 2);
+    virtual_days = SOAK_WARMUP_DAYS + 2;
+  }
+  ESP_LOGI(TAG, "Starting soak test: %d virtual days, %d s per step", virtual_days, SOAK_STEP_SECONDS);
+
+  const char *dbFilenameRelative = "/soak_test.db";
+
+  ParkedState parked;
+  time_t virtual_now = std::max<time_t>(time(nullptr), 1700000000);
+  bool success = this->park_live_state(parked, dbFilenameRelative, virtual_now);
+  if (!success) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Soak: Could not initialize scratch database");
+  }
+
+  const int steps_per_day = 86400 / SOAK_STEP_SECONDS;
+  const int steps_per_refresh = 7200 / SOAK_STEP_SECONDS;
+  std::vector<SoakSample> samples;
+  int ingested = 0;
+  uint32_t start_ms = millis();
+
+  for (int day = 0; success && day < virtual_days; day++) {
+    for (int step = 0; step < steps_per_day; step++) {
+      virtual_now += SOAK_STEP_SECONDS;
+
+      // Persistent ingest with TTLs of 1-3 days, so expiry and purge churn message IDs. Every fourth message is
+      // also count-limited, so display count flushes and their retirements run too.
+      char text[64];
+      snprintf(text, sizeof(text), "Soak zpráva %d den %d", ingested, day);
+      int ttl_days = 1 + (ingested % SOAK_WARMUP_DAYS);
+      this->add_message(20 + (ingested % 60), 1 + (ingested % 99), 101, "Soak", text, "", ttl_days * 86400, "soak",
+                        true, "", ingested % 4 == 0 ? SOAK_MAX_DISPLAYS : 0);
+      // Short-lived ephemeral notification every third step
+      if (step % 3 == 0) {
+        this->add_message(50, 48, 101, "Info", text, "", 900, "soak");
+      }
+      ingested++;
+
+      if (step % steps_per_refresh == 0) {
+        this->check_expired_messages();
+        this->check_expired_ephemeral_messages();
+        this->check_purge_interval();
+        this->job_runner_.drain();  // A due purge runs as a job
+        this->pending_message_cache_refresh_.store(false);
+        this->refresh_message_cache();
+      }
+
+      // A few display cycles per step, exactly as the state machine would record them
+      for (int cycle = 0; cycle < 3; cycle++) {
+        MessageHandle msg = this->select_next_message();
+        if (msg.is_valid()) {
+          this->update_message_display_stats(msg);
+        }
+      }
+
+      yield();
+      esp_task_wdt_reset();
+    }
+
+    SoakSample sample;
+    multi_heap_info_t heap_info;
+    heap_caps_get_info(&heap_info, MALLOC_CAP_8BIT);
+    sample.heap_allocated_bytes = heap_info.total_allocated_bytes;
+    sample.heap_allocated_blocks = heap_info.allocated_blocks;
+    sample.sqlite_memory_used = sqlite3_memory_used();
+    sample.open_statements = this->db_manager_->get_open_statement_count();
+    {
+      std::lock_guard<std::mutex> lock(this->message_mutex_);
+      sample.persistent_cache_size = this->persistent_messages_.size();
+      sample.ephemeral_queue_size = this->ephemeral_messages_.size();
+      sample.message_table_slots = this->message_table_.slot_count();
+    }
+    sample.database_file_size = 0;
+    File db_file = LittleFS.open(dbFilenameRelative, "r");
+    if (db_file) {
+      sample.database_file_size = db_file.size();
+      db_file.close();
+    }
+    samples.push_back(sample);
+
+    ESP_LOGI(TAG,
+             "Soak day %2d: heap %lld B / %lld blocks, sqlite %lld B, stmts %lld, cache %lld, ephemeral %lld, "
+             "slots %lld, file %lld B",
+             day + 1, (long long) sample.heap_allocated_bytes, (long long) sample.heap_allocated_blocks,
+             (long long) sample.sqlite_memory_used, (long long) sample.open_statements,
+             (long long) sample.persistent_cache_size, (long long) sample.ephemeral_queue_size,
+             (long long) sample.message_table_slots, (long long) sample.database_file_size);
+  }
+
+  this->restore_live_state(parked, dbFilenameRelative);
+
+  // Any resource that only ever grows after the warm-up is a leak
+  struct SoakMetric {
+    const char *name;
+    int64_t SoakSample::*field;
+    int64_t tolerance;
+  };
+  static const SoakMetric METRICS[] = {
+      {"heap bytes", &SoakSample::heap_allocated_bytes, 4096},
+      {"heap blocks", &SoakSample::heap_allocated_blocks, 16},
+      {"sqlite memory", &SoakSample::sqlite_memory_used, 4096},
+      {"open statements", &SoakSample::open_statements, 0},
+      {"persistent cache", &SoakSample::persistent_cache_size, 8},
+      {"ephemeral queue", &SoakSample::ephemeral_queue_size, 8},
+      {"message table slots", &SoakSample::message_table_slots, 8},
+      {"database file", &SoakSample::database_file_size, 8192},
+  };
+  size_t warmup = SOAK_WARMUP_DAYS;
+  for (const auto &metric : METRICS) {
+    if (samples.empty()) {
+      break;
+    }
+    std::vector<int64_t> series;
+    for (const auto &sample : samples) {
+      series.push_back(sample.*(metric.field));
+    }
+    if (grows_monotonically(series, warmup, metric.tolerance)) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Soak: %s grew monotonically from %lld to %lld after day %d", metric.name,
+               (long long) series[warmup], (long long) series.back(), SOAK_WARMUP_DAYS);
+      success = false;
+    }
+  }
+  if (success && !samples.empty() && samples.back().open_statements > 0) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Soak: %lld statements left unfinalized", (long long) samples.back().open_statements);
+    success = false;
+  }
+
+  ESP_LOGI(TAG, "Soak test: %s (%d virtual days, %d messages ingested, %u ms)", success ? "PASSED" : "FAILED",
+           virtual_days, ingested, (unsigned) (millis() - start_ms));
+  return success;
+}
+
+bool B48DisplayController::run_fault_injection(const std::string &schedule) {
+#ifndef B48_FAULT_INJECTION
+  (void) schedule;
+  ESP_LOGW(TAG, "Fault injection is not compiled in (set fault_injection: true)");
+  return false;
+#else
+  B48FaultInjector injector;
+  if (!injector.parse_schedule(schedule.empty() ? DEFAULT_FAULT_SCHEDULE : schedule.c_str())) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Fault injection: Invalid schedule");
+    return false;
+  }
+
+  // Observe each fault from its start until the next one starts (or the run ends)
+  std::vector<size_t> order(injector.schedule().size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&injector](size_t a, size_t b) {
+    return injector.schedule()[a].start_s < injector.schedule()[b].start_s;
+  });
+  uint32_t run_end_s = 0;
+  for (const FaultEvent &event : injector.schedule()) {
+    run_end_s = std::max<uint32_t>(run_end_s, event.start_s + event.duration_s + FAULT_RECOVERY_LIMIT_SECONDS);
+  }
+  ESP_LOGI(TAG, "Starting fault injection: %zu faults over %u virtual seconds", order.size(), (unsigned) run_end_s);
+
+  struct FaultOutcome {
+    uint32_t frames_lost = 0;
+    int degraded_cycles = 0;
+    int ingest_failures = 0;
+    int32_t recovery_s = -1;  // From the end of the fault to the start of a normal streak; -1 = never
+  };
+  std::vector<FaultOutcome> outcomes(order.size());
+
+  const char *dbFilenameRelative = "/fault_test.db";
+  ParkedState parked;
+  time_t virtual_now = std::max<time_t>(time(nullptr), 1700000000);
+  bool success = this->park_live_state(parked, dbFilenameRelative, virtual_now);
+  if (!success) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Fault injection: Could not initialize scratch database");
+  }
+  for (int i = 0; success && i < FAULT_SEED_MESSAGES; i++) {
+    char text[96];
+    snprintf(text, sizeof(text), "Provozní zpráva %d: pravidelné oznámení pro návštěvníky hackerspace", i);
+    success = this->add_message(40 + i * 5, 10 + i, 101, "Fault", text, "", 0, "fault", false);
+  }
+  this->pending_message_cache_refresh_.store(false);
+  if (success) {
+    this->refresh_message_cache();
+  }
+
+  // A cycle is normal if a cached message (not the fallback) went out without losing a frame and it is not
+  // a repeat of the previous cycle; a fault has recovered after FAULT_RECOVERY_STREAK normal cycles in a row.
+  injector.set_capture_uart(true);
+  global_fault_injector = &injector;
+  MessageHandle previous;
+  int streak = 0;
+  uint32_t streak_start_s = 0;
+  int baseline_degraded = 0;
+  int cycle = 0;
+  uint32_t elapsed_s = 0;
+  uint32_t next_expiry_check_s = 0;
+  uint32_t start_ms = millis();
+
+  while (success && elapsed_s < run_end_s) {
+    injector.advance(elapsed_s);
+
+    // Fault currently under observation: the latest one that has started
+    int observed = -1;
+    for (size_t i = 0; i < order.size() && injector.schedule()[order[i]].start_s <= elapsed_s; i++) {
+      observed = static_cast<int>(i);
+    }
+
+    // Background work, at the rates loop() uses
+    if (cycle % FAULT_INGEST_CYCLES == 0) {
+      char text[48];
+      snprintf(text, sizeof(text), "Hlášení %d", cycle);
+      bool ephemeral = (cycle / FAULT_INGEST_CYCLES) % 2 == 1;
+      if (!this->add_message(45, 30, 101, "Info", text, "", ephemeral ? 600 : 7200, "fault") && observed >= 0) {
+        outcomes[observed].ingest_failures++;
+      }
+      // Edits from HA refresh the cache too, whether or not the insert made it
+      this->pending_message_cache_refresh_.store(true);
+    }
+    this->check_expired_ephemeral_messages();
+    if (elapsed_s >= next_expiry_check_s) {
+      this->check_expired_messages();
+      next_expiry_check_s = elapsed_s + 3600;
+    }
+    this->check_purge_interval();
+    this->job_runner_.drain();
+    if (this->pending_message_cache_refresh_.exchange(false) || this->cache_refresh_failed_) {
+      this->refresh_message_cache();
+    }
+
+    // One display cycle, sent exactly as run_transition_mode() sends it
+    uint32_t lost_before = injector.frames_lost();
+    this->serial_protocol_.switch_to_cycle(6);
+    MessageHandle msg = this->select_next_message();
+    bool selected = false;
+    {
+      std::lock_guard<std::mutex> lock(this->message_mutex_);
+      const MessageEntry *entry = this->message_table_.get(msg);
+      if (entry) {
+        send_commands_for_message(*entry);
+        selected = true;
+      }
+    }
+    if (!selected) {
+      display_fallback_message();
+    }
+    this->serial_protocol_.switch_to_cycle(0);
+    if (selected) {
+      this->update_message_display_stats(msg);
+    }
+    uint32_t lost = injector.frames_lost() - lost_before;
+    bool normal = selected && lost == 0 && msg != previous;
+    previous = msg;
+
+    if (normal) {
+      if (streak++ == 0) {
+        streak_start_s = elapsed_s;
+      }
+    } else {
+      streak = 0;
+    }
+
+    if (observed < 0) {
+      // Before the first fault; the first cycles only fill the display history
+      if (!normal && cycle >= 2) {
+        baseline_degraded++;
+      }
+    } else {
+      const FaultEvent &event = injector.schedule()[order[observed]];
+      FaultOutcome &outcome = outcomes[observed];
+      outcome.frames_lost += lost;
+      if (!normal) {
+        outcome.degraded_cycles++;
+      }
+      uint32_t fault_end_s = event.start_s + event.duration_s;
+      if (outcome.recovery_s < 0 && streak >= FAULT_RECOVERY_STREAK && elapsed_s >= fault_end_s) {
+        outcome.recovery_s = streak_start_s > fault_end_s ? static_cast<int32_t>(streak_start_s - fault_end_s) : 0;
+      }
+    }
+
+    // Transition plus display time; the fallback keeps the previous duration, as in run_display_message()
+    uint32_t cycle_s = this->transition_duration_ + std::max<uint32_t>(this->current_display_duration_ms_ / 1000, 1);
+    elapsed_s += cycle_s;
+    virtual_now += cycle_s;
+    cycle++;
+
+    yield();
+    esp_task_wdt_reset();
+  }
+
+  global_fault_injector = nullptr;
+  this->restore_live_state(parked, dbFilenameRelative);
+
+  if (baseline_degraded > 0) {
+    ESP_LOGE(TAG, "[TEST][FAIL] Fault injection: Rotation was not steady before the first fault (%d bad cycles)",
+             baseline_degraded);
+    success = false;
+  }
+  ESP_LOGI(TAG, "Fault            | Start s | Dur s | Magnitude | Frames lost | Degraded | Ingest fails | Recovery s");
+  for (size_t i = 0; i < order.size(); i++) {
+    const FaultEvent &event = injector.schedule()[order[i]];
+    const FaultOutcome &outcome = outcomes[i];
+    ESP_LOGI(TAG, "%-16s | %7u | %5u | %9ld | %11u | %8d | %12d | %s%ld", B48FaultInjector::type_name(event.type),
+             (unsigned) event.start_s, (unsigned) event.duration_s, (long) event.magnitude,
+             (unsigned) outcome.frames_lost, outcome.degraded_cycles, outcome.ingest_failures,
+             outcome.recovery_s < 0 ? "never " : "", (long) outcome.recovery_s);
+    if (outcome.recovery_s < 0) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Fault injection: No normal rotation after %s at t=%u s",
+               B48FaultInjector::type_name(event.type), (unsigned) event.start_s);
+      success = false;
+    }
+    // Only a UART fault can keep frames off the display; database and clock faults must not disturb the rotation
+    if (event.type != FaultType::UART_STALL && outcome.degraded_cycles > 0) {
+      ESP_LOGE(TAG, "[TEST][FAIL] Fault injection: %s at t=%u s disturbed %d display cycles",
+               B48FaultInjector::type_name(event.type), (unsigned) event.start_s, outcome.degraded_cycles);
+      success = false;
+    }
+  }
+  ESP_LOGI(TAG, "Fault injection: %s (%d cycles, %u injected SQLite failures, %u frames delivered, %u ms)",
+           success ? "PASSED" : "FAILED", cycle, (unsigned) injector.injected_sqlite_failures(),
+           (unsigned) injector.frames_delivered(), (unsigned) (millis() - start_ms));
+  return success;
+#endif
+}
+
 }  // namespace b48_display_controller
-}  // namespace esphome
\ No newline at end of file
+}  // namespace esphome
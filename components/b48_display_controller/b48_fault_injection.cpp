@@ -0,0 +1,179 @@
+#include "b48_fault_injection.h"
+#include "esphome/core/log.h"
+#include <sqlite3.h>
+#include <cstdlib>
+#include <cstring>
+
+namespace esphome {
+namespace b48_display_controller {
+
+static const char *const TAG = "b48c.fault";
+
+B48FaultInjector *global_fault_injector = nullptr;
+
+static const char *const FAULT_TYPE_NAMES[] = {"sqlite_step", "filesystem_full", "uart_stall", "clock_jump"};
+
+const char *B48FaultInjector::type_name(FaultType type) { return FAULT_TYPE_NAMES[static_cast<size_t>(type)]; }
+
+bool B48FaultInjector::parse_schedule(const std::string &script) {
+  this->schedule_.clear();
+  size_t pos = 0;
+  while (pos < script.size()) {
+    size_t end = script.find(';', pos);
+    if (end == std::string::npos) {
+      end = script.size();
+    }
+    std::string entry = script.substr(pos, end - pos);
+    pos = end + 1;
+    if (entry.find_first_not_of(" \t") == std::string::npos) {
+      continue;
+    }
+
+    // type:start:duration[:magnitude]
+    std::vector<std::string> fields;
+    size_t field_pos = 0;
+    while (true) {
+      size_t colon = entry.find(':', field_pos);
+      fields.push_back(entry.substr(field_pos, colon == std::string::npos ? std::string::npos : colon - field_pos));
+      if (colon == std::string::npos) {
+        break;
+      }
+      field_pos = colon + 1;
+    }
+    if (fields.size() < 3 || fields.size() > 4) {
+      ESP_LOGE(TAG, "Fault schedule entry '%s' needs type:start:duration[:magnitude]", entry.c_str());
+      this->schedule_.clear();
+      return false;
+    }
+
+    size_t type_start = fields[0].find_first_not_of(" \t");
+    if (type_start == std::string::npos) {
+      ESP_LOGE(TAG, "Fault schedule entry '%s' has no fault type", entry.c_str());
+      this->schedule_.clear();
+      return false;
+    }
+    size_t type_end = fields[0].find_last_not_of(" \t");
+    std::string type_name = fields[0].substr(type_start, type_end - type_start + 1);
+    FaultEvent event;
+    bool known = false;
+    for (size_t i = 0; i < sizeof(FAULT_TYPE_NAMES) / sizeof(FAULT_TYPE_NAMES[0]); i++) {
+      if (type_name == FAULT_TYPE_NAMES[i]) {
+        event.type = static_cast<FaultType>(i);
+        known = true;
+      }
+    }
+    char *parse_end = nullptr;
+    event.start_s = strtoul(fields[1].c_str(), &parse_end, 10);
+    bool numbers_ok = parse_end != fields[1].c_str() && *parse_end == '\0';
+    event.duration_s = strtoul(fields[2].c_str(), &parse_end, 10);
+    numbers_ok = numbers_ok && parse_end != fields[2].c_str() && *parse_end == '\0';
+    event.magnitude = 0;
+    if (fields.size() == 4) {
+      event.magnitude = strtol(fields[3].c_str(), &parse_end, 10);
+      numbers_ok = numbers_ok && parse_end != fields[3].c_str() && *parse_end == '\0';
+    }
+    if (!known || !numbers_ok || event.duration_s == 0) {
+      ESP_LOGE(TAG, "Invalid fault schedule entry '%s'", entry.c_str());
+      this->schedule_.clear();
+      return false;
+    }
+    this->schedule_.push_back(event);
+  }
+  return !this->schedule_.empty();
+}
+
+int B48FaultInjector::advance(uint32_t elapsed_s) {
+  bool active[4] = {false, false, false, false};
+  int32_t clock_offset = 0;
+  int started = -1;
+  for (size_t i = 0; i < this->schedule_.size(); i++) {
+    const FaultEvent &event = this->schedule_[i];
+    if (elapsed_s < event.start_s || elapsed_s - event.start_s >= event.duration_s) {
+      continue;
+    }
+    active[static_cast<size_t>(event.type)] = true;
+    if (event.type == FaultType::CLOCK_JUMP) {
+      clock_offset += event.magnitude;
+    }
+    if (started < 0 && !this->active_[static_cast<size_t>(event.type)]) {
+      started = static_cast<int>(i);
+    }
+  }
+
+  for (size_t i = 0; i < 4; i++) {
+    if (active[i] != this->active_[i]) {
+      ESP_LOGI(TAG, "Fault %s %s at t=%u s", FAULT_TYPE_NAMES[i], active[i] ? "injected" : "cleared",
+               (unsigned) elapsed_s);
+    }
+    this->active_[i] = active[i];
+  }
+  this->clock_offset_ = clock_offset;
+  return started;
+}
+
+void B48FaultInjector::clear_active() {
+  for (bool &active : this->active_) {
+    active = false;
+  }
+  this->clock_offset_ = 0;
+}
+
+bool B48FaultInjector::any_active() const {
+  for (bool active : this->active_) {
+    if (active) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int B48FaultInjector::sqlite_step_fault(bool writes) {
+  if (this->is_active(FaultType::SQLITE_STEP)) {
+    this->injected_sqlite_failures_++;
+    return SQLITE_IOERR;
+  }
+  if (writes && this->is_active(FaultType::FILESYSTEM_FULL)) {
+    this->injected_sqlite_failures_++;
+    return SQLITE_FULL;
+  }
+  return SQLITE_OK;
+}
+
+int B48FaultInjector::sqlite_exec_fault(const char *sql) {
+  // Plain queries still work on a full filesystem; anything else may need to write pages or the journal
+  const char *p = sql;
+  while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+    p++;
+  }
+  bool reads_only = strncasecmp(p, "SELECT", 6) == 0 || (strncasecmp(p, "PRAGMA", 6) == 0 && strchr(p, '=') == nullptr);
+  return this->sqlite_step_fault(!reads_only);
+}
+
+B48FaultInjector::UartAction B48FaultInjector::intercept_uart_write(const uint8_t *data, size_t length,
+                                                                     bool single_frame) {
+  size_t frames = single_frame ? 1 : count_frames(data, length);
+  if (this->is_active(FaultType::UART_STALL)) {
+    this->frames_lost_ += frames;
+    return UART_DROPPED;
+  }
+  if (this->capture_uart_) {
+    this->frames_delivered_ += frames;
+    return UART_CAPTURED;
+  }
+  return UART_PASS;
+}
+
+size_t B48FaultInjector::count_frames(const uint8_t *data, size_t length) {
+  // Each frame is payload, CR, checksum; payloads never contain CR, so skip the byte after every CR
+  size_t frames = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (data[i] == 0x0D) {
+      frames++;
+      i++;
+    }
+  }
+  return frames;
+}
+
+}  // namespace b48_display_controller
+}  // namespace esphome
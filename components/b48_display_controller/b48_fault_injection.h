@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <ctime>
+#include <string>
+#include <vector>
+
+// Builds opt in with `fault_injection: true`, which passes -DB48_FAULT_INJECTION to every translation unit.
+// Without it none of the hooks below exist.
+
+namespace esphome {
+namespace b48_display_controller {
+
+enum class FaultType : uint8_t {
+  SQLITE_STEP,      // Every sqlite3_step()/exec fails with SQLITE_IOERR
+  FILESYSTEM_FULL,  // Writing statements fail with SQLITE_FULL, reads still work
+  UART_STALL,       // Serial writes time out; the frames never reach the display
+  CLOCK_JUMP,       // Wall clock is off by `magnitude` seconds until the next time sync corrects it
+};
+
+// One scripted fault: active from start_s for duration_s seconds of run time
+struct FaultEvent {
+  FaultType type;
+  uint32_t start_s;
+  uint32_t duration_s;
+  int32_t magnitude;  // Clock offset in seconds for CLOCK_JUMP, unused otherwise
+};
+
+/**
+ * @brief Scripted fault schedule plus the hooks the database manager, serial protocol and clock consult.
+ *
+ * The schedule is driven by advance() with the run's elapsed time; the hooks only answer "fail this call?"
+ * and count what they broke. Publish the injector through global_fault_injector for the duration of a run.
+ */
+class B48FaultInjector {
+ public:
+  // Result of intercept_uart_write()
+  enum UartAction : uint8_t {
+    UART_PASS,      // Not capturing: write to the UART as usual
+    UART_CAPTURED,  // Counted as delivered but kept off the wire
+    UART_DROPPED,   // Lost to an injected stall
+  };
+
+  /**
+   * @brief Parse a schedule like "sqlite_step:60:120;filesystem_full:600:300;clock_jump:1800:600:-86400"
+   * (type:start_s:duration_s[:magnitude], entries separated by ';')
+   * @return false (and leaves the schedule empty) on a syntax error
+   */
+  bool parse_schedule(const std::string &script);
+  void set_schedule(const std::vector<FaultEvent> &events) { this->schedule_ = events; }
+  const std::vector<FaultEvent> &schedule() const { return this->schedule_; }
+
+  /**
+   * @brief Activate and clear scheduled faults for the given run time
+   * @return Index of the event that became active, or -1 if none did
+   */
+  int advance(uint32_t elapsed_s);
+  void clear_active();
+  bool is_active(FaultType type) const { return this->active_[static_cast<size_t>(type)]; }
+  bool any_active() const;
+
+  // Keep UART writes off the wire while a run drives the real send paths
+  void set_capture_uart(bool capture) { this->capture_uart_ = capture; }
+
+  // --- Hooks ---
+  int sqlite_step_fault(bool writes);          // SQLITE_OK, or the result code the call must fail with
+  int sqlite_exec_fault(const char *sql);      // Same for sqlite3_exec with a SQL string
+  UartAction intercept_uart_write(const uint8_t *data, size_t length, bool single_frame);
+  time_t adjust_clock(time_t now) const { return now + this->clock_offset_; }
+
+  // --- Counters (since construction) ---
+  uint32_t injected_sqlite_failures() const { return this->injected_sqlite_failures_; }
+  uint32_t frames_lost() const { return this->frames_lost_; }
+  uint32_t frames_delivered() const { return this->frames_delivered_; }
+
+  static const char *type_name(FaultType type);
+
+ protected:
+  static size_t count_frames(const uint8_t *data, size_t length);
+
+  std::vector<FaultEvent> schedule_;
+  bool active_[4]{false, false, false, false};
+  int32_t clock_offset_{0};
+  bool capture_uart_{false};
+
+  uint32_t injected_sqlite_failures_{0};
+  uint32_t frames_lost_{0};
+  uint32_t frames_delivered_{0};
+};
+
+// Set while a fault-injection run is in progress; nullptr means no hook interferes
+extern B48FaultInjector *global_fault_injector;
+
+}  // namespace b48_display_controller
+}  // namespace esphome
@@ -57,6 +57,40 @@ void B48HAIntegration::register_services_() {
   register_service(&B48HAIntegration::handle_pause_state_machine_service_, "pause_display_state_machine");
   register_service(&B48HAIntegration::handle_resume_state_machine_service_, "resume_display_state_machine");
 
+  // Register service for the long-run soak test (runs on a scratch database with a virtual clock)
+  register_service(&B48HAIntegration::handle_run_soak_test_service_, "run_soak_test", {"virtual_days"});
+
+  // Register service for scripted fault injection (only does something in builds with fault_injection: true)
+  register_service(&B48HAIntegration::handle_run_fault_injection_service_, "run_fault_injection", {"schedule"});
+
+  // Register service for the content pack staging check (erases the inactive pack slot, so never run at startup)
+  register_service(&B48HAIntegration::handle_run_content_pack_staging_test_service_,
+                   "run_content_pack_staging_test");
+
+  // Register services for the memory-mapped content pack
+  register_service(&B48HAIntegration::handle_export_content_pack_service_, "export_content_pack");
+  register_service(&B48HAIntegration::handle_reload_content_pack_service_, "reload_content_pack");
+  register_service(&B48HAIntegration::handle_content_pack_upload_begin_service_, "content_pack_upload_begin",
+                   {"total_size"});
+  register_service(&B48HAIntegration::handle_content_pack_upload_chunk_service_, "content_pack_upload_chunk",
+                   {"offset", "data"});
+  register_service(&B48HAIntegration::handle_content_pack_upload_finish_service_, "content_pack_upload_finish");
+
+  // Register service for formatting the deferred hot-path log ring
+  register_service(&B48HAIntegration::handle_dump_log_ring_service_, "dump_log_ring", {"clear"});
+
+  // Register service for full-text message search (results arrive as an esphome.b48_search_results event)
+  register_service(&B48HAIntegration::handle_search_messages_service_, "search_messages", {"query", "limit"});
+
+  // Register service for reporting background job progress and time
+  register_service(&B48HAIntegration::handle_report_jobs_service_, "report_jobs");
+
+  // Register service for comparing the live scheduler with the shadow policies
+  register_service(&B48HAIntegration::handle_report_scheduling_service_, "report_scheduling", {"reset"});
+
+  // Register service for reporting display time per state and the cycle 6 tuning
+  register_service(&B48HAIntegration::handle_report_airtime_service_, "report_airtime", {"reset"});
+
   ESP_LOGD(TAG, "Service registration complete.");
 }
 
@@ -176,9 +210,9 @@ void B48HAIntegration::handle_purge_disabled_messages_service_() {
   if (parent_) {
     bool success = parent_->purge_disabled_messages();
     if (success) {
-      ESP_LOGI(TAG, "Successfully purged disabled messages via HA service");
+      ESP_LOGI(TAG, "Purge queued as a background job (progress via report_jobs)");
     } else {
-      ESP_LOGE(TAG, "Failed to purge disabled messages via HA service");
+      ESP_LOGE(TAG, "Purge not queued (database unavailable or a purge already running)");
     }
   } else {
     ESP_LOGE(TAG, "Cannot purge disabled messages - parent controller not available");
@@ -228,6 +262,204 @@ void B48HAIntegration::handle_resume_state_machine_service_() {
   }
 }
 
+// --- Soak Test Service Handler ---
+
+void B48HAIntegration::handle_run_soak_test_service_(int virtual_days) {
+  ESP_LOGI(TAG, "Service run_soak_test called: virtual_days=%d", virtual_days);
+  if (parent_) {
+    bool passed = parent_->run_soak_test(virtual_days);
+    ESP_LOGI(TAG, "Soak test %s via HA service.", passed ? "passed" : "failed");
+  } else {
+    ESP_LOGE(TAG, "Cannot run soak test - parent controller not available.");
+  }
+}
+
+// --- Fault Injection Service Handler ---
+
+void B48HAIntegration::handle_run_fault_injection_service_(std::string schedule) {
+  ESP_LOGI(TAG, "Service run_fault_injection called: schedule='%s'", schedule.c_str());
+  if (parent_) {
+    bool passed = parent_->run_fault_injection(schedule);
+    ESP_LOGI(TAG, "Fault injection run %s via HA service.", passed ? "passed" : "failed");
+  } else {
+    ESP_LOGE(TAG, "Cannot run fault injection - parent controller not available.");
+  }
+}
+
+// --- Content Pack Staging Test Service Handler ---
+
+void B48HAIntegration::handle_run_content_pack_staging_test_service_() {
+  ESP_LOGI(TAG, "Service run_content_pack_staging_test called.");
+  if (parent_) {
+    bool passed = parent_->run_content_pack_staging_test();
+    ESP_LOGI(TAG, "Content pack staging test %s via HA service.", passed ? "passed" : "failed");
+  } else {
+    ESP_LOGE(TAG, "Cannot run content pack staging test - parent controller not available.");
+  }
+}
+
+// --- Content Pack Service Handlers ---
+
+void B48HAIntegration::handle_export_content_pack_service_() {
+  ESP_LOGI(TAG, "Service export_content_pack called.");
+  if (parent_) {
+    if (parent_->export_content_pack()) {
+      ESP_LOGI(TAG, "Content pack exported via HA service.");
+    } else {
+      ESP_LOGE(TAG, "Failed to export content pack via HA service.");
+    }
+  } else {
+    ESP_LOGE(TAG, "Cannot export content pack - parent controller not available.");
+  }
+}
+
+void B48HAIntegration::handle_reload_content_pack_service_() {
+  ESP_LOGI(TAG, "Service reload_content_pack called.");
+  if (parent_) {
+    parent_->load_content_pack();
+  } else {
+    ESP_LOGE(TAG, "Cannot reload content pack - parent controller not available.");
+  }
+}
+
+void B48HAIntegration::handle_content_pack_upload_begin_service_(int total_size) {
+  ESP_LOGI(TAG, "Service content_pack_upload_begin called: total_size=%d", total_size);
+  if (parent_) {
+    if (!parent_->begin_content_pack_upload(total_size)) {
+      ESP_LOGE(TAG, "Failed to start content pack upload.");
+    }
+  } else {
+    ESP_LOGE(TAG, "Cannot start content pack upload - parent controller not available.");
+  }
+}
+
+void B48HAIntegration::handle_content_pack_upload_chunk_service_(int offset, std::string data) {
+  ESP_LOGD(TAG, "Service content_pack_upload_chunk called: offset=%d, %u base64 chars", offset, (unsigned) data.size());
+  if (parent_) {
+    if (!parent_->write_content_pack_chunk(offset, data)) {
+      ESP_LOGE(TAG, "Failed to write content pack chunk at offset %d.", offset);
+    }
+  } else {
+    ESP_LOGE(TAG, "Cannot write content pack chunk - parent controller not available.");
+  }
+}
+
+void B48HAIntegration::handle_content_pack_upload_finish_service_() {
+  ESP_LOGI(TAG, "Service content_pack_upload_finish called.");
+  if (parent_) {
+    if (parent_->finish_content_pack_upload()) {
+      ESP_LOGI(TAG, "Content pack upload complete and loaded.");
+    } else {
+      ESP_LOGE(TAG, "Uploaded content pack failed validation.");
+    }
+  } else {
+    ESP_LOGE(TAG, "Cannot finish content pack upload - parent controller not available.");
+  }
+}
+
+void B48HAIntegration::handle_dump_log_ring_service_(bool clear) {
+  ESP_LOGI(TAG, "Service dump_log_ring called: clear=%s", clear ? "true" : "false");
+  if (parent_) {
+    parent_->dump_log_ring(clear);
+  } else {
+    ESP_LOGE(TAG, "Cannot dump log ring - parent controller not available.");
+  }
+}
+
+void B48HAIntegration::handle_search_messages_service_(std::string query, int limit) {
+  ESP_LOGI(TAG, "Service search_messages called: query='%s', limit=%d", query.c_str(), limit);
+  if (!parent_) {
+    ESP_LOGE(TAG, "Cannot search messages - parent controller not available.");
+    return;
+  }
+
+  std::vector<SearchHit> hits;
+  uint32_t elapsed_us = 0;
+  bool used_index = false;
+  bool ok = parent_->search_messages(query, limit, hits, elapsed_us, used_index);
+
+  // ids: "12,37"; results: one "id: snippet" line per hit, newest first
+  std::string ids;
+  std::string results;
+  for (const auto &hit : hits) {
+    if (!ids.empty()) {
+      ids += ",";
+      results += "\n";
+    }
+    ids += std::to_string(hit.message_id);
+    results += std::to_string(hit.message_id) + ": " + hit.snippet;
+  }
+  fire_homeassistant_event("esphome.b48_search_results", {{"query", query},
+                                                          {"success", ok ? "true" : "false"},
+                                                          {"count", std::to_string(hits.size())},
+                                                          {"ids", ids},
+                                                          {"results", results},
+                                                          {"mode", used_index ? "fts5" : "like"},
+                                                          {"elapsed_us", std::to_string(elapsed_us)}});
+}
+
+void B48HAIntegration::handle_report_jobs_service_() {
+  ESP_LOGI(TAG, "Service report_jobs called");
+  if (parent_) {
+    parent_->log_job_report();
+  } else {
+    ESP_LOGE(TAG, "Cannot report jobs - parent controller not available.");
+  }
+}
+
+void B48HAIntegration::handle_report_scheduling_service_(bool reset) {
+  ESP_LOGI(TAG, "Service report_scheduling called: reset=%s", reset ? "true" : "false");
+  if (!parent_) {
+    ESP_LOGE(TAG, "Cannot report scheduling - parent controller not available.");
+    return;
+  }
+
+  // policies: one "name: fairness, longest wait, starved, never picked, agreement, pick us" line per policy
+  std::vector<B48ShadowScheduler::PolicyReport> reports = parent_->report_scheduling(reset);
+  std::string policies;
+  for (const auto &report : reports) {
+    char line[160];
+    snprintf(line, sizeof(line), "%s: fairness %.3f, longest wait %u, starved %u, never picked %u, agree %.0f%%, "
+             "pick %u/%u us", report.name, report.fairness, (unsigned) report.longest_wait, (unsigned) report.starved,
+             (unsigned) report.never_picked, report.agreement * 100.0f, (unsigned) report.average_pick_us,
+             (unsigned) report.longest_pick_us);
+    if (!policies.empty()) {
+      policies += "\n";
+    }
+    policies += line;
+  }
+  fire_homeassistant_event("esphome.b48_scheduling_report",
+                           {{"slots", std::to_string(reports.empty() ? 0 : reports[0].slots)},
+                            {"policies", policies}});
+}
+
+void B48HAIntegration::handle_report_airtime_service_(bool reset) {
+  ESP_LOGI(TAG, "Service report_airtime called: reset=%s", reset ? "true" : "false");
+  if (!parent_) {
+    ESP_LOGE(TAG, "Cannot report airtime - parent controller not available.");
+    return;
+  }
+
+  AirtimeSummary summary = parent_->report_airtime(reset);
+  auto format = [](float value, const char *spec) {
+    char text[16];
+    snprintf(text, sizeof(text), spec, value);
+    return std::string(text);
+  };
+  fire_homeassistant_event("esphome.b48_airtime_report",
+                           {{"tracked_s", std::to_string(summary.tracked_s)},
+                            {"transition_share", format(summary.share[AIRTIME_TRANSITION], "%.3f")},
+                            {"content_share", format(summary.share[AIRTIME_CONTENT], "%.3f")},
+                            {"fallback_share", format(summary.share[AIRTIME_FALLBACK], "%.3f")},
+                            {"paused_share", format(summary.share[AIRTIME_PAUSED], "%.3f")},
+                            {"content_ratio", format(summary.content_ratio, "%.2f")},
+                            {"fixed_ratio", format(summary.fixed_ratio, "%.2f")},
+                            {"transitions", std::to_string(summary.transitions)},
+                            {"late", std::to_string(summary.late)},
+                            {"planned_ms", std::to_string(summary.planned_ms)},
+                            {"average_drain_ms", std::to_string(summary.average_drain_ms)}});
+}
+
 // --- Sensor Update Method ---
 
 void B48HAIntegration::publish_queue_size(int size) {
@@ -64,6 +64,37 @@ class B48HAIntegration : public Component, public api::CustomAPIDevice {
   void handle_pause_state_machine_service_();
   void handle_resume_state_machine_service_();
 
+  // Long-run soak test service handler
+  void handle_run_soak_test_service_(int virtual_days);
+
+  // Fault injection service handler (empty schedule = default)
+  void handle_run_fault_injection_service_(std::string schedule);
+
+  // Content pack staging check (overwrites the inactive pack slot)
+  void handle_run_content_pack_staging_test_service_();
+
+  // --- Content Pack Service Handlers ---
+  void handle_export_content_pack_service_();
+  void handle_reload_content_pack_service_();
+  void handle_content_pack_upload_begin_service_(int total_size);
+  void handle_content_pack_upload_chunk_service_(int offset, std::string data);
+  void handle_content_pack_upload_finish_service_();
+
+  // Deferred-format log ring service handler
+  void handle_dump_log_ring_service_(bool clear);
+
+  // Message search service handler (fires esphome.b48_search_results)
+  void handle_search_messages_service_(std::string query, int limit);
+
+  // Background job report service handler
+  void handle_report_jobs_service_();
+
+  // Scheduling policy comparison service handler (fires esphome.b48_scheduling_report)
+  void handle_report_scheduling_service_(bool reset);
+
+  // Airtime ledger and transition tuning service handler (fires esphome.b48_airtime_report)
+  void handle_report_airtime_service_(bool reset);
+
   // --- Member Variables ---
   B48DisplayController *parent_; // Pointer to the main controller component
 
@@ -0,0 +1,152 @@
+#include "b48_job.h"
+#include "esphome/core/log.h"
+#include <Arduino.h>  // For micros() and millis()
+#include <cstring>
+
+namespace esphome {
+namespace b48_display_controller {
+
+static const char *const TAG = "b48c.job";
+
+bool B48Job::step() {
+  if (this->finished_) {
+    return false;
+  }
+  if (this->steps_ == 0) {
+    this->started_ms_ = millis();
+  }
+  uint32_t start_us = micros();
+  bool more = this->step_(*this) && !this->failed_;
+  uint32_t elapsed_us = micros() - start_us;
+  this->steps_++;
+  this->busy_us_ += elapsed_us;
+  if (elapsed_us > this->longest_step_us_) {
+    this->longest_step_us_ = elapsed_us;
+  }
+  if (!more) {
+    this->finished_ = true;
+    this->finished_ms_ = millis();
+  }
+  return more;
+}
+
+uint32_t B48Job::wall_ms() const {
+  if (this->steps_ == 0) {
+    return 0;
+  }
+  return (this->finished_ ? this->finished_ms_ : millis()) - this->started_ms_;
+}
+
+bool B48JobRunner::submit(std::unique_ptr<B48Job> job) {
+  if (this->is_queued(job->name())) {
+    ESP_LOGD(TAG, "Job %s already queued", job->name());
+    return false;
+  }
+  ESP_LOGD(TAG, "Queued job %s", job->name());
+  this->queue_.push_back(std::move(job));
+  return true;
+}
+
+bool B48JobRunner::is_queued(const char *name) const { return this->find(name) != nullptr; }
+
+const B48Job *B48JobRunner::find(const char *name) const {
+  for (const auto &job : this->queue_) {
+    if (strcmp(job->name(), name) == 0) {
+      return job.get();
+    }
+  }
+  return nullptr;
+}
+
+size_t B48JobRunner::run(uint32_t budget_us) {
+  if (this->queue_.empty()) {
+    return 0;
+  }
+
+  uint32_t start_us = micros();
+  size_t steps = 0;
+  while (!this->queue_.empty()) {
+    B48Job &job = *this->queue_.front();
+    uint32_t used_us = micros() - start_us;
+    if (steps > 0 && used_us + job.average_step_us() > budget_us) {
+      break;
+    }
+
+    bool more = job.step();
+    steps++;
+    std::unique_ptr<B48Job> current = std::move(this->queue_.front());
+    this->queue_.pop_front();
+    if (more) {
+      this->queue_.push_back(std::move(current));  // Round-robin, so one long job cannot starve the others
+    } else {
+      this->finish(*current);
+    }
+
+    if (micros() - start_us >= budget_us) {
+      break;
+    }
+  }
+
+  uint32_t elapsed_us = micros() - start_us;
+  this->run_calls_++;
+  this->total_busy_us_ += elapsed_us;
+  if (elapsed_us > budget_us) {
+    this->budget_overruns_++;
+  }
+  if (elapsed_us > this->longest_run_us_) {
+    this->longest_run_us_ = elapsed_us;
+  }
+  return steps;
+}
+
+void B48JobRunner::drain() {
+  while (!this->queue_.empty()) {
+    this->run(UINT32_MAX);
+  }
+}
+
+bool B48JobRunner::run_to_completion(B48Job &job) {
+  while (job.step()) {
+  }
+  if (job.on_finish_) {
+    job.on_finish_(job);
+  }
+  return !job.failed();
+}
+
+void B48JobRunner::finish(B48Job &job) {
+  ESP_LOGI(TAG, "Job %s %s: %u/%u after %u steps, %u us busy (longest step %u us) over %u ms", job.name(),
+           job.failed() ? "failed" : "done", (unsigned) job.progress_done(), (unsigned) job.progress_total(),
+           (unsigned) job.steps(), (unsigned) job.busy_us(), (unsigned) job.longest_step_us(),
+           (unsigned) job.wall_ms());
+  if (job.on_finish_) {
+    job.on_finish_(job);
+  }
+
+  JobSummary summary{job.name(),  job.failed(),  job.progress_done(),     job.progress_total(),
+                     job.steps(), job.busy_us(), job.longest_step_us(), job.wall_ms()};
+  if (this->history_.size() >= HISTORY_SIZE) {
+    this->history_.erase(this->history_.begin());
+  }
+  this->history_.push_back(summary);
+}
+
+void B48JobRunner::log_report() const {
+  ESP_LOGI(TAG, "Jobs: %zu queued, %u run() calls, %u us busy, longest call %u us, %u over budget",
+           this->queue_.size(), (unsigned) this->run_calls_, (unsigned) this->total_busy_us_,
+           (unsigned) this->longest_run_us_, (unsigned) this->budget_overruns_);
+  for (const auto &job : this->queue_) {
+    ESP_LOGI(TAG, "  running  %-14s %u/%u, %u steps, %u us busy (longest %u us), %u ms so far", job->name(),
+             (unsigned) job->progress_done(), (unsigned) job->progress_total(), (unsigned) job->steps(),
+             (unsigned) job->busy_us(), (unsigned) job->longest_step_us(), (unsigned) job->wall_ms());
+  }
+  for (const auto &summary : this->history_) {
+    ESP_LOGI(TAG, "  %-8s %-14s %u/%u, %u steps, %u us busy (longest %u us), %u ms",
+             summary.failed ? "failed" : "done", summary.name, (unsigned) summary.progress_done,
+             (unsigned) summary.progress_total, (unsigned) summary.steps, (unsigned) summary.busy_us,
+             (unsigned) summary.longest_step_us, (unsigned) summary.wall_ms);
+  }
+}
+
+}  // namespace b48_display_controller
+}  // namespace esphome
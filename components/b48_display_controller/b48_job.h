@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace esphome {
+namespace b48_display_controller {
+
+/**
+ * @brief Resumable unit of background work (purge, vacuum, cache load, bootstrap, backfill).
+ *
+ * The step function does one bounded piece of work and returns true while more remains. Jobs keep their
+ * own position between steps, so the runner can stop after any step and continue on the next loop().
+ */
+class B48Job {
+ public:
+  using StepFunction = std::function<bool(B48Job &job)>;
+  using FinishFunction = std::function<void(B48Job &job)>;
+
+  B48Job(const char *name, StepFunction step, FinishFunction on_finish = nullptr)
+      : name_(name), step_(std::move(step)), on_finish_(std::move(on_finish)) {}
+
+  const char *name() const { return this->name_; }
+
+  /**
+   * @brief Run one step and account its time
+   * @return true while the job has more work
+   */
+  bool step();
+
+  // Called from step functions
+  void set_progress(uint32_t done, uint32_t total) {
+    this->progress_done_ = done;
+    this->progress_total_ = total;
+  }
+  void fail() { this->failed_ = true; }
+
+  bool failed() const { return this->failed_; }
+  bool finished() const { return this->finished_; }
+  uint32_t progress_done() const { return this->progress_done_; }
+  uint32_t progress_total() const { return this->progress_total_; }  // 0 = unknown
+  uint32_t steps() const { return this->steps_; }
+  uint32_t busy_us() const { return this->busy_us_; }
+  uint32_t longest_step_us() const { return this->longest_step_us_; }
+  uint32_t average_step_us() const { return this->steps_ ? this->busy_us_ / this->steps_ : 0; }
+  uint32_t wall_ms() const;  // From the first step to completion (or now)
+
+ protected:
+  friend class B48JobRunner;
+
+  const char *name_;
+  StepFunction step_;
+  FinishFunction on_finish_;
+  bool failed_{false};
+  bool finished_{false};
+  uint32_t progress_done_{0};
+  uint32_t progress_total_{0};
+  uint32_t steps_{0};
+  uint32_t busy_us_{0};
+  uint32_t longest_step_us_{0};
+  uint32_t started_ms_{0};
+  uint32_t finished_ms_{0};
+};
+
+/**
+ * @brief Cooperative scheduler for B48Jobs, driven from loop().
+ *
+ * run() steps the queued jobs round-robin until the microsecond budget is spent, then returns so the display
+ * state machine keeps its timing even on single-core chips. A step is only started if the job's average step
+ * fits in the remaining budget (the first step of a call always runs). Not thread-safe: loop task only.
+ */
+class B48JobRunner {
+ public:
+  // Completed job, kept for the report
+  struct JobSummary {
+    const char *name;
+    bool failed;
+    uint32_t progress_done;
+    uint32_t progress_total;
+    uint32_t steps;
+    uint32_t busy_us;
+    uint32_t longest_step_us;
+    uint32_t wall_ms;
+  };
+
+  /**
+   * @brief Queue a job
+   * @return false if a job with the same name is already queued (the new one is dropped)
+   */
+  bool submit(std::unique_ptr<B48Job> job);
+  bool is_queued(const char *name) const;
+  const B48Job *find(const char *name) const;  // Queued job by name, nullptr if none
+  bool idle() const { return this->queue_.empty(); }
+  size_t queued_count() const { return this->queue_.size(); }
+
+  /**
+   * @brief Step queued jobs within the budget
+   * @return Number of steps taken
+   */
+  size_t run(uint32_t budget_us);
+
+  // Run everything queued to completion, ignoring the budget (setup, tests and synchronous callers)
+  void drain();
+
+  // Step a job that is not queued until it finishes; runs its finish callback
+  static bool run_to_completion(B48Job &job);
+
+  // Log queued jobs with progress and time, recent completions and budget use
+  void log_report() const;
+
+  uint32_t budget_overruns() const { return this->budget_overruns_; }  // run() calls that went over budget
+
+  static constexpr size_t HISTORY_SIZE = 8;
+
+ protected:
+  void finish(B48Job &job);
+
+  std::deque<std::unique_ptr<B48Job>> queue_;
+  std::vector<JobSummary> history_;  // Most recent last
+  uint32_t run_calls_{0};
+  uint32_t budget_overruns_{0};
+  uint32_t longest_run_us_{0};
+  uint32_t total_busy_us_{0};
+};
+
+}  // namespace b48_display_controller
+}  // namespace esphome
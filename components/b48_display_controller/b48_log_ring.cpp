@@ -0,0 +1,253 @@
+#include "b48_log_ring.h"
+#include <Arduino.h>  // For millis()
+#include <cstdio>
+
+namespace esphome {
+namespace b48_display_controller {
+
+B48LogRing *global_log_ring = nullptr;
+
+B48LogRing::B48LogRing(size_t capacity_bytes) : buffer_(capacity_bytes), wrap_end_(capacity_bytes) {}
+
+uint32_t B48LogRing::now_ms() { return millis(); }
+
+uint8_t *B48LogRing::reserve(size_t length) {
+  if (length > this->buffer_.size() || length > UINT16_MAX) {
+    return nullptr;
+  }
+
+  if (this->head_ + length > this->buffer_.size()) {
+    // No room before the end of the buffer: drop the records stored there and continue at offset 0
+    while (this->count_ > 0 && this->tail_ >= this->head_) {
+      this->evict_oldest();
+    }
+    if (this->count_ == 0) {
+      this->tail_ = 0;
+      this->wrap_end_ = this->buffer_.size();
+    } else {
+      this->wrap_end_ = this->head_;
+    }
+    this->head_ = 0;
+  }
+
+  // Overwrite the oldest records that sit where the new one goes
+  while (this->count_ > 0 && this->tail_ >= this->head_ && this->tail_ < this->head_ + length) {
+    this->evict_oldest();
+  }
+  if (this->count_ == 0) {
+    this->tail_ = this->head_;
+    this->wrap_end_ = this->buffer_.size();
+  }
+
+  uint8_t *dest = &this->buffer_[this->head_];
+  this->head_ += length;
+  this->count_++;
+  return dest;
+}
+
+void B48LogRing::evict_oldest() {
+  LogRecordHeader header;
+  memcpy(&header, &this->buffer_[this->tail_], sizeof(header));
+  this->tail_ += header.length;
+  if (this->tail_ >= this->wrap_end_) {
+    this->tail_ = 0;
+    this->wrap_end_ = this->buffer_.size();
+  }
+  this->count_--;
+  this->overwritten_count_++;
+}
+
+uint8_t *B48LogRing::write_arg(uint8_t *dest, const void *value) {
+  dest[0] = ARG_POINTER;
+  memcpy(dest + 1, &value, sizeof(value));
+  return dest + 1 + sizeof(value);
+}
+
+uint8_t *B48LogRing::write_arg(uint8_t *dest, const char *value) {
+  if (value == nullptr) {
+    dest[0] = ARG_STRING;
+    dest[1] = 0;
+    return dest + 2;
+  }
+  size_t length = strnlen(value, MAX_STRING_LENGTH);
+  dest[0] = ARG_STRING;
+  if (length == MAX_STRING_LENGTH && value[length] != '\0') {
+    // Cut without splitting a UTF-8 sequence; the formatter appends "..."
+    dest[0] = ARG_STRING_TRUNCATED;
+    while (length > 0 && (static_cast<uint8_t>(value[length]) & 0xC0) == 0x80) {
+      length--;
+    }
+  }
+  dest[1] = static_cast<uint8_t>(length);
+  memcpy(dest + 2, value, length);
+  // Bytes dropped by the UTF-8 back-off end up as slack at the end of the record
+  return dest + 2 + length;
+}
+
+std::string B48LogRing::format(const LogRecordHeader &header, const uint8_t *payload) {
+  std::string out;
+  out.reserve(96);
+  char spec[24];
+  char buffer[80];
+  const uint8_t *arg = payload;
+  uint8_t args_left = header.arg_count;
+
+  for (const char *p = header.format; *p != '\0'; p++) {
+    if (*p != '%') {
+      out += *p;
+      continue;
+    }
+    if (p[1] == '%') {
+      out += '%';
+      p++;
+      continue;
+    }
+
+    // Keep flags, width and precision; drop length modifiers (numbers are stored widened to 64 bits)
+    size_t spec_len = 0;
+    spec[spec_len++] = '%';
+    const char *q = p + 1;
+    while (*q != '\0' && strchr("-+ #0123456789.", *q) != nullptr && spec_len < sizeof(spec) - 4) {
+      spec[spec_len++] = *q++;
+    }
+    while (*q != '\0' && strchr("hlLqjzt", *q) != nullptr) {
+      q++;
+    }
+    char conversion = *q;
+    if (conversion == '\0') {
+      break;
+    }
+    p = q;
+
+    if (args_left == 0) {
+      out += "<?>";
+      continue;
+    }
+    args_left--;
+    uint8_t type = arg[0];
+    const uint8_t *data = arg + 1;
+    std::string text;
+    if (type == ARG_STRING || type == ARG_STRING_TRUNCATED) {
+      text.assign(reinterpret_cast<const char *>(data + 1), data[0]);
+      if (type == ARG_STRING_TRUNCATED) {
+        text += "...";
+      }
+      arg = data + 1 + data[0];
+    } else if (type == ARG_POINTER) {
+      arg = data + sizeof(void *);
+    } else {
+      arg = data + 8;
+    }
+
+    bool is_number = type == ARG_INT || type == ARG_UINT;
+    buffer[0] = '\0';
+    switch (conversion) {
+      case 'd':
+      case 'i':
+      case 'u':
+      case 'x':
+      case 'X':
+      case 'o':
+      case 'c':
+        if (!is_number) {
+          out += "<?>";
+          continue;
+        }
+        if (conversion != 'c') {
+          spec[spec_len++] = 'l';
+          spec[spec_len++] = 'l';
+        }
+        spec[spec_len++] = conversion;
+        spec[spec_len] = '\0';
+        if (conversion == 'd' || conversion == 'i') {
+          int64_t value;
+          memcpy(&value, data, 8);
+          snprintf(buffer, sizeof(buffer), spec, static_cast<long long>(value));
+        } else {
+          uint64_t value;
+          memcpy(&value, data, 8);
+          if (conversion == 'c') {
+            snprintf(buffer, sizeof(buffer), spec, static_cast<int>(value));
+          } else {
+            snprintf(buffer, sizeof(buffer), spec, static_cast<unsigned long long>(value));
+          }
+        }
+        break;
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G': {
+        if (type != ARG_DOUBLE) {
+          out += "<?>";
+          continue;
+        }
+        double value;
+        memcpy(&value, data, 8);
+        spec[spec_len++] = conversion;
+        spec[spec_len] = '\0';
+        snprintf(buffer, sizeof(buffer), spec, value);
+        break;
+      }
+      case 's':
+        if (type != ARG_STRING && type != ARG_STRING_TRUNCATED) {
+          out += "<?>";
+          continue;
+        }
+        spec[spec_len++] = 's';
+        spec[spec_len] = '\0';
+        snprintf(buffer, sizeof(buffer), spec, text.c_str());
+        break;
+      case 'p': {
+        const void *value = nullptr;
+        if (type == ARG_POINTER) {
+          memcpy(&value, data, sizeof(value));
+        }
+        snprintf(buffer, sizeof(buffer), "%p", value);
+        break;
+      }
+      default:
+        out += "<?>";
+        continue;
+    }
+    out += buffer;
+  }
+  return out;
+}
+
+size_t B48LogRing::dump(const std::function<void(const LogRecordHeader &, const std::string &)> &callback) const {
+  size_t offset = this->tail_;
+  size_t wrap_end = this->wrap_end_;
+  for (size_t i = 0; i < this->count_; i++) {
+    if (offset >= wrap_end) {
+      offset = 0;
+      wrap_end = this->buffer_.size();
+    }
+    LogRecordHeader header;
+    memcpy(&header, &this->buffer_[offset], sizeof(header));
+    callback(header, format(header, &this->buffer_[offset] + sizeof(header)));
+    offset += header.length;
+  }
+  return this->count_;
+}
+
+void B48LogRing::clear() {
+  this->head_ = 0;
+  this->tail_ = 0;
+  this->wrap_end_ = this->buffer_.size();
+  this->count_ = 0;
+}
+
+size_t B48LogRing::used_bytes() const {
+  if (this->count_ == 0) {
+    return 0;
+  }
+  if (this->tail_ < this->head_) {
+    return this->head_ - this->tail_;
+  }
+  return (this->wrap_end_ - this->tail_) + this->head_;
+}
+
+}  // namespace b48_display_controller
+}  // namespace esphome
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace b48_display_controller {
+
+// Fixed part of every ring record. The format and tag must be string literals (only pointers are stored);
+// arg_count arguments follow, each as a type byte plus raw payload.
+struct LogRecordHeader {
+  uint32_t sequence;
+  uint32_t timestamp_ms;
+  const char *format;
+  const char *tag;
+  uint16_t length;  // Whole record including this header, padded to 4 bytes
+  char level;       // 'E', 'W', 'I', 'D' or 'V'
+  uint8_t arg_count;
+};
+
+/**
+ * @brief Byte ring of deferred-format log records for hot paths.
+ *
+ * record() copies the format pointer and the raw arguments (strings bounded to MAX_STRING_LENGTH bytes)
+ * and never formats or allocates; the oldest records are overwritten when the ring is full. Text is
+ * only produced by format()/dump(). Not thread-safe: call from the ESPHome loop task only.
+ */
+class B48LogRing {
+ public:
+  static constexpr size_t MAX_STRING_LENGTH = 48;
+
+  enum ArgType : uint8_t { ARG_INT, ARG_UINT, ARG_DOUBLE, ARG_POINTER, ARG_STRING, ARG_STRING_TRUNCATED };
+
+  explicit B48LogRing(size_t capacity_bytes);
+
+  template<typename... Args> void record(char level, const char *tag, const char *format, Args... args) {
+    size_t length = (sizeof(LogRecordHeader) + payload_size(args...) + 3) & ~static_cast<size_t>(3);
+    uint8_t *dest = this->reserve(length);
+    if (dest == nullptr) {
+      this->dropped_count_++;
+      return;
+    }
+    LogRecordHeader header;
+    header.sequence = ++this->recorded_count_;
+    header.timestamp_ms = now_ms();
+    header.format = format;
+    header.tag = tag;
+    header.length = static_cast<uint16_t>(length);
+    header.level = level;
+    header.arg_count = static_cast<uint8_t>(sizeof...(Args));
+    memcpy(dest, &header, sizeof(header));
+    write_args(dest + sizeof(header), args...);
+  }
+
+  /**
+   * @brief Render one record (as passed to dump callbacks) the way printf would have
+   */
+  static std::string format(const LogRecordHeader &header, const uint8_t *payload);
+
+  /**
+   * @brief Format every stored record, oldest first
+   * @return Number of records dumped
+   */
+  size_t dump(const std::function<void(const LogRecordHeader &, const std::string &)> &callback) const;
+
+  void clear();
+
+  size_t capacity_bytes() const { return this->buffer_.size(); }
+  size_t used_bytes() const;
+  size_t record_count() const { return this->count_; }
+  uint32_t recorded_count() const { return this->recorded_count_; }
+  uint32_t overwritten_count() const { return this->overwritten_count_; }
+  uint32_t dropped_count() const { return this->dropped_count_; }  // Records larger than the whole ring
+
+ protected:
+  static uint32_t now_ms();
+  uint8_t *reserve(size_t length);
+  void evict_oldest();
+
+  // --- Argument encoding: one type byte, then 8 bytes for numbers, a pointer, or length + bytes ---
+  static size_t payload_size() { return 0; }
+  template<typename T, typename... Rest> static size_t payload_size(T first, Rest... rest) {
+    return arg_size(first) + payload_size(rest...);
+  }
+  template<typename T> static typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value, size_t>::type
+  arg_size(T) {
+    return 1 + 8;
+  }
+  static size_t arg_size(const void *) { return 1 + sizeof(void *); }
+  static size_t arg_size(const char *value) { return 2 + (value ? strnlen(value, MAX_STRING_LENGTH) : 0); }
+  static size_t arg_size(char *value) { return arg_size(static_cast<const char *>(value)); }
+
+  static void write_args(uint8_t *) {}
+  template<typename T, typename... Rest> static void write_args(uint8_t *dest, T first, Rest... rest) {
+    write_args(write_arg(dest, first), rest...);
+  }
+  template<typename T>
+  static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, uint8_t *>::type write_arg(
+      uint8_t *dest, T value) {
+    int64_t widened = value;
+    return write_number(dest, ARG_INT, &widened);
+  }
+  template<typename T>
+  static typename std::enable_if<(std::is_integral<T>::value && std::is_unsigned<T>::value) || std::is_enum<T>::value,
+                                 uint8_t *>::type
+  write_arg(uint8_t *dest, T value) {
+    uint64_t widened = static_cast<uint64_t>(value);
+    return write_number(dest, ARG_UINT, &widened);
+  }
+  template<typename T>
+  static typename std::enable_if<std::is_floating_point<T>::value, uint8_t *>::type write_arg(uint8_t *dest, T value) {
+    double widened = value;
+    return write_number(dest, ARG_DOUBLE, &widened);
+  }
+  static uint8_t *write_arg(uint8_t *dest, const void *value);
+  static uint8_t *write_arg(uint8_t *dest, const char *value);
+  static uint8_t *write_arg(uint8_t *dest, char *value) { return write_arg(dest, static_cast<const char *>(value)); }
+  static uint8_t *write_number(uint8_t *dest, ArgType type, const void *value) {
+    dest[0] = type;
+    memcpy(dest + 1, value, 8);
+    return dest + 9;
+  }
+
+  std::vector<uint8_t> buffer_;
+  size_t head_{0};      // Where the next record is written
+  size_t tail_{0};      // Oldest record
+  size_t wrap_end_{0};  // End of valid data when the records wrap around the buffer end
+  size_t count_{0};
+  uint32_t recorded_count_{0};
+  uint32_t overwritten_count_{0};
+  uint32_t dropped_count_{0};
+};
+
+// Set by the controller when the ring is enabled; nullptr sends ring logs straight to the logger
+extern B48LogRing *global_log_ring;
+
+}  // namespace b48_display_controller
+}  // namespace esphome
+
+// Hot-path variants of ESP_LOGx. With the ring enabled they only capture the format and arguments;
+// otherwise they behave exactly like ESP_LOGx. Arguments must be printf-compatible (use c_str()).
+#define B48_RING_LOG(level, esp_macro, tag, format, ...) \
+  do { \
+    if (esphome::b48_display_controller::global_log_ring != nullptr) { \
+      esphome::b48_display_controller::global_log_ring->record(level, tag, format, ##__VA_ARGS__); \
+    } else { \
+      esp_macro(tag, format, ##__VA_ARGS__); \
+    } \
+  } while (0)
+
+#define B48_RLOGW(tag, format, ...) B48_RING_LOG('W', ESP_LOGW, tag, format, ##__VA_ARGS__)
+#define B48_RLOGI(tag, format, ...) B48_RING_LOG('I', ESP_LOGI, tag, format, ##__VA_ARGS__)
+#define B48_RLOGD(tag, format, ...) B48_RING_LOG('D', ESP_LOGD, tag, format, ##__VA_ARGS__)
+#define B48_RLOGV(tag, format, ...) B48_RING_LOG('V', ESP_LOGV, tag, format, ##__VA_ARGS__)
@@ -0,0 +1,73 @@
+#include "b48_message_table.h"
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace b48_display_controller {
+
+static const char *const TAG = "b48c.table";
+
+MessageHandle MessageTable::insert(const MessageEntry &entry) {
+  MessageHandle handle;
+  if (!this->free_slots_.empty()) {
+    handle.index = this->free_slots_.back();
+    this->free_slots_.pop_back();
+  } else {
+    if (this->slots_.size() >= MAX_SLOTS) {
+      ESP_LOGE(TAG, "Message table full (%zu slots)", this->slots_.size());
+      return MessageHandle();
+    }
+    handle.index = static_cast<uint16_t>(this->slots_.size());
+    this->slots_.emplace_back();
+  }
+
+  Slot &slot = this->slots_[handle.index];
+  slot.entry = entry;
+  slot.occupied = true;
+  handle.generation = slot.generation;
+  this->live_count_++;
+  return handle;
+}
+
+bool MessageTable::remove(MessageHandle handle) {
+  if (!this->contains(handle)) {
+    return false;
+  }
+  Slot &slot = this->slots_[handle.index];
+  slot.occupied = false;
+  slot.generation++;  // Invalidates every outstanding handle to this slot
+  // Drop the text now instead of when the slot is reused
+  slot.entry = MessageEntry();
+  this->free_slots_.push_back(handle.index);
+  this->live_count_--;
+  return true;
+}
+
+MessageEntry *MessageTable::get(MessageHandle handle) {
+  if (handle.index >= this->slots_.size()) {
+    return nullptr;
+  }
+  Slot &slot = this->slots_[handle.index];
+  return (slot.occupied && slot.generation == handle.generation) ? &slot.entry : nullptr;
+}
+
+const MessageEntry *MessageTable::get(MessageHandle handle) const {
+  if (handle.index >= this->slots_.size()) {
+    return nullptr;
+  }
+  const Slot &slot = this->slots_[handle.index];
+  return (slot.occupied && slot.generation == handle.generation) ? &slot.entry : nullptr;
+}
+
+size_t MessageTable::memory_usage() const {
+  size_t bytes = this->slots_.capacity() * sizeof(Slot) + this->free_slots_.capacity() * sizeof(uint16_t);
+  for (const auto &slot : this->slots_) {
+    if (slot.occupied) {
+      bytes += slot.entry.static_intro.capacity() + slot.entry.scrolling_message.capacity() +
+               slot.entry.next_message_hint.capacity();
+    }
+  }
+  return bytes;
+}
+
+}  // namespace b48_display_controller
+}  // namespace esphome
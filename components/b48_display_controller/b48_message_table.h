@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "b48_database_manager.h"  // For MessageEntry
+
+namespace esphome {
+namespace b48_display_controller {
+
+/**
+ * @brief Compact, trivially copyable reference to a MessageTable slot.
+ *
+ * A handle stays valid until its slot is removed; the slot's generation is bumped on removal,
+ * so a stale handle is detected with one compare instead of a refcount.
+ */
+struct MessageHandle {
+  uint16_t index{0xFFFF};
+  uint16_t generation{0};
+
+  bool is_valid() const { return this->index != 0xFFFF; }
+  bool operator==(const MessageHandle &other) const {
+    return this->index == other.index && this->generation == other.generation;
+  }
+  bool operator!=(const MessageHandle &other) const { return !(*this == other); }
+};
+
+static_assert(sizeof(MessageHandle) == 4, "MessageHandle must stay 4 bytes");
+
+/**
+ * @brief Central storage for every scheduled message (persistent, ephemeral and content pack).
+ *
+ * Entries live in a slot vector and are addressed by MessageHandle. Freed slots are recycled
+ * through a free list, so the table does not grow with message churn.
+ */
+class MessageTable {
+ public:
+  /**
+   * @brief Store an entry in a free slot (or a new one)
+   * @return Handle of the slot, or an invalid handle if the table is full
+   */
+  MessageHandle insert(const MessageEntry &entry);
+
+  /**
+   * @brief Free a slot. All handles to it become stale.
+   * @return false if the handle was already stale
+   */
+  bool remove(MessageHandle handle);
+
+  // Entry behind a handle, nullptr if the handle is stale or invalid
+  MessageEntry *get(MessageHandle handle);
+  const MessageEntry *get(MessageHandle handle) const;
+
+  bool contains(MessageHandle handle) const { return this->get(handle) != nullptr; }
+  size_t size() const { return this->live_count_; }
+  size_t slot_count() const { return this->slots_.size(); }
+
+  // Approximate heap footprint of the table itself (slots plus free list)
+  size_t memory_usage() const;
+
+  static constexpr size_t MAX_SLOTS = 0xFFFE;
+
+ protected:
+  struct Slot {
+    MessageEntry entry;
+    uint16_t generation{0};
+    bool occupied{false};
+  };
+
+  std::vector<Slot> slots_;
+  std::vector<uint16_t> free_slots_;
+  size_t live_count_{0};
+};
+
+}  // namespace b48_display_controller
+}  // namespace esphome
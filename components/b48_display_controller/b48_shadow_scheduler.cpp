@@ -0,0 +1,305 @@
+#include "b48_shadow_scheduler.h"
+#include "esphome/core/log.h"
+#include <Arduino.h>  // For micros()
+#include <algorithm>
+
+namespace esphome {
+namespace b48_display_controller {
+
+static const char *const TAG = "b48c.shadow";
+
+namespace {
+
+// Cycles through the rotation in key order, one slot each
+class RoundRobinPolicy : public B48SchedulingPolicy {
+ public:
+  const char *name() const override { return "round_robin"; }
+  size_t pick(const std::vector<ShadowCandidate> &candidates) override {
+    size_t index = 0;
+    for (size_t i = 0; i < candidates.size(); i++) {
+      if (this->has_last_ && candidates[i].key > this->last_key_) {
+        index = i;
+        break;
+      }
+    }
+    this->last_key_ = candidates[index].key;
+    this->has_last_ = true;
+    return index;
+  }
+
+ protected:
+  uint64_t last_key_{0};
+  bool has_last_{false};
+};
+
+// Longest-waiting candidate first; never-picked ones by arrival, then priority
+class OldestFirstPolicy : public B48SchedulingPolicy {
+ public:
+  const char *name() const override { return "oldest_first"; }
+  size_t pick(const std::vector<ShadowCandidate> &candidates) override {
+    size_t best = 0;
+    for (size_t i = 1; i < candidates.size(); i++) {
+      const ShadowCandidate &a = candidates[i];
+      const ShadowCandidate &b = candidates[best];
+      if (a.last_pick_slot != b.last_pick_slot) {
+        if (a.last_pick_slot < b.last_pick_slot) {
+          best = i;
+        }
+      } else if (a.first_seen_slot != b.first_seen_slot) {
+        if (a.first_seen_slot < b.first_seen_slot) {
+          best = i;
+        }
+      } else if (a.priority > b.priority) {
+        best = i;
+      }
+    }
+    return best;
+  }
+};
+
+// Highest priority always wins; equal priorities take turns
+class StrictPriorityPolicy : public B48SchedulingPolicy {
+ public:
+  const char *name() const override { return "strict_priority"; }
+  size_t pick(const std::vector<ShadowCandidate> &candidates) override {
+    size_t best = 0;
+    for (size_t i = 1; i < candidates.size(); i++) {
+      const ShadowCandidate &a = candidates[i];
+      const ShadowCandidate &b = candidates[best];
+      if (a.priority > b.priority || (a.priority == b.priority && a.last_pick_slot < b.last_pick_slot)) {
+        best = i;
+      }
+    }
+    return best;
+  }
+};
+
+// Random draw with priority + BASE_TICKETS tickets per candidate, so low priorities keep a chance
+class LotteryPolicy : public B48SchedulingPolicy {
+ public:
+  const char *name() const override { return "lottery"; }
+  size_t pick(const std::vector<ShadowCandidate> &candidates) override {
+    uint32_t total = 0;
+    for (const auto &candidate : candidates) {
+      total += tickets(candidate);
+    }
+    uint32_t draw = this->next_random() % total;
+    for (size_t i = 0; i < candidates.size(); i++) {
+      uint32_t held = tickets(candidates[i]);
+      if (draw < held) {
+        return i;
+      }
+      draw -= held;
+    }
+    return candidates.size() - 1;
+  }
+
+ protected:
+  static constexpr int BASE_TICKETS = 10;
+  static uint32_t tickets(const ShadowCandidate &candidate) {
+    return static_cast<uint32_t>(std::max(candidate.priority, 0) + BASE_TICKETS);
+  }
+  // xorshift32 with a fixed seed, so runs over the same traffic are comparable
+  uint32_t next_random() {
+    this->state_ ^= this->state_ << 13;
+    this->state_ ^= this->state_ >> 17;
+    this->state_ ^= this->state_ << 5;
+    return this->state_;
+  }
+  uint32_t state_{0x2545F491u};
+};
+
+}  // namespace
+
+std::unique_ptr<B48SchedulingPolicy> B48SchedulingPolicy::create(const std::string &name) {
+  if (name == "round_robin") {
+    return std::unique_ptr<B48SchedulingPolicy>(new RoundRobinPolicy());
+  }
+  if (name == "oldest_first") {
+    return std::unique_ptr<B48SchedulingPolicy>(new OldestFirstPolicy());
+  }
+  if (name == "strict_priority") {
+    return std::unique_ptr<B48SchedulingPolicy>(new StrictPriorityPolicy());
+  }
+  if (name == "lottery") {
+    return std::unique_ptr<B48SchedulingPolicy>(new LotteryPolicy());
+  }
+  return nullptr;
+}
+
+B48ShadowScheduler::B48ShadowScheduler() { this->policies_.resize(1); }
+
+bool B48ShadowScheduler::add_policy(const std::string &name) {
+  for (const auto &state : this->policies_) {
+    if (state.policy && name == state.policy->name()) {
+      ESP_LOGW(TAG, "Shadow policy %s is already configured", name.c_str());
+      return false;
+    }
+  }
+  std::unique_ptr<B48SchedulingPolicy> policy = B48SchedulingPolicy::create(name);
+  if (!policy) {
+    ESP_LOGE(TAG, "Unknown scheduling policy '%s'", name.c_str());
+    return false;
+  }
+  this->policies_.resize(this->policies_.size() + 1);
+  this->policies_.back().policy = std::move(policy);
+  return true;
+}
+
+void B48ShadowScheduler::evaluate(const std::vector<ShadowCandidate> &candidates, uint64_t live_key) {
+  if (candidates.empty()) {
+    return;
+  }
+  uint32_t start_us = micros();
+  uint32_t slot = this->slot_++;
+
+  this->view_.assign(candidates.begin(), candidates.end());
+  std::sort(this->view_.begin(), this->view_.end(),
+            [](const ShadowCandidate &a, const ShadowCandidate &b) { return a.key < b.key; });
+
+  for (auto &state : this->policies_) {
+    // Same rotation for everyone, but each policy sees the history its own picks would have produced
+    for (auto &candidate : this->view_) {
+      auto inserted = state.candidates.insert(std::make_pair(candidate.key, CandidateStats()));
+      CandidateStats &stats = inserted.first->second;
+      if (inserted.second) {
+        stats.first_seen_slot = slot;
+      }
+      stats.last_seen_slot = slot;
+      stats.eligible_slots++;
+      candidate.last_pick_slot = stats.last_pick_slot;
+      candidate.first_seen_slot = stats.first_seen_slot;
+    }
+
+    uint64_t picked_key = live_key;
+    if (state.policy) {
+      uint32_t pick_start_us = micros();
+      size_t index = state.policy->pick(this->view_);
+      uint32_t pick_us = micros() - pick_start_us;
+      state.pick_us_total += pick_us;
+      state.longest_pick_us = std::max(state.longest_pick_us, pick_us);
+      picked_key = this->view_[index < this->view_.size() ? index : 0].key;
+    }
+    if (picked_key == live_key) {
+      state.agreements++;
+    }
+
+    auto picked = state.candidates.find(picked_key);
+    if (picked != state.candidates.end()) {
+      CandidateStats &stats = picked->second;
+      int64_t since = stats.last_pick_slot >= 0 ? stats.last_pick_slot : stats.first_seen_slot;
+      state.longest_wait = std::max(state.longest_wait, static_cast<uint32_t>(slot - since));
+      stats.last_pick_slot = slot;
+      stats.picks++;
+    }
+    state.last_rotation_size = this->view_.size();
+
+    if (slot % PRUNE_INTERVAL_SLOTS == 0) {
+      this->prune(state);
+    }
+  }
+  this->last_evaluation_us_ = micros() - start_us;
+}
+
+void B48ShadowScheduler::prune(PolicyState &state) {
+  // Candidates missing from the latest slot have left the rotation (expired, deleted, retired)
+  uint32_t latest = this->slot_ - 1;
+  for (auto it = state.candidates.begin(); it != state.candidates.end();) {
+    if (it->second.last_seen_slot != latest) {
+      it = state.candidates.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+B48ShadowScheduler::PolicyReport B48ShadowScheduler::report_policy(const PolicyState &state) const {
+  PolicyReport report{};
+  report.name = state.policy ? state.policy->name() : "active";
+  report.slots = this->slot_;
+  report.longest_wait = state.longest_wait;
+  if (this->slot_ == 0) {
+    report.fairness = 1.0f;
+    return report;
+  }
+
+  // Only candidates in the latest slot count; the rest have left the rotation
+  uint32_t latest = this->slot_ - 1;
+  uint32_t starvation_slots = STARVATION_FACTOR * state.last_rotation_size;
+  double share_sum = 0.0;
+  double share_square_sum = 0.0;
+  uint32_t current = 0;
+  for (const auto &entry : state.candidates) {
+    const CandidateStats &stats = entry.second;
+    if (stats.last_seen_slot != latest) {
+      continue;
+    }
+    current++;
+    double share = static_cast<double>(stats.picks) / stats.eligible_slots;
+    share_sum += share;
+    share_square_sum += share * share;
+    if (stats.picks > 0) {
+      report.distinct_picked++;
+    } else {
+      report.never_picked++;
+    }
+    int64_t since = stats.last_pick_slot >= 0 ? stats.last_pick_slot : stats.first_seen_slot;
+    uint32_t waiting = static_cast<uint32_t>(latest - since);
+    report.longest_wait = std::max(report.longest_wait, waiting);
+    if (waiting > starvation_slots) {
+      report.starved++;
+    }
+  }
+  report.fairness = share_square_sum > 0.0 ? static_cast<float>(share_sum * share_sum / (current * share_square_sum))
+                                           : (current == 0 ? 1.0f : 0.0f);
+  report.agreement = static_cast<float>(state.agreements) / this->slot_;
+  if (state.policy) {
+    report.average_pick_us = state.pick_us_total / this->slot_;
+    report.longest_pick_us = state.longest_pick_us;
+  }
+  return report;
+}
+
+std::vector<B48ShadowScheduler::PolicyReport> B48ShadowScheduler::report() const {
+  std::vector<PolicyReport> reports;
+  reports.reserve(this->policies_.size());
+  for (const auto &state : this->policies_) {
+    reports.push_back(this->report_policy(state));
+  }
+  return reports;
+}
+
+size_t B48ShadowScheduler::tracked_candidates() const {
+  size_t tracked = 0;
+  for (const auto &state : this->policies_) {
+    tracked = std::max(tracked, state.candidates.size());
+  }
+  return tracked;
+}
+
+void B48ShadowScheduler::log_report() const {
+  ESP_LOGI(TAG, "Scheduling: %u slots, %zu shadow policies, %zu candidates tracked, last evaluation %u us",
+           (unsigned) this->slot_, this->policy_count(), this->tracked_candidates(),
+           (unsigned) this->last_evaluation_us_);
+  ESP_LOGI(TAG, "  policy          | fairness | longest wait | starved | never | agree | pick us avg/max");
+  for (const auto &report : this->report()) {
+    ESP_LOGI(TAG, "  %-15s | %8.3f | %12u | %7u | %5u | %4.0f%% | %u/%u", report.name, report.fairness,
+             (unsigned) report.longest_wait, (unsigned) report.starved, (unsigned) report.never_picked,
+             report.agreement * 100.0f, (unsigned) report.average_pick_us, (unsigned) report.longest_pick_us);
+  }
+}
+
+void B48ShadowScheduler::reset() {
+  for (auto &state : this->policies_) {
+    state.candidates.clear();
+    state.agreements = 0;
+    state.longest_wait = 0;
+    state.pick_us_total = 0;
+    state.longest_pick_us = 0;
+    state.last_rotation_size = 0;
+  }
+  this->slot_ = 0;
+}
+
+}  // namespace b48_display_controller
+}  // namespace esphome
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace esphome {
+namespace b48_display_controller {
+
+// One schedulable slot as a policy sees it. Variant groups are already collapsed into one candidate.
+struct ShadowCandidate {
+  uint64_t key;              // Stable across cache refreshes: the message handle, or the variant group
+  int priority;
+  int64_t last_pick_slot;    // This policy's own history; -1 = never picked
+  uint32_t first_seen_slot;  // Slot in which the candidate joined the rotation
+};
+
+/**
+ * @brief Selection policy that can be evaluated next to the live scheduler.
+ *
+ * pick() sees the candidates with the history the policy itself would have produced, never the live one,
+ * so its metrics show how the rotation would behave if it were in charge.
+ */
+class B48SchedulingPolicy {
+ public:
+  virtual ~B48SchedulingPolicy() = default;
+  virtual const char *name() const = 0;
+
+  /**
+   * @brief Choose the next message
+   * @param candidates Non-empty, in a stable order (by key)
+   * @return Index into candidates
+   */
+  virtual size_t pick(const std::vector<ShadowCandidate> &candidates) = 0;
+
+  // round_robin, oldest_first, strict_priority or lottery; nullptr for an unknown name
+  static std::unique_ptr<B48SchedulingPolicy> create(const std::string &name);
+};
+
+/**
+ * @brief Runs shadow policies against the live message set and keeps comparable metrics for each.
+ *
+ * Every live selection is one slot. Each shadow policy picks from the same candidates using its own
+ * counterfactual history; the live pick is tracked the same way as the "active" row. Nothing is sent to the
+ * display. Per-candidate state is dropped once a candidate has left the rotation, so memory follows the
+ * message set. Not thread-safe: call with the controller's message mutex held.
+ */
+class B48ShadowScheduler {
+ public:
+  // Metrics of one policy since the last reset
+  struct PolicyReport {
+    const char *name;
+    uint32_t slots;
+    uint32_t distinct_picked;  // Candidates picked at least once (current rotation)
+    float fairness;            // Jain's index of each candidate's share of the slots it was eligible for
+    uint32_t longest_wait;     // Most slots a candidate waited between picks (or since it joined)
+    uint32_t starved;          // Current candidates waiting more than STARVATION_FACTOR x rotation size
+    uint32_t never_picked;     // Current candidates not picked since they joined
+    float agreement;           // Share of slots with the same pick as the live scheduler
+    uint32_t average_pick_us;
+    uint32_t longest_pick_us;
+  };
+
+  B48ShadowScheduler();
+
+  bool add_policy(const std::string &name);  // false for an unknown or duplicate name
+  bool enabled() const { return this->policies_.size() > 1; }
+  size_t policy_count() const { return this->policies_.size() - 1; }  // Shadow policies only
+
+  /**
+   * @brief Record one live selection and let every shadow policy pick from the same candidates
+   * @param candidates Current rotation, collapsed by variant group
+   * @param live_key Key of the live pick
+   */
+  void evaluate(const std::vector<ShadowCandidate> &candidates, uint64_t live_key);
+
+  std::vector<PolicyReport> report() const;  // Active row first
+  void log_report() const;
+  void reset();
+
+  uint32_t evaluation_us() const { return this->last_evaluation_us_; }  // Cost of the last evaluate()
+  size_t tracked_candidates() const;  // Most candidates any policy keeps state for
+
+  static constexpr uint32_t STARVATION_FACTOR = 2;
+  static constexpr uint32_t PRUNE_INTERVAL_SLOTS = 32;
+
+ protected:
+  struct CandidateStats {
+    int64_t last_pick_slot{-1};
+    uint32_t first_seen_slot{0};
+    uint32_t last_seen_slot{0};
+    uint32_t eligible_slots{0};
+    uint32_t picks{0};
+  };
+
+  struct PolicyState {
+    std::unique_ptr<B48SchedulingPolicy> policy;  // nullptr for the live scheduler
+    std::map<uint64_t, CandidateStats> candidates;
+    uint32_t agreements{0};
+    uint32_t longest_wait{0};
+    uint32_t pick_us_total{0};
+    uint32_t longest_pick_us{0};
+    uint32_t last_rotation_size{0};
+  };
+
+  PolicyReport report_policy(const PolicyState &state) const;
+  void prune(PolicyState &state);
+
+  std::vector<PolicyState> policies_;  // [0] = live scheduler
+  std::vector<ShadowCandidate> view_;  // Reused between evaluations
+  uint32_t slot_{0};
+  uint32_t last_evaluation_us_{0};
+};
+
+}  // namespace b48_display_controller
+}  // namespace esphome
@@ -1,5 +1,6 @@
 #include "buse120_serial_protocol.h"
 #include "esphome/core/log.h"
+#include "esphome/core/hal.h"  // For micros()
 #include <sstream>
 #include <iomanip>
 #include <cstring>
@@ -10,6 +11,12 @@ namespace b48_display_controller {
 static const char *const TAG = "buse120";
 
 bool BUSE120SerialProtocol::send_command(const std::string &payload) {
+#ifdef B48_FAULT_INJECTION
+  bool delivered = false;
+  if (fault_intercept(reinterpret_cast<const uint8_t *>(payload.data()), payload.length(), true, &delivered)) {
+    return delivered;
+  }
+#endif
   if (!this->uart_) {
     ESP_LOGE(TAG, "UART not initialized");
     return false;
@@ -28,6 +35,7 @@ bool BUSE120SerialProtocol::send_command(const std::string &payload) {
   ESP_LOGV(TAG, "Bytes: %s", debug_bytes.c_str());
 
   // Send payload
+  this->account_write(payload.length() + 2);
   this->uart_->write_array(reinterpret_cast<const uint8_t *>(payload.c_str()), payload.length());
 
   // Send terminator (CR)
@@ -87,43 +95,51 @@ void BUSE120SerialProtocol::send_invert_command() {
   send_command(payload);
 }
 
-void BUSE120SerialProtocol::send_line_number(int line) {
+std::string BUSE120SerialProtocol::line_number_payload(int line) {
   char payload[5];
   snprintf(payload, sizeof(payload), "l%03d", line);
-  send_command(payload);
+  return payload;
 }
 
-void BUSE120SerialProtocol::send_tarif_zone(int zone) {
+std::string BUSE120SerialProtocol::tarif_zone_payload(int zone) {
   char payload[9];
   snprintf(payload, sizeof(payload), "e%03d000", zone);
-  send_command(payload);
+  return payload;
 }
 
-void BUSE120SerialProtocol::send_static_intro(const std::string &text) {
+std::string BUSE120SerialProtocol::static_intro_payload(const std::string &text) {
   // Convert Czech characters to display encoding first
   std::string encoded = encode_czech_characters(text);
   // Safely truncate to 15 bytes without breaking multi-byte sequences
-  std::string truncated = safe_truncate(encoded, 15);
-  std::string payload = "zI " + truncated;
-  send_command(payload);
+  return "zI " + safe_truncate(encoded, 15);
 }
 
-void BUSE120SerialProtocol::send_scrolling_message(const std::string &text) {
+std::string BUSE120SerialProtocol::scrolling_message_payload(const std::string &text) {
   // Convert Czech characters to display encoding first
   std::string encoded = encode_czech_characters(text);
   // Safely truncate to 511 bytes without breaking multi-byte sequences
-  std::string truncated = safe_truncate(encoded, 511);
-  std::string payload = "zM " + truncated;
-  send_command(payload);
+  return "zM " + safe_truncate(encoded, 511);
 }
 
-void BUSE120SerialProtocol::send_next_message_hint(const std::string &text) {
+std::string BUSE120SerialProtocol::next_message_hint_payload(const std::string &text) {
   // Convert Czech characters to display encoding first
   std::string encoded = encode_czech_characters(text);
   // Safely truncate to 15 bytes without breaking multi-byte sequences
-  std::string truncated = safe_truncate(encoded, 15);
-  std::string payload = "v " + truncated;
-  send_command(payload);
+  return "v " + safe_truncate(encoded, 15);
+}
+
+void BUSE120SerialProtocol::send_line_number(int line) { send_command(line_number_payload(line)); }
+
+void BUSE120SerialProtocol::send_tarif_zone(int zone) { send_command(tarif_zone_payload(zone)); }
+
+void BUSE120SerialProtocol::send_static_intro(const std::string &text) { send_command(static_intro_payload(text)); }
+
+void BUSE120SerialProtocol::send_scrolling_message(const std::string &text) {
+  send_command(scrolling_message_payload(text));
+}
+
+void BUSE120SerialProtocol::send_next_message_hint(const std::string &text) {
+  send_command(next_message_hint_payload(text));
 }
 
 void BUSE120SerialProtocol::send_time_update(int hour, int minute) {
@@ -139,6 +155,13 @@ void BUSE120SerialProtocol::switch_to_cycle(int cycle) {
 }
 
 bool BUSE120SerialProtocol::send_raw_payload(const std::string &raw_payload) {
+#ifdef B48_FAULT_INJECTION
+  bool delivered = false;
+  if (fault_intercept(reinterpret_cast<const uint8_t *>(raw_payload.data()), raw_payload.length(), true,
+                      &delivered)) {
+    return delivered;
+  }
+#endif
   if (!this->uart_) {
     ESP_LOGE(TAG, "UART not initialized for raw payload");
     return false;
@@ -156,6 +179,7 @@ bool BUSE120SerialProtocol::send_raw_payload(const std::string &raw_payload) {
   ESP_LOGV(TAG, "Raw payload bytes: %s", debug_bytes.c_str());
 
   // Send payload
+  this->account_write(raw_payload.length() + 2);
   this->uart_->write_array(reinterpret_cast<const uint8_t *>(raw_payload.c_str()), raw_payload.length());
 
   // Send terminator (CR)
@@ -167,5 +191,73 @@ bool BUSE120SerialProtocol::send_raw_payload(const std::string &raw_payload) {
   return true;
 }
 
+std::string BUSE120SerialProtocol::build_wire_frame(const std::string &payload) {
+  std::string frame = payload;
+  frame += CR;
+  frame += static_cast<char>(calculate_checksum(payload));
+  return frame;
+}
+
+bool BUSE120SerialProtocol::send_wire_frames(const uint8_t *data, size_t length) {
+#ifdef B48_FAULT_INJECTION
+  bool delivered = false;
+  if (fault_intercept(data, length, false, &delivered)) {
+    return delivered;
+  }
+#endif
+  if (!this->uart_) {
+    ESP_LOGE(TAG, "UART not initialized for prebuilt frames");
+    return false;
+  }
+
+  ESP_LOGV(TAG, "Sending %zu bytes of prebuilt frames", length);
+  this->account_write(length);
+  this->uart_->write_array(data, length);
+  return true;
+}
+
+uint32_t BUSE120SerialProtocol::estimate_wire_us(size_t bytes) const {
+  // Without a UART, assume the display's usual 1200 baud 7E2: 1 start + 7 data + 1 parity + 2 stop bits
+  uint32_t baud = 1200;
+  uint32_t bits_per_byte = 11;
+  if (this->uart_ && this->uart_->get_baud_rate() > 0) {
+    baud = this->uart_->get_baud_rate();
+    bits_per_byte = 1 + this->uart_->get_data_bits() + this->uart_->get_stop_bits() +
+                    (this->uart_->get_parity() != uart::UART_CONFIG_PARITY_NONE ? 1 : 0);
+  }
+  return static_cast<uint32_t>(static_cast<uint64_t>(bytes) * bits_per_byte * 1000000ULL / baud);
+}
+
+uint32_t BUSE120SerialProtocol::wire_pending_us() const {
+  int32_t pending = static_cast<int32_t>(this->wire_busy_until_us_ - micros());
+  return pending > 0 ? static_cast<uint32_t>(pending) : 0;
+}
+
+void BUSE120SerialProtocol::account_write(size_t bytes) {
+  // Bytes start on the wire once the previous write has drained
+  uint32_t start_us = micros() + this->wire_pending_us();
+  this->wire_busy_until_us_ = start_us + this->estimate_wire_us(bytes);
+  this->bytes_written_ += bytes;
+}
+
+#ifdef B48_FAULT_INJECTION
+bool BUSE120SerialProtocol::fault_intercept(const uint8_t *data, size_t length, bool single_frame, bool *delivered) {
+  if (global_fault_injector == nullptr) {
+    return false;
+  }
+  switch (global_fault_injector->intercept_uart_write(data, length, single_frame)) {
+    case B48FaultInjector::UART_DROPPED:
+      ESP_LOGV(TAG, "Injected UART stall: dropped %zu bytes", length);
+      *delivered = false;
+      return true;
+    case B48FaultInjector::UART_CAPTURED:
+      *delivered = true;
+      return true;
+    default:
+      return false;
+  }
+}
+#endif
+
 }  // namespace b48_display_controller
-}  // namespace esphome
\ No newline at end of file
+}  // namespace esphome
@@ -2,6 +2,7 @@
 
 #include "esphome/components/uart/uart.h"
 #include "character_mappings.h"
+#include "b48_fault_injection.h"
 #include <string>
 #include <cstdint>
 #include <memory>
@@ -88,6 +89,29 @@ class BUSE120SerialProtocol {
    */
   bool send_raw_payload(const std::string &raw_payload);
 
+  /**
+   * @brief Write bytes that already contain complete frames (payload, CR and checksum).
+   * Used for pre-encoded content, e.g. frames read in place from the content pack partition.
+   * @param data Pointer to the wire bytes
+   * @param length Number of bytes to write
+   * @return true if successful, false otherwise.
+   */
+  bool send_wire_frames(const uint8_t *data, size_t length);
+
+  /**
+   * @brief Build the complete wire representation of a command (payload + CR + checksum)
+   * @param payload The command payload
+   * @return The bytes exactly as send_command() would put them on the wire
+   */
+  static std::string build_wire_frame(const std::string &payload);
+
+  // Payload builders shared by the send_* methods and the content pack exporter
+  static std::string line_number_payload(int line);
+  static std::string tarif_zone_payload(int zone);
+  static std::string static_intro_payload(const std::string &text);
+  static std::string scrolling_message_payload(const std::string &text);
+  static std::string next_message_hint_payload(const std::string &text);
+
   /**
    * @brief Convert Czech UTF-8 characters to display encoding (\x0e prefix format)
    * @param text The text to encode
@@ -102,17 +126,46 @@ class BUSE120SerialProtocol {
    * @return Safely truncated string
    */
   static std::string safe_truncate(const std::string &text, size_t max_bytes);
-  
+
+  /**
+   * @brief Estimate how long bytes take on the wire with the UART's framing
+   * @param bytes Number of bytes
+   * @return Microseconds at the configured baud rate, start, data, parity and stop bits
+   */
+  uint32_t estimate_wire_us(size_t bytes) const;
+
+  /**
+   * @brief Time until everything written so far has left the UART (estimate, 0 = drained)
+   * Writes queue behind each other, so this holds whether write_array() buffers or blocks.
+   */
+  uint32_t wire_pending_us() const;
+
+  uint32_t bytes_written() const { return this->bytes_written_; }
+
  private:
+  // Extend the wire estimate by a write that went to the UART
+  void account_write(size_t bytes);
+
   /**
    * @brief Calculate the checksum for a payload
    * @param payload The payload to calculate checksum for
    * @return The calculated checksum byte
    */
-  uint8_t calculate_checksum(const std::string &payload);
+  static uint8_t calculate_checksum(const std::string &payload);
+
+#ifdef B48_FAULT_INJECTION
+  /**
+   * @brief Let an active fault injector drop or capture a write
+   * @param delivered Set to whether the write counts as sent
+   * @return true if the injector consumed the write and the UART must not be touched
+   */
+  static bool fault_intercept(const uint8_t *data, size_t length, bool single_frame, bool *delivered);
+#endif
   
   // Member variables
   uart::UARTComponent *uart_{nullptr};
+  uint32_t wire_busy_until_us_{0};  // micros() at which the last written byte leaves the UART (estimate)
+  uint32_t bytes_written_{0};
   static constexpr char CR = 0x0D;  // Carriage Return for BUSE120 protocol
 };
 